@@ -0,0 +1,340 @@
+// Microbenchmarks for the FileSystem layer against the original
+// implementations (bench/Legacy.cpp), on a reproducible synthetic tree.
+//
+//   make bench BENCH_ARGS="--depth 4 --files 64 --iters 50"
+//   build/mfe-bench --dir /mnt/nfs/scratch --io=uring
+
+#include "DirSizeCache.h"
+#include "DiskUsage.h"
+#include "FileSystem.h"
+#include "IoStats.h"
+#include "Legacy.h"
+#include "ListingCache.h"
+#include "StatBatch.h"
+#include "TreeGen.h"
+#include "WorkPool.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Options
+{
+    TreeSpec spec;
+    std::string dir;                            // where to build the trees; a temp dir by default
+    unsigned flat = 20000;                      // entries in the flat directory listed by listDir
+    std::uint64_t copySize = 16ULL * 1024 * 1024;
+    unsigned iters = 20;
+    bool keep = false;
+};
+
+// Counts every syscall made by the process's threads through the
+// raw_syscalls:sys_enter tracepoint, one perf counter per thread. Needs
+// tracefs and perf permission; without them the benchmarks fall back to the
+// IoStats counters, which only see the directory engines.
+class SyscallCounter
+{
+public:
+    ~SyscallCounter() {
+        for (int fd : fds_) ::close(fd);
+    }
+
+    bool open() {
+        std::uint64_t id = 0;
+        for (const char *p : {"/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+                              "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"}) {
+            std::ifstream in(p);
+            if (in >> id) break;
+        }
+        if (id == 0) return false;
+
+        DIR *tasks = ::opendir("/proc/self/task");
+        if (!tasks) return false;
+        while (dirent *e = ::readdir(tasks)) {
+            if (e->d_name[0] == '.') continue;
+            struct perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.type = PERF_TYPE_TRACEPOINT;
+            attr.size = sizeof(attr);
+            attr.config = id;
+            int fd = static_cast<int>(::syscall(__NR_perf_event_open, &attr, std::atoi(e->d_name), -1, -1,
+                                                PERF_FLAG_FD_CLOEXEC));
+            if (fd < 0) {
+                ::closedir(tasks);
+                return false;
+            }
+            fds_.push_back(fd);
+        }
+        ::closedir(tasks);
+
+        // reading the counters is itself a syscall per thread; measure and subtract it
+        std::uint64_t a = rawRead();
+        overhead_ = rawRead() - a;
+        return true;
+    }
+
+    std::uint64_t read() { return rawRead() - overhead_; }
+
+private:
+    std::uint64_t rawRead() {
+        std::uint64_t total = 0;
+        for (int fd : fds_) {
+            std::uint64_t v = 0;
+            if (::read(fd, &v, sizeof(v)) == sizeof(v)) total += v;
+        }
+        return total;
+    }
+
+    std::vector<int> fds_;
+    std::uint64_t overhead_ = 0;
+};
+
+SyscallCounter syscallCounter;
+bool exactSyscalls = false;
+
+std::uint64_t syscallsNow() {
+    return exactSyscalls ? syscallCounter.read() : ioSnapshot().syscalls();
+}
+
+struct Result
+{
+    std::string name;
+    std::string impl;
+    double opsPerSec = 0;
+    double p50 = 0; // seconds
+    double p99 = 0;
+    double syscallsPerOp = -1; // -1: not measurable
+};
+
+std::vector<Result> results;
+
+// Runs `op` once untimed and then `iters` times, calling `setup` (untimed)
+// before each run.
+void measure(const std::string &name, const std::string &impl, unsigned iters,
+             const std::function<void()> &setup, const std::function<void()> &op, bool countable = true) {
+    setup();
+    op();
+
+    std::vector<double> lat;
+    lat.reserve(iters);
+    std::uint64_t syscalls = 0;
+    double total = 0;
+    for (unsigned i = 0; i < iters; ++i) {
+        setup();
+        std::uint64_t s0 = syscallsNow();
+        auto t0 = std::chrono::steady_clock::now();
+        op();
+        double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        syscalls += syscallsNow() - s0;
+        lat.push_back(dt);
+        total += dt;
+    }
+    std::sort(lat.begin(), lat.end());
+
+    Result r;
+    r.name = name;
+    r.impl = impl;
+    r.opsPerSec = total > 0 ? iters / total : 0;
+    r.p50 = lat[lat.size() / 2];
+    r.p99 = lat[std::min(lat.size() - 1, static_cast<std::size_t>(lat.size() * 0.99))];
+    if (countable) r.syscallsPerOp = static_cast<double>(syscalls) / iters;
+    results.push_back(r);
+    std::cerr << "  " << name << " [" << impl << "] done\n";
+}
+
+std::string formatLatency(double s) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(s < 1e-3 ? 1 : 2);
+    if (s < 1e-3) out << s * 1e6 << "us";
+    else if (s < 1) out << s * 1e3 << "ms";
+    else out << s << "s";
+    return out.str();
+}
+
+void printResults() {
+    std::cout << std::left << std::setw(28) << "benchmark" << std::setw(10) << "impl"
+              << std::right << std::setw(12) << "ops/s" << std::setw(12) << "p50" << std::setw(12) << "p99"
+              << std::setw(14) << "syscalls/op" << "\n";
+    std::cout << std::string(88, '-') << "\n";
+    for (const Result &r : results) {
+        std::cout << std::left << std::setw(28) << r.name << std::setw(10) << r.impl << std::right
+                  << std::setw(12) << std::fixed << std::setprecision(1) << r.opsPerSec
+                  << std::setw(12) << formatLatency(r.p50) << std::setw(12) << formatLatency(r.p99)
+                  << std::setw(14);
+        if (r.syscallsPerOp < 0) std::cout << "-";
+        else std::cout << std::setprecision(0) << r.syscallsPerOp;
+        std::cout << "\n";
+    }
+    std::cout << "\nsyscalls: " << (exactSyscalls ? "all syscalls, raw_syscalls:sys_enter perf counter"
+                                                  : "open/getdents/stat only (IoStats); legacy not measurable")
+              << "\n";
+}
+
+void usage() {
+    std::cout << "Usage: mfe-bench [options]\n"
+                 "  --dir PATH          build the trees in a new PATH/mfe-bench-XXXXXX (default: /tmp)\n"
+                 "  --fanout N          subdirectories per directory (4)\n"
+                 "  --depth N           directory levels (3)\n"
+                 "  --files N           files per directory (32)\n"
+                 "  --size-dist D       fixed | uniform | lognormal (lognormal)\n"
+                 "  --mean-size BYTES   mean file size (4096)\n"
+                 "  --hardlinks RATIO   share of files that are hard links (0.05)\n"
+                 "  --seed N            generator seed (42)\n"
+                 "  --flat N            entries in the listDir directory (20000)\n"
+                 "  --copy-size BYTES   size of the file copied by copyFile (16 MiB)\n"
+                 "  --iters N           measured iterations per benchmark (20)\n"
+                 "  --io=sync|uring     stat backend for the current engines\n"
+                 "  --keep              do not delete the generated trees\n";
+}
+
+bool parseArgs(int argc, char **argv, Options &opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                std::cerr << "missing value for " << a << "\n";
+                std::exit(2);
+            }
+            return argv[++i];
+        };
+        if (a == "--dir") opt.dir = value();
+        else if (a == "--fanout") opt.spec.fanout = static_cast<unsigned>(std::stoul(value()));
+        else if (a == "--depth") opt.spec.depth = static_cast<unsigned>(std::stoul(value()));
+        else if (a == "--files") opt.spec.filesPerDir = static_cast<unsigned>(std::stoul(value()));
+        else if (a == "--mean-size") opt.spec.meanSize = std::stoull(value());
+        else if (a == "--hardlinks") opt.spec.hardLinkRatio = std::stod(value());
+        else if (a == "--seed") opt.spec.seed = std::stoull(value());
+        else if (a == "--flat") opt.flat = static_cast<unsigned>(std::stoul(value()));
+        else if (a == "--copy-size") opt.copySize = std::stoull(value());
+        else if (a == "--iters") opt.iters = std::max(1u, static_cast<unsigned>(std::stoul(value())));
+        else if (a == "--keep") opt.keep = true;
+        else if (a == "--size-dist") {
+            if (!parseSizeDist(value(), opt.spec.sizeDist)) return false;
+        } else if (a.rfind("--io=", 0) == 0) {
+            StatBackend backend;
+            if (!parseStatBackend(a.substr(5), backend)) return false;
+            setStatBackend(backend);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage();
+        return 2;
+    }
+
+    // always a fresh directory of our own, which is all the cleanup removes
+    std::string base = opt.dir.empty() ? "/tmp" : opt.dir;
+    if (::mkdir(base.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::perror(base.c_str());
+        return 1;
+    }
+    std::string tmpl = base + "/mfe-bench-XXXXXX";
+    if (!::mkdtemp(&tmpl[0])) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    opt.dir = tmpl;
+    const std::string tree = opt.dir + "/tree", flat = opt.dir + "/flat", copySrc = opt.dir + "/copy.bin";
+    // keep the directory size cache away from the user's real one
+    ::setenv("MFE_CACHE_DIR", (opt.dir + "/cache").c_str(), 1);
+
+    std::cerr << "generating in " << opt.dir << " (fanout " << opt.spec.fanout << ", depth " << opt.spec.depth
+              << ", " << opt.spec.filesPerDir << " files/dir, " << sizeDistName(opt.spec.sizeDist) << " sizes)\n";
+    TreeStats stats;
+    if (!TreeGen::generate(tree, opt.spec, stats) || !TreeGen::generateFlat(flat, opt.flat, opt.spec.seed) ||
+        !TreeGen::generateFile(copySrc, opt.copySize, opt.spec.seed)) {
+        std::perror("generate");
+        return 1;
+    }
+    const auto generated = std::chrono::steady_clock::now();
+    std::cout << "tree: " << stats.dirs << " dirs, " << stats.files << " files (" << stats.hardLinks
+              << " hard links), " << stats.bytes << " bytes; stat backend " << statBackendName(statBackend())
+              << "\n";
+
+    // start the pool first so the per-thread syscall counters cover its workers
+    WorkPool::shared();
+    exactSyscalls = syscallCounter.open();
+
+    auto none = [] {};
+    const unsigned n = opt.iters;
+
+    std::string listName = "listDir (" + std::to_string(opt.flat) + ")";
+    // every timed run reads the directory; the ListingCache hit is measured on its own
+    auto uncached = [] { ListingCache::instance().clear(); };
+    measure(listName, "current", n, uncached, [&] { FileSystem::listDir(flat); });
+    measure(listName, "legacy", n, none, [&] { legacy::listDir(flat); });
+    measure("listDir (" + std::to_string(opt.flat) + ", cached)", "current", n, none, [&] { FileSystem::listDir(flat); });
+
+    std::size_t hitsNow = 0, hitsLegacy = 0;
+    measure("search", "current", n, none, [&] {
+        std::vector<std::pair<std::string, bool>> r;
+        FileSystem::search(tree, TreeGen::MATCH_WORD, r, false);
+        hitsNow = r.size();
+    });
+    measure("search", "legacy", n, none, [&] {
+        std::vector<std::pair<std::string, bool>> r;
+        legacy::search(tree, TreeGen::MATCH_WORD, r);
+        hitsLegacy = r.size();
+    });
+    if (hitsNow != hitsLegacy)
+        std::cout << "warning: search found " << hitsNow << " (current) vs " << hitsLegacy << " (legacy)\n";
+
+    measure("calcDirSize (no cache)", "current", n, none, [&] { DiskUsage::scan(tree, false); });
+    // DirSizeCache is opt-in, and skips directories changed in the last two seconds; let the fresh tree age first
+    DirSizeCache::setEnabled(true);
+    std::this_thread::sleep_until(generated + std::chrono::milliseconds(2100));
+    measure("calcDirSize (cached)", "current", n, none, [&] { FileSystem::calcDirSize(tree); });
+    measure("calcDirSize", "legacy", n, none, [&] { legacy::calcDirSize(tree); });
+
+    const std::string copyDst = opt.dir + "/copy.out";
+    auto removeCopy = [&] { ::unlink(copyDst.c_str()); };
+    measure("copyFile", "current", n, removeCopy, [&] { FileSystem::copyFile(copySrc, copyDst); });
+    measure("copyFile", "legacy", n, removeCopy, [&] { legacy::copyFile(copySrc, copyDst, false); });
+    removeCopy();
+
+    // each op moves the file one way; setup puts it back untimed
+    const std::string moveA = flat + "/entry_0000000", moveB = opt.dir + "/moved";
+    auto restore = [&] { ::rename(moveB.c_str(), moveA.c_str()); };
+    measure("move (rename)", "current", n, restore, [&] { FileSystem::move(moveA, moveB); });
+    measure("move (rename)", "legacy", n, restore, [&] { legacy::move(moveA, moveB, false); });
+    restore();
+
+    std::cout << "\n";
+    printResults();
+
+    if (!opt.keep) {
+        std::error_code ec;
+        std::filesystem::remove_all(opt.dir, ec);
+    } else {
+        std::cout << "kept " << opt.dir << "\n";
+    }
+    return 0;
+}
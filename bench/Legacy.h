@@ -0,0 +1,23 @@
+#ifndef LEGACY_H
+#define LEGACY_H
+
+#include "FileSystem.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// The original FileSystem implementations (opendir/readdir + stat(path),
+// std::filesystem iterators and copies), kept verbatim as the baseline the
+// benchmarks compare the current engines against.
+namespace legacy {
+
+std::vector<FileInfo> listDir(const std::string &path);
+unsigned long long calcDirSize(const std::string &path);
+void search(const std::string &path, const std::string &keyword, std::vector<std::pair<std::string, bool>> &results);
+bool copyFile(const std::string &src, const std::string &dst, bool overwrite);
+bool move(const std::string &src, const std::string &dst, bool overwrite);
+
+} // namespace legacy
+
+#endif
@@ -0,0 +1,172 @@
+#include "TreeGen.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+const char *const TreeGen::MATCH_WORD = "report";
+
+namespace {
+
+// splitmix64: tiny, and unlike <random> distributions its output is the
+// same on every standard library, which keeps trees reproducible.
+class Rng
+{
+public:
+    explicit Rng(std::uint64_t seed) : state_(seed) {}
+
+    std::uint64_t next() {
+        std::uint64_t z = (state_ += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    double uniform() { return static_cast<double>(next() >> 11) * (1.0 / 9007199254740992.0); }
+
+    double normal() {
+        // Box-Muller; u1 is kept away from 0 for the log
+        double u1 = std::max(uniform(), 1e-300), u2 = uniform();
+        return std::sqrt(-2.0 * std::log(u1)) * std::cos(6.283185307179586 * u2);
+    }
+
+private:
+    std::uint64_t state_;
+};
+
+std::uint64_t drawSize(Rng &rng, const TreeSpec &spec) {
+    double size = 0;
+    switch (spec.sizeDist) {
+    case SizeDist::Fixed: size = static_cast<double>(spec.meanSize); break;
+    case SizeDist::Uniform: size = rng.uniform() * 2.0 * static_cast<double>(spec.meanSize); break;
+    case SizeDist::LogNormal: {
+        // mean of a lognormal is exp(mu + sigma^2 / 2)
+        const double sigma = 1.5;
+        double mu = std::log(std::max<double>(1.0, static_cast<double>(spec.meanSize))) - sigma * sigma / 2;
+        size = std::exp(mu + sigma * rng.normal());
+        break;
+    }
+    }
+    return std::min<std::uint64_t>(spec.maxSize, static_cast<std::uint64_t>(size));
+}
+
+bool writeData(int fd, std::uint64_t size, Rng &rng) {
+    static const std::size_t BLOCK = 1 << 16;
+    std::vector<std::uint64_t> buf(BLOCK / sizeof(std::uint64_t));
+    std::uint64_t left = size;
+    while (left > 0) {
+        for (auto &w : buf) w = rng.next();
+        std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(left, BLOCK));
+        const char *p = reinterpret_cast<const char *>(buf.data());
+        std::size_t done = 0;
+        while (done < n) {
+            ssize_t w = ::write(fd, p + done, n - done);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return false;
+            done += static_cast<std::size_t>(w);
+        }
+        left -= n;
+    }
+    return true;
+}
+
+bool makeFile(const std::string &path, std::uint64_t size, Rng &rng) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    bool ok = writeData(fd, size, rng);
+    return (::close(fd) == 0) && ok;
+}
+
+class Generator
+{
+public:
+    Generator(const TreeSpec &spec, TreeStats &stats) : spec_(spec), stats_(stats), rng_(spec.seed) {}
+
+    bool dir(const std::string &path, unsigned level) {
+        if (::mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) return false;
+        ++stats_.dirs;
+
+        char name[64];
+        for (unsigned i = 0; i < spec_.filesPerDir; ++i) {
+            bool match = rng_.uniform() < spec_.matchRatio;
+            if (match) std::snprintf(name, sizeof(name), "%s_%05u.dat", TreeGen::MATCH_WORD, i);
+            else std::snprintf(name, sizeof(name), "file_%05u.dat", i);
+            std::string file = path + "/" + name;
+            stats_.matches += match;
+
+            if (!files_.empty() && rng_.uniform() < spec_.hardLinkRatio) {
+                const std::string &target = files_[rng_.next() % files_.size()];
+                if (::link(target.c_str(), file.c_str()) != 0) return false;
+                ++stats_.hardLinks;
+            } else {
+                std::uint64_t size = drawSize(rng_, spec_);
+                if (!makeFile(file, size, rng_)) return false;
+                stats_.bytes += size;
+                files_.push_back(file);
+            }
+            ++stats_.files;
+        }
+
+        if (level >= spec_.depth) return true;
+        for (unsigned i = 0; i < spec_.fanout; ++i) {
+            bool match = rng_.uniform() < spec_.matchRatio;
+            if (match) std::snprintf(name, sizeof(name), "%s_dir_%03u", TreeGen::MATCH_WORD, i);
+            else std::snprintf(name, sizeof(name), "dir_%03u", i);
+            stats_.matches += match;
+            if (!dir(path + "/" + name, level + 1)) return false;
+        }
+        return true;
+    }
+
+private:
+    const TreeSpec &spec_;
+    TreeStats &stats_;
+    Rng rng_;
+    std::vector<std::string> files_; // link targets
+};
+
+} // namespace
+
+bool parseSizeDist(const std::string &name, SizeDist &out) {
+    if (name == "fixed") out = SizeDist::Fixed;
+    else if (name == "uniform") out = SizeDist::Uniform;
+    else if (name == "lognormal") out = SizeDist::LogNormal;
+    else return false;
+    return true;
+}
+
+const char *sizeDistName(SizeDist dist) {
+    switch (dist) {
+    case SizeDist::Fixed: return "fixed";
+    case SizeDist::Uniform: return "uniform";
+    default: return "lognormal";
+    }
+}
+
+bool TreeGen::generate(const std::string &root, const TreeSpec &spec, TreeStats &stats) {
+    stats = TreeStats();
+    Generator gen(spec, stats);
+    return gen.dir(root, 0);
+}
+
+bool TreeGen::generateFlat(const std::string &dir, unsigned count, std::uint64_t seed) {
+    if (::mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) return false;
+    Rng rng(seed);
+    char name[64];
+    for (unsigned i = 0; i < count; ++i) {
+        std::snprintf(name, sizeof(name), "entry_%07u", i);
+        if (!makeFile(dir + "/" + name, rng.next() % 128, rng)) return false;
+    }
+    return true;
+}
+
+bool TreeGen::generateFile(const std::string &path, std::uint64_t size, std::uint64_t seed) {
+    Rng rng(seed);
+    return makeFile(path, size, rng);
+}
@@ -0,0 +1,56 @@
+#ifndef TREE_GEN_H
+#define TREE_GEN_H
+
+#include <cstdint>
+#include <string>
+
+enum class SizeDist
+{
+    Fixed,    // every file is meanSize bytes
+    Uniform,  // uniform in [0, 2 * meanSize]
+    LogNormal // heavy-tailed: many small files, a few large ones (sigma 1.5)
+};
+
+bool parseSizeDist(const std::string &name, SizeDist &out);
+const char *sizeDistName(SizeDist dist);
+
+// Shape of a synthetic tree. The same spec and seed always produce the same
+// names, sizes and link structure.
+struct TreeSpec
+{
+    unsigned fanout = 4;           // subdirectories per directory
+    unsigned depth = 3;            // directory levels below the root
+    unsigned filesPerDir = 32;
+    SizeDist sizeDist = SizeDist::LogNormal;
+    std::uint64_t meanSize = 4096;
+    std::uint64_t maxSize = 64ULL * 1024 * 1024;
+    double hardLinkRatio = 0.05;   // share of files created as a hard link to an earlier file
+    double matchRatio = 0.02;      // share of names containing TreeGen::MATCH_WORD
+    std::uint64_t seed = 42;
+};
+
+struct TreeStats
+{
+    std::uint64_t dirs = 0;
+    std::uint64_t files = 0;
+    std::uint64_t hardLinks = 0;
+    std::uint64_t matches = 0;     // names containing MATCH_WORD (dirs included)
+    std::uint64_t bytes = 0;       // apparent size, each hard-linked inode counted once
+};
+
+class TreeGen
+{
+public:
+    static const char *const MATCH_WORD;
+
+    // Creates the tree described by `spec` under `root` (created if missing).
+    static bool generate(const std::string &root, const TreeSpec &spec, TreeStats &stats);
+
+    // A flat directory of `count` empty-ish files, for listing benchmarks.
+    static bool generateFlat(const std::string &dir, unsigned count, std::uint64_t seed);
+
+    // One file of exactly `size` bytes of pseudo-random data.
+    static bool generateFile(const std::string &path, std::uint64_t size, std::uint64_t seed);
+};
+
+#endif
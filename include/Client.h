@@ -0,0 +1,47 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include "Protocol.h"
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// `--connect <socket>`: thin client of Server. It runs one command given on
+// the command line, or one per line of a script, over a single connection:
+//   ls [dir]   search <keyword> [dir]   du [dir]   stat <path>
+//   cp [-f] <src> <dst>   mv [-f] <src> <dst>
+// Relative paths are resolved against the client's working directory.
+class Client
+{
+public:
+    Client() = default;
+    ~Client();
+
+    Client(const Client &) = delete;
+    Client &operator=(const Client &) = delete;
+
+    bool connect(const std::string &socketPath);
+
+    // Sends `request` and waits for its response; false if the connection
+    // broke. `body` is the response after its header.
+    bool call(Protocol::Writer &request, Protocol::Status &status, std::string &body);
+    std::uint32_t nextId() { return ++id_; }
+
+    // Runs one command and prints its result; false if it failed.
+    bool command(const std::vector<std::string> &args, std::ostream &out);
+
+    // Process entry: `args` as one command, or commands from `script` (one
+    // per line, ';' separated) when `args` is empty. Returns the exit status.
+    static int run(const std::string &socketPath, const std::vector<std::string> &args, std::istream &script);
+
+private:
+    bool readFull(char *p, std::size_t n);
+
+    int fd_ = -1;
+    std::uint32_t id_ = 0;
+};
+
+#endif
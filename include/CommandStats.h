@@ -0,0 +1,79 @@
+#ifndef COMMAND_STATS_H
+#define COMMAND_STATS_H
+
+#include "IoStats.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class JobContext;
+
+// What one command cost. Counts and CPU time come from the command's
+// JobContext, so work done on the pool is charged to the command that queued
+// it, and a background job running meanwhile is not.
+struct CommandSample
+{
+    double wallSeconds = 0;
+    double cpuSeconds = 0;
+    std::uint64_t entries = 0;  // directory entries read
+    std::uint64_t bytesRead = 0;
+    std::uint64_t bytesWritten = 0;
+    std::uint64_t syscalls = 0; // as counted by IoStats: open/close/getdents/stat/data calls
+};
+
+// Measures from construction to finish(), through the JobContext current at
+// construction (process-wide counters and getrusage outside any command).
+class CommandProbe
+{
+public:
+    CommandProbe();
+    CommandSample finish() const;
+
+private:
+    IoSnapshot ioNow() const;
+    double cpuNow() const;
+
+    JobContext *job_;
+    std::chrono::steady_clock::time_point start_;
+    double cpuStart_;
+    IoSnapshot io_;
+};
+
+// Per-command samples for the session, behind the `stats` command. Background
+// jobs record from their own threads.
+class CommandStats
+{
+public:
+    static CommandStats &instance();
+
+    void record(const std::string &command, const CommandSample &sample);
+    void clear();
+
+    // Totals and a latency histogram for `command`, or for every command
+    // when empty.
+    void print(std::ostream &out, const std::string &command = std::string()) const;
+
+    // One line for a single sample, printed after each command with `stats on`.
+    static void printSample(std::ostream &out, const std::string &command, const CommandSample &sample);
+
+    // set by `stats on|off`, read by every job thread after its command
+    std::atomic<bool> verbose{false};
+
+private:
+    struct Series
+    {
+        std::vector<double> wall; // seconds, one per run
+        CommandSample total;
+    };
+
+    mutable std::mutex m_;
+    std::map<std::string, Series> commands_;
+};
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef COPY_ENGINE_H
+#define COPY_ENGINE_H
+
+#include <cstdint>
+#include <string>
+
+enum class CopyMethod
+{
+    None,
+    Reflink,       // FICLONE: shares extents, no data moved (btrfs, XFS)
+    CopyFileRange, // in-kernel copy, may be offloaded by the filesystem/NFS server
+    Sendfile,      // in-kernel page-cache copy
+    ReadWrite      // user-space loop with a large buffer
+};
+
+const char *copyMethodName(CopyMethod method);
+
+struct CopyReport
+{
+    CopyMethod method = CopyMethod::None; // last (fastest successful) path used
+    std::uint64_t bytes = 0;
+    double seconds = 0;
+
+    double bytesPerSec() const { return seconds > 0 ? static_cast<double>(bytes) / seconds : 0; }
+};
+
+// Moves file data with the cheapest mechanism the filesystems allow:
+// reflink, then copy_file_range, then sendfile, then read/write. The
+// destination is preallocated with fallocate before any bytes are copied,
+// and truncated to what was copied if the source turned out shorter.
+class CopyEngine
+{
+public:
+    // Copies everything from srcFd (offset 0) into the empty dstFd.
+    static bool copyData(int srcFd, int dstFd, std::uint64_t sizeHint, CopyReport &report);
+
+    // Creates dst with src's permission bits (failing if it exists unless
+    // `overwrite`) and copies the data; a partial dst is removed on failure.
+    static bool copyFile(const std::string &src, const std::string &dst, bool overwrite, CopyReport &report);
+};
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef DIR_READER_H
+#define DIR_READER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// One directory entry as returned by getdents64. `name` points into the
+// reader's batch buffer and stays valid only until the next call to next().
+struct DirEntry
+{
+    const char *name;
+    std::size_t nameLen;
+    unsigned char type; // DT_* value, DT_UNKNOWN if the filesystem does not report it
+    std::uint64_t ino;
+};
+
+// Fields that statAt() should fetch; anything not requested is left zeroed.
+enum StatField : unsigned
+{
+    STAT_TYPE = 1u << 0,   // type + mode
+    STAT_SIZE = 1u << 1,
+    STAT_BLOCKS = 1u << 2, // allocated 512-byte blocks
+    STAT_MTIME = 1u << 3,
+    STAT_CTIME = 1u << 4,
+    STAT_ATIME = 1u << 5,
+    STAT_INO = 1u << 6,    // dev + ino + nlink
+};
+
+struct StatInfo
+{
+    unsigned char type = 0; // DT_* value
+    std::uint32_t mode = 0;
+    std::uint64_t dev = 0;
+    std::uint64_t ino = 0;
+    std::uint64_t nlink = 0;
+    std::int64_t size = 0;
+    std::uint64_t blocks = 0;
+    std::int64_t mtimeNs = 0;
+    std::int64_t ctimeNs = 0;
+    std::int64_t atimeNs = 0;
+};
+
+// Streams the entries of one directory with large getdents64 batches,
+// skipping "." and "..". The directory fd stays open for the reader's
+// lifetime so callers can fstatat/openat relative to it.
+class DirReader
+{
+public:
+    explicit DirReader(const std::string &path);
+    DirReader(int parentFd, const char *name);
+    // Reads an already-open directory fd without taking ownership of it.
+    explicit DirReader(int dirfd);
+    ~DirReader();
+
+    DirReader(const DirReader &) = delete;
+    DirReader &operator=(const DirReader &) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+    int fd() const { return fd_; }
+    bool next(DirEntry &entry);
+    // True when next() stopped on a getdents error rather than at the end:
+    // the entries seen so far are not the whole directory.
+    bool failed() const { return failed_; }
+
+private:
+    bool fill();
+    void acquireBuffer();
+
+    int fd_;
+    bool ownFd_;
+    char *buf_;
+    bool ownBuf_;
+    std::size_t len_;
+    std::size_t pos_;
+    bool eof_;
+    bool failed_ = false;
+    std::uint64_t unreported_ = 0; // entries not yet added to the job's progress
+};
+
+// Stats `name` relative to `dirfd` (statx when available, fstatat otherwise)
+// requesting only `fields`; an empty name stats `dirfd` itself. Returns
+// false if the entry cannot be stat'ed.
+bool statAt(int dirfd, const char *name, unsigned fields, StatInfo &out, bool follow = true);
+
+// statx() field mask for a set of StatField bits, and the conversion of its
+// result; shared with the batched backend in StatBatch.
+struct statx;
+unsigned statxMask(unsigned fields);
+void fromStatx(const struct statx &stx, StatInfo &out);
+
+// Resolves the DT_* type of an entry, stat'ing only when d_type is unknown
+// or a symlink has to be followed.
+unsigned char resolveType(int dirfd, const DirEntry &entry, bool follow = true);
+
+#endif
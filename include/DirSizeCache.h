@@ -0,0 +1,118 @@
+#ifndef DIR_SIZE_CACHE_H
+#define DIR_SIZE_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A multiply-linked file; kept apart so a cache hit can still count it only
+// once per (dev, ino) across the whole scan.
+struct LinkedFile
+{
+    std::uint64_t ino = 0;
+    std::uint64_t apparent = 0;
+    std::uint64_t allocated = 0;
+};
+
+// What a directory contributes by itself: its regular files and the names of
+// its subdirectories. Valid while the directory's mtime and ctime are
+// unchanged, since any create/delete/rename inside it bumps both.
+struct DirSizeEntry
+{
+    std::int64_t mtimeNs = 0;
+    std::int64_t ctimeNs = 0;
+    std::uint64_t apparent = 0;
+    std::uint64_t allocated = 0;
+    std::uint64_t files = 0; // singly-linked files, included in apparent/allocated
+    std::vector<LinkedFile> links;
+    std::vector<std::string> subdirs;
+};
+
+// Persistent cache of per-directory sizes keyed by (dev, inode), stored in
+// cacheDir()/dirsize.cache. DiskUsage consults it so unchanged directories
+// cost one statx instead of getdents + a statx per file. Only the
+// directory's own mtime/ctime are checked, and in-place writes to a file
+// change neither, so a hit can report stale sizes: the cache is off unless
+// enabled (`cache on`, or MFE_DIR_CACHE=1 in the environment). Entries are
+// spread over sharded maps and handed out shared, never copied, and the
+// least recently used are evicted beyond MAX_BYTES.
+class DirSizeCache
+{
+public:
+    static const std::size_t MAX_BYTES = 64 << 20; // approximate memory of all entries
+
+    struct Stats
+    {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t stores = 0;
+        std::uint64_t evictions = 0;
+        std::size_t entries = 0;
+        std::size_t bytes = 0;
+        std::string path;
+    };
+
+    static DirSizeCache &instance();
+
+    static void setEnabled(bool enabled);
+    static bool enabled();
+
+    // The entry for (dev, ino) if it matches mtime/ctime; counts a hit or miss.
+    std::shared_ptr<const DirSizeEntry> lookup(std::uint64_t dev, std::uint64_t ino, std::int64_t mtimeNs,
+                                               std::int64_t ctimeNs);
+    void store(std::uint64_t dev, std::uint64_t ino, DirSizeEntry entry);
+
+    bool save();
+    void clear();
+    Stats stats();
+
+private:
+    static const std::size_t SHARDS = 64;
+
+    struct Key
+    {
+        std::uint64_t dev;
+        std::uint64_t ino;
+        bool operator==(const Key &o) const { return dev == o.dev && ino == o.ino; }
+    };
+    struct KeyHash
+    {
+        std::size_t operator()(const Key &k) const;
+    };
+    struct Slot
+    {
+        std::shared_ptr<const DirSizeEntry> entry;
+        std::size_t bytes = 0;
+        std::uint64_t lastUse = 0;
+    };
+    struct Shard
+    {
+        std::mutex m;
+        std::unordered_map<Key, Slot, KeyHash> map;
+        std::size_t bytes = 0;
+    };
+
+    DirSizeCache();
+    void load();
+    void ensureLoaded() { std::call_once(loaded_, [this] { load(); }); }
+    Shard &shard(const Key &key) { return shards_[KeyHash()(key) % SHARDS]; }
+    void insert(Shard &s, const Key &key, DirSizeEntry entry); // with s.m held
+    void evict(Shard &s);
+
+    Shard shards_[SHARDS];
+    std::once_flag loaded_;
+    std::mutex fileM_; // one save at a time
+    std::string path_;
+    std::atomic<bool> dirty_{false};
+    std::atomic<std::uint64_t> clock_{0};
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> misses_{0};
+    std::atomic<std::uint64_t> stores_{0};
+    std::atomic<std::uint64_t> evictions_{0};
+};
+
+#endif
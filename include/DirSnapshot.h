@@ -0,0 +1,52 @@
+#ifndef DIR_SNAPSHOT_H
+#define DIR_SNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct FileInfo;
+
+// Listing of one directory stored column-wise: all names packed into one
+// NUL-separated arena, and type/size/mtime as plain integer columns. A
+// million entries cost one allocation per column instead of two strings
+// each, and sorting or filtering on a key touches only that column.
+class DirSnapshot
+{
+public:
+    void reserve(std::size_t entries, std::size_t nameBytes = 0);
+    void clear();
+
+    std::size_t size() const { return isDir_.size(); }
+    bool empty() const { return isDir_.empty(); }
+
+    // `isDir` follows symlinks; `type` is the DT_* value of the entry itself.
+    void add(const char *name, std::size_t len, bool isDir, unsigned char type, std::int64_t size,
+             std::int64_t mtimeNs);
+
+    std::string_view name(std::size_t i) const {
+        return std::string_view(names_.data() + nameOff_[i], nameOff_[i + 1] - nameOff_[i] - 1);
+    }
+    const char *nameCStr(std::size_t i) const { return names_.data() + nameOff_[i]; }
+    bool isDir(std::size_t i) const { return isDir_[i] != 0; }
+    unsigned char type(std::size_t i) const { return type_[i]; } // DT_LNK for any symlink
+    std::int64_t fileSize(std::size_t i) const { return size_[i]; } // -1 for directories
+    std::int64_t mtimeNs(std::size_t i) const { return mtime_[i]; }
+
+    // "YYYY-MM-DD HH:MM:SS" in local time, formatted on demand.
+    std::string mtimeString(std::size_t i) const;
+    // Materialises one row, for callers that still want a FileInfo.
+    FileInfo info(std::size_t i) const;
+
+private:
+    std::vector<char> names_;
+    std::vector<std::uint32_t> nameOff_{0}; // entry i spans [nameOff_[i], nameOff_[i + 1])
+    std::vector<unsigned char> isDir_;
+    std::vector<unsigned char> type_;
+    std::vector<std::int64_t> size_;
+    std::vector<std::int64_t> mtime_;
+};
+
+#endif
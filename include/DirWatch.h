@@ -0,0 +1,91 @@
+#ifndef DIR_WATCH_H
+#define DIR_WATCH_H
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct WatchEvent
+{
+    enum Kind { Created, Deleted, Modified, Moved, Overflow };
+
+    Kind kind;
+    bool isDir = false;
+    std::string dir;  // watched directory the entry is in, as passed to add()
+    std::string name; // entry inside `dir`; "" when `dir` itself went away
+    std::string fromDir, fromName; // Moved: where the entry was before
+};
+
+// inotify on a set of directories. Events are read in bursts: after the
+// first one arrives, reading continues until the queue stays quiet for
+// COALESCE_MS (or MAX_BATCH_MS passes), and the burst is folded into one
+// event per entry: repeated modifications collapse, a create followed by
+// a delete cancels out, and a MOVED_FROM/MOVED_TO pair becomes one move.
+// A writer producing thousands of IN_MODIFY per second costs one event per
+// batch. Not thread-safe except where noted.
+class DirWatch
+{
+public:
+    static const int COALESCE_MS = 50;
+    static const int MAX_BATCH_MS = 250;
+
+    DirWatch();
+    ~DirWatch();
+
+    DirWatch(const DirWatch &) = delete;
+    DirWatch &operator=(const DirWatch &) = delete;
+
+    bool ok() const { return fd_ >= 0; }
+    int fd() const { return fd_; }
+
+    // Watches `path`, and with `recursive` every directory below it (walked
+    // in parallel); directories created later under a recursive watch are
+    // added as they appear. False if `path` itself cannot be watched.
+    bool add(const std::string &path, bool recursive = false);
+    void remove(const std::string &path);
+
+    // Waits up to `timeoutMs` (-1 blocks) for events and returns the
+    // coalesced burst; false when nothing arrived. With 0 only what is
+    // already queued is read, without waiting for the burst to end.
+    bool read(std::vector<WatchEvent> &batch, int timeoutMs);
+
+    std::size_t watches() const;
+    // Directories that could not be watched (typically fs.inotify.max_user_watches).
+    std::uint64_t failed() const { return failed_; }
+    // inotify events read so far, before coalescing.
+    std::uint64_t rawEvents() const { return raw_; }
+
+private:
+    struct Raw
+    {
+        std::uint32_t mask;
+        std::uint32_t cookie;
+        std::string dir;
+        std::string name;
+    };
+
+    struct Watched
+    {
+        std::string path;
+        bool recursive;
+        bool root; // passed to add(), not found below another watch
+    };
+
+    bool addOne(const std::string &path, bool recursive, bool root); // thread-safe
+    // Watches the directories under `path`; with `found`, every entry met
+    // is reported as created (it may predate the watch).
+    void addTree(const std::string &path, bool root, std::vector<Raw> *found);
+    void drain(std::vector<Raw> &raw);
+    static void coalesce(const std::vector<Raw> &raw, std::vector<WatchEvent> &batch);
+
+    int fd_ = -1;
+    mutable std::mutex m_; // guards the maps while a recursive add runs on the pool
+    std::unordered_map<int, Watched> dirs_; // by watch descriptor
+    std::unordered_map<std::string, int> wds_;
+    std::uint64_t failed_ = 0;
+    std::uint64_t raw_ = 0;
+};
+
+#endif
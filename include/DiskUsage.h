@@ -0,0 +1,47 @@
+#ifndef DISK_USAGE_H
+#define DISK_USAGE_H
+
+#include "DirReader.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+struct WalkDir;
+
+struct DuResult
+{
+    std::uint64_t apparent = 0;  // sum of st_size of regular files
+    std::uint64_t allocated = 0; // sum of st_blocks * 512 of regular files
+    std::uint64_t files = 0;
+    std::uint64_t dirs = 0;
+    std::uint64_t errors = 0;
+    bool ok = false;             // false if the root could not be opened
+};
+
+// Shared disk-usage engine behind FileSystem::calcDirSize, `du` and `ls -s`.
+// Subdirectories are spread over the work-stealing pool; each non-directory
+// entry costs exactly one statx relative to its parent dirfd. Inodes with
+// more than one link are counted once per (dev, ino). With `useCache` and
+// the cache enabled (DirSizeCache::enabled()), directories unchanged since
+// the last scan are answered from DirSizeCache.
+class DiskUsage
+{
+public:
+    // Every regular file the walk stats, hard links included (before they
+    // are de-duplicated); `name` is relative to `dir`. Called concurrently
+    // from pool workers.
+    using FileCallback = std::function<void(const WalkDir &dir, const char *name, const StatInfo &st)>;
+    // Every directory, bottom-up once it and all of its descendants are
+    // done: dir.sum[0] and dir.sum[1] then hold the subtree's apparent and
+    // allocated bytes. Called concurrently from pool workers.
+    using DirCallback = std::function<void(const WalkDir &dir)>;
+
+    static DuResult scan(const std::string &path, bool useCache = true);
+    // The same walk with a hook on each file; the cache is bypassed, since a
+    // cached directory is never read.
+    static DuResult scan(const std::string &path, const FileCallback &onFile);
+    static DuResult scan(const std::string &path, const FileCallback &onFile, const DirCallback &onDir);
+};
+
+#endif
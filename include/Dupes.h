@@ -0,0 +1,49 @@
+#ifndef DUPES_H
+#define DUPES_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Files with identical contents; paths are sorted, and hard links to one
+// inode appear once.
+struct DupeSet
+{
+    std::uint64_t size = 0;
+    std::vector<std::string> paths;
+
+    std::uint64_t reclaimable() const { return size * (paths.size() - 1); }
+};
+
+struct DupesStats
+{
+    bool ok = false; // false if the root could not be opened
+    std::uint64_t files = 0;        // non-empty regular files, one per inode
+    std::uint64_t sizeMatches = 0;  // files sharing their size with another
+    std::uint64_t prefixMatches = 0; // of those, files sharing size and prefix hash
+    std::uint64_t bytesHashed = 0;
+    std::uint64_t duplicates = 0;   // files beyond the first of each set
+    std::uint64_t reclaimable = 0;  // bytes freed by keeping one file per set
+    std::uint64_t errors = 0;
+    bool cancelled = false;
+    double seconds = 0;
+};
+
+// Duplicate finder in stages, each reading only what the previous one could
+// not rule out:
+//  1. one parallel DiskUsage walk collects (size, dev, ino, path) of every
+//     regular file; hard links collapse to one entry and sizes held by a
+//     single inode are dropped;
+//  2. the first PREFIX_BYTES of each remaining file are hashed;
+//  3. files still sharing size and prefix hash are hashed in full (pread in blocks).
+// Hashes are XXH64 (Hash64), computed on the work pool.
+class Dupes
+{
+public:
+    static const std::size_t PREFIX_BYTES = 4096;
+
+    // Sets are ordered by reclaimable bytes, largest first.
+    static DupesStats find(const std::string &root, std::vector<DupeSet> &sets);
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef FILE_INDEX_H
+#define FILE_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+struct IndexBuildStats
+{
+    bool ok = false;
+    std::uint64_t dirs = 0;
+    std::uint64_t entries = 0;
+    std::uint64_t trigrams = 0;
+    std::uint64_t rescanned = 0; // directories read with getdents
+    std::uint64_t reused = 0;    // directories taken from the previous index (mtime unchanged)
+    std::uint64_t bytes = 0;     // size of the index file
+    double seconds = 0;
+};
+
+// Persistent filename index of every path under a root, stored as one
+// mmap-able file in cacheDir(): directory and entry tables, a packed name
+// blob and a trigram -> sorted entry-id posting list. Queries intersect the
+// posting lists of the keyword's trigrams and verify the survivors, so a
+// search never touches the filesystem.
+class FileIndex
+{
+public:
+    ~FileIndex();
+
+    FileIndex(const FileIndex &) = delete;
+    FileIndex &operator=(const FileIndex &) = delete;
+
+    static std::string indexPath(const std::string &root);
+
+    // Indexes `root`. With `incremental`, directories whose mtime matches the
+    // existing index are not re-read; only changed ones are rescanned.
+    static IndexBuildStats build(const std::string &root, bool incremental);
+    static bool drop(const std::string &root);
+
+    static std::unique_ptr<FileIndex> open(const std::string &root);
+    // Opens the index of `path` or of its nearest indexed ancestor.
+    static std::unique_ptr<FileIndex> openCovering(const std::string &path);
+
+    const std::string &root() const { return root_; }
+    std::uint64_t dirCount() const;
+    std::uint64_t entryCount() const;
+    std::uint64_t trigramCount() const;
+    std::int64_t builtAtNs() const;
+    std::size_t fileSize() const { return size_; }
+
+    // Calls onMatch(absolutePath, isDir) for every entry strictly below
+    // `under` whose name contains `keyword` (ASCII case-insensitive).
+    void search(const std::string &under, const std::string &keyword,
+                const std::function<void(const std::string &, bool)> &onMatch) const;
+
+private:
+    FileIndex() = default;
+
+    std::string relPath(std::uint32_t entry) const;
+
+    std::string root_;
+    const char *base_ = nullptr;
+    std::size_t size_ = 0;
+};
+
+#endif
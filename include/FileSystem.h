@@ -3,8 +3,15 @@
 
 #include <string>
 #include <vector>
+#include <cstddef>
 #include <cstdint>
 #include <utility>
+#include <functional>
+
+struct CopyReport;
+struct TreeCopyStats;
+struct TreeRemoveStats;
+class DirSnapshot;
 
 struct FileInfo
 {
@@ -12,23 +19,55 @@ struct FileInfo
     bool isDir;        // true if directory
     std::int64_t size; // -1 for directory, otherwise bytes
     std::string mtime; // "YYYY-MM-DD HH:MM:SS"
+    std::int64_t mtimeNs = 0; // same time, nanoseconds since the epoch
 };
 
 class FileSystem
 {
 public:
+    // (display path, isDir); called from worker threads but never concurrently
+    using SearchCallback = std::function<void(const std::string &, bool)>;
+    // one batch of a streamed listing, in directory order; reused for the next batch
+    using ListCallback = std::function<void(const DirSnapshot &)>;
+
     static bool exists(const std::string &path);
     static bool isDir(const std::string &path);
-    static std::vector<FileInfo> listDir(const std::string &path);
+    // withStat=false lists names and types from d_type only (size 0, mtime empty)
+    static std::vector<FileInfo> listDir(const std::string &path, bool withStat = true);
+    // Columnar listing of the whole directory (see DirSnapshot); false if `path` cannot be opened.
+    // Served from ListingCache while the directory is unchanged.
+    static bool listDir(const std::string &path, DirSnapshot &out);
+    // Same, but hands entries over in batches of up to `batchSize` as they are
+    // read and stat'ed instead of keeping the whole directory; a cached
+    // listing arrives as one batch.
+    static bool listDir(const std::string &path, const ListCallback &onBatch, std::size_t batchSize = 4096);
     static bool createFile(const std::string &path);
     static bool createDir(const std::string &path);
     static bool removeFile(const std::string &path);
     static bool removeDir(const std::string &path);
     static bool isEmptyDir(const std::string &path);
-    static bool copyFile(const std::string &src, const std::string &dst, bool overwrite = false);
+    // data is moved by CopyEngine; `report` (optional) receives the method and throughput
+    static bool copyFile(const std::string &src, const std::string &dst, bool overwrite = false, CopyReport *report = nullptr);
+    // recursive copy through TreeCopy; `stats` (optional) receives counts and throughput
+    static bool copyDir(const std::string &src, const std::string &dst, bool overwrite = false, TreeCopyStats *stats = nullptr);
+    // recursive delete through TreeRemove; `stats` (optional) receives counts
+    static bool removeTree(const std::string &path, TreeRemoveStats *stats = nullptr);
+    // `dst`, or `dst/<name of src>` when `dst` is an existing directory
+    static std::string moveTarget(const std::string &src, const std::string &dst);
+    // whether `dst` may be replaced by `src`: not the source or one of its
+    // ancestors, and a directory only by a directory, a file only by a file
+    static bool canReplace(const std::string &src, const std::string &dst);
+    // renames `src` to exactly `dst`; with `overwrite` an existing `dst` that
+    // canReplace() allows is replaced, a non-empty directory through TreeRemove
     static bool move(const std::string &src, const std::string &dst, bool overwrite = false);
+    // absolute path of the entry itself: the parent is resolved, the last
+    // component is kept, so a symlink names the link and not its target
+    static std::string entryPath(const std::string &path);
     static unsigned long long calcDirSize(const std::string &path);
-    static void search(const std::string &path, const std::string &keyword, std::vector<std::pair<std::string,bool>> &results);
+    // answered from a FileIndex covering `path` when one exists and useIndex is set,
+    // otherwise by a parallel walk that reports hits as they are found
+    static void search(const std::string &path, const std::string &keyword, const SearchCallback &onMatch, bool useIndex = true);
+    static void search(const std::string &path, const std::string &keyword, std::vector<std::pair<std::string,bool>> &results, bool useIndex = true);
     // static FileInfo getInfo(const std::string &path);
 };
 
@@ -0,0 +1,64 @@
+#ifndef FIND_H
+#define FIND_H
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+
+// A find expression: every predicate that is set must hold (there is no -o).
+struct FindQuery
+{
+    static constexpr std::int64_t NONE = std::numeric_limits<std::int64_t>::max();
+
+    std::vector<std::string> names; // shell globs on the entry name (-name / -iname)
+    std::string regex;              // ECMAScript, searched in the entry name (-regex / -iregex)
+    bool ignoreCase = false;        // applies to names and regex
+    char type = 0;                  // 'f', 'd', 'l' or 0 for any
+    std::int64_t minSize = 0;       // bytes, inclusive
+    std::int64_t maxSize = NONE;
+    std::int64_t minAge = -NONE;    // seconds since mtime, inclusive; negative for future mtimes
+    std::int64_t maxAge = NONE;
+    int minDepth = 1;               // the root is depth 0 and is never reported
+    int maxDepth = -1;              // -1 for unlimited
+    std::vector<std::string> excludes; // directories whose name matches one of these globs are not entered
+
+    // Parses find-style arguments ("-name '*.log' -mtime +7 -type f") into
+    // the query; returns false with `error` set on the first bad one.
+    bool parse(const std::vector<std::string> &args, std::string &error);
+
+    // True when a predicate needs the entry's size or mtime.
+    bool needsStat() const { return minSize > 0 || maxSize != NONE || minAge != -NONE || maxAge != NONE; }
+};
+
+struct FindStats
+{
+    bool ok = false; // false if the root could not be opened (or the regex is invalid)
+    std::uint64_t entries = 0; // entries looked at
+    std::uint64_t stats = 0;   // of those, stat'ed for size or mtime
+    std::uint64_t matches = 0;
+    std::uint64_t pruned = 0;  // directories not entered because of depth or excludes
+    std::uint64_t errors = 0;
+    bool cancelled = false;
+    double seconds = 0;
+};
+
+// Predicate search over a tree on TreeWalk. The query is compiled once:
+// globs of the common shapes ("*.log", "core*", "*tmp*", literal names) become
+// suffix/prefix/substring tests on the name straight from the getdents
+// buffer, other globs go to fnmatch, and the regex is built once. Per entry
+// the predicates run cheapest first: d_type, name, regex, and only then one
+// statx for size and mtime, so entries rejected by name are never stat'ed.
+// Directories beyond maxDepth or matching an exclude glob are not opened.
+class Find
+{
+public:
+    // `path` is relative to the root; called from pool workers in no
+    // particular order, never concurrently. `type` is 'f', 'd', 'l' or '?' for others.
+    using MatchCallback = std::function<void(const std::string &path, char type)>;
+
+    static FindStats run(const std::string &root, const FindQuery &query, const MatchCallback &onMatch);
+};
+
+#endif
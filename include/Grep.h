@@ -0,0 +1,47 @@
+#ifndef GREP_H
+#define GREP_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+struct GrepOptions
+{
+    bool ignoreCase = false; // ASCII case only
+    bool filesOnly = false;  // report matching files, not lines (grep -l)
+};
+
+struct GrepStats
+{
+    bool ok = false; // false if the path could not be opened
+    std::uint64_t files = 0;        // regular files scanned
+    std::uint64_t binary = 0;       // skipped: a NUL byte in the first block
+    std::uint64_t matchedFiles = 0;
+    std::uint64_t lines = 0;        // matching lines
+    std::uint64_t bytes = 0;        // bytes of text files scanned
+    std::uint64_t errors = 0;       // files that could not be opened or read
+    double seconds = 0;
+};
+
+// Fixed-string content search over a file or a tree. The tree is walked with
+// TreeWalk (as `search` does) and files are scanned on the work pool in
+// batches. Each file is read with pread in 1 MiB blocks into a per-thread
+// buffer and scanned a run of whole lines at a time (at most 16 MiB, and
+// binary files are rejected on the first block; no mmap, so a file
+// truncated mid-scan cannot raise SIGBUS). Matches are found with the
+// vectorized scan of findSubstring; newlines are counted only between hits
+// and to the end of each run, never per line.
+class Grep
+{
+public:
+    // Receives the complete output of one file ("path:line:text\n" per
+    // matching line, or "path\n" with filesOnly), so lines of one file are
+    // never interleaved with another's. Called from pool workers, never
+    // concurrently.
+    using FileCallback = std::function<void(const std::string &text)>;
+
+    static GrepStats run(const std::string &path, const std::string &pattern, const GrepOptions &options,
+                         const FileCallback &onFile);
+};
+
+#endif
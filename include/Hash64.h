@@ -0,0 +1,28 @@
+#ifndef HASH64_H
+#define HASH64_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Streaming XXH64: a fast non-cryptographic 64-bit hash, used to tell file
+// contents apart (dupes). Feeding the same bytes in any split gives the
+// same digest as hashing them in one call.
+class Hash64
+{
+public:
+    explicit Hash64(std::uint64_t seed = 0);
+
+    void update(const void *data, std::size_t n);
+    std::uint64_t digest() const;
+
+    static std::uint64_t of(const void *data, std::size_t n, std::uint64_t seed = 0);
+
+private:
+    std::uint64_t v_[4];
+    std::uint64_t seed_;
+    std::uint64_t total_ = 0;
+    unsigned char buf_[32];
+    std::size_t buffered_ = 0;
+};
+
+#endif
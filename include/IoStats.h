@@ -0,0 +1,57 @@
+#ifndef IO_STATS_H
+#define IO_STATS_H
+
+#include <atomic>
+#include <cstdint>
+
+// Counters of the filesystem syscalls issued by the listing and copy engines,
+// kept process-wide and per JobContext. Updated with relaxed atomics so
+// worker threads can share them.
+struct IoCounters
+{
+    std::atomic<std::uint64_t> opens{0};
+    std::atomic<std::uint64_t> closes{0};
+    std::atomic<std::uint64_t> getdents{0};
+    std::atomic<std::uint64_t> direntBytes{0}; // bytes of linux_dirent64 records returned
+    std::atomic<std::uint64_t> entries{0};     // directory entries handed to callers
+    std::atomic<std::uint64_t> stats{0};
+    std::atomic<std::uint64_t> statsSkipped{0}; // entries answered from d_type alone
+    std::atomic<std::uint64_t> ringEnters{0};   // io_uring_enter calls of the batched stat backend
+    std::atomic<std::uint64_t> ringStats{0};    // statx requests completed through the ring
+    std::atomic<std::uint64_t> dataCalls{0};    // read/write/copy_file_range/sendfile/FICLONE calls
+    std::atomic<std::uint64_t> bytesRead{0};
+    std::atomic<std::uint64_t> bytesWritten{0};
+};
+
+// Plain copy of the counters, used to compute per-operation deltas.
+struct IoSnapshot
+{
+    std::uint64_t opens = 0;
+    std::uint64_t closes = 0;
+    std::uint64_t getdents = 0;
+    std::uint64_t direntBytes = 0;
+    std::uint64_t entries = 0;
+    std::uint64_t stats = 0;
+    std::uint64_t statsSkipped = 0;
+    std::uint64_t ringEnters = 0;
+    std::uint64_t ringStats = 0;
+    std::uint64_t dataCalls = 0;
+    std::uint64_t bytesRead = 0;
+    std::uint64_t bytesWritten = 0;
+
+    std::uint64_t syscalls() const { return opens + closes + getdents + stats + ringEnters + dataCalls; }
+    // Syscalls the old opendir/readdir + per-entry ::stat(path) loop would
+    // have issued for the same work (glibc reads 32 KiB per getdents).
+    std::uint64_t legacySyscalls() const;
+};
+
+IoSnapshot operator-(const IoSnapshot &a, const IoSnapshot &b);
+
+IoCounters &ioCounters();
+IoSnapshot ioSnapshot(const IoCounters &counters = ioCounters());
+
+// Adds `n` to one counter, process-wide and in the current command's
+// JobContext, e.g. ioCount(&IoCounters::opens).
+void ioCount(std::atomic<std::uint64_t> IoCounters::*counter, std::uint64_t n = 1);
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef JOB_CONTEXT_H
+#define JOB_CONTEXT_H
+
+#include "IoStats.h"
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+// State shared by a running command and all the work it schedules: a
+// cancellation flag the engines poll between directories and copy chunks,
+// progress counters, the command's own IoStats counters and CPU time, and
+// the stream the command prints to. It is installed
+// per thread with JobScope, and WorkPool carries the submitter's context
+// into every task, so pool workers see the same one.
+class JobContext
+{
+public:
+    void cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+    bool cancelled() const { return cancelled_.load(std::memory_order_relaxed); }
+
+    std::uint64_t entries() const { return entries_.load(std::memory_order_relaxed); }
+    std::uint64_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+
+    // Syscalls and bytes of this command alone, whichever threads issued them.
+    IoCounters &io() { return io_; }
+    const IoCounters &io() const { return io_; }
+    // CPU time of every thread while it ran under this context, up to now.
+    double cpuSeconds() const;
+
+    // Output of the command; std::cout when null.
+    std::ostream *out = nullptr;
+
+    // Context of the calling thread, or null outside any command.
+    static JobContext *current();
+
+    // True when the current command has been asked to stop.
+    static bool stopRequested() {
+        JobContext *job = current();
+        return job && job->cancelled();
+    }
+
+    // Progress accounting for the current command; no-ops outside one.
+    static void addEntries(std::uint64_t n);
+    static void addBytes(std::uint64_t n);
+
+    static std::ostream &output();
+
+private:
+    friend class JobScope;
+
+    std::atomic<bool> cancelled_{false};
+    std::atomic<std::uint64_t> entries_{0};
+    std::atomic<std::uint64_t> bytes_{0};
+    IoCounters io_;
+    std::atomic<std::uint64_t> cpuNs_{0}; // charged when a thread leaves the context
+};
+
+// Makes `job` the current context of this thread until the scope ends. The
+// thread's CPU time in between is charged to `job`.
+class JobScope
+{
+public:
+    explicit JobScope(JobContext *job);
+    ~JobScope();
+
+    JobScope(const JobScope &) = delete;
+    JobScope &operator=(const JobScope &) = delete;
+
+private:
+    static void enter(JobContext *job);
+
+    JobContext *previous_;
+};
+
+#endif
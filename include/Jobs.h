@@ -0,0 +1,84 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "JobContext.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+// Background commands ("du /big &"). Each job runs on its own thread under
+// its own JobContext, so its pool tasks can be cancelled and its progress
+// read while it runs; its output is captured and shown by `fg`.
+class JobTable
+{
+public:
+    static JobTable &instance();
+    ~JobTable(); // cancels and joins every job still running
+
+    // Starts `body` in the background; returns the job id.
+    int start(const std::string &command, std::function<void()> body);
+
+    // One line per job: state, elapsed time, entries read and bytes copied.
+    void list(std::ostream &out);
+
+    // Waits for job `id` (the newest when 0), prints its captured output and
+    // forgets it. While waiting, Ctrl-C cancels the job. False if no such job.
+    bool foreground(int id, std::ostream &out);
+
+    // Foregrounds every job in id order; batch mode runs this before exiting.
+    void waitAll(std::ostream &out);
+
+    // Asks job `id` to stop at its next directory or copy chunk.
+    bool cancel(int id);
+
+    // Announces jobs that finished since the last call; run before each prompt.
+    void reportFinished(std::ostream &out);
+
+    // Ctrl-C cancels the foreground command instead of killing the process;
+    // a second Ctrl-C, or one at the prompt, still terminates.
+    static void installInterruptHandler();
+
+    // Registers the context Ctrl-C cancels for the scope's duration.
+    class Foreground
+    {
+    public:
+        explicit Foreground(JobContext *job);
+        ~Foreground();
+
+        Foreground(const Foreground &) = delete;
+        Foreground &operator=(const Foreground &) = delete;
+
+    private:
+        JobContext *previous_;
+    };
+
+private:
+    struct Job
+    {
+        int id = 0;
+        std::string command;
+        JobContext context;
+        std::ostringstream output;
+        std::thread thread;
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::time_point ended; // written before `finished` is set
+        std::atomic<bool> finished{false};
+        bool reported = false;
+    };
+
+    static void printJob(std::ostream &out, const Job &job);
+
+    std::mutex m_;
+    std::map<int, std::unique_ptr<Job>> jobs_;
+    int nextId_ = 1;
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef LIST_SORT_H
+#define LIST_SORT_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+class DirSnapshot;
+
+enum class ListOrder
+{
+    Size,     // largest first, empty directories last
+    Time,     // newest first
+    Name,     // natural order: "file2" before "file10"
+    Extension // by extension, then natural name
+};
+
+// (key, row) pair sorted in place of the rows themselves.
+struct SortEntry
+{
+    std::uint64_t key;
+    std::uint32_t index;
+};
+
+// Stable ascending LSD radix sort on the 64-bit key, skipping byte positions
+// where every key agrees. Large inputs are sorted in chunks on the work pool
+// and merged.
+void radixSort(std::vector<SortEntry> &entries);
+
+// "file2" < "file10": digit runs compare by numeric value, everything else
+// by ASCII case-insensitive byte value.
+bool naturalLess(std::string_view a, std::string_view b);
+
+// Text after the last '.', empty for names without one or dotfiles like ".bashrc".
+std::string_view extensionOf(std::string_view name);
+
+// Row indices of `snap` in display order. For ListOrder::Size, `sizes` gives
+// each row's size with directories already measured (0 = empty directory).
+// Ties in size and time are broken by name.
+std::vector<std::uint32_t> sortListing(const DirSnapshot &snap, ListOrder order,
+                                       const std::vector<std::uint64_t> *sizes = nullptr);
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef LISTING_CACHE_H
+#define LISTING_CACHE_H
+
+#include "DirWatch.h"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class DirSnapshot;
+
+// In-memory listings (FileSystem::listDir) of recently visited directories,
+// so `ls` after cd-ing back and forth costs no getdents and no stats. Each
+// cached directory has an inotify watch (DirWatch); pending events are
+// drained before every lookup, and any create, delete, rename, write or
+// attribute change inside the directory drops its listing. The watch is
+// added before the directory is read, and a listing is only stored if no
+// event arrived in between. Entries whose ls row depends on another inode's
+// state (subdirectories, whose mtime changes with their own contents, and
+// symlinks, shown by their target) are re-stat'ed on every hit instead.
+// Listings are keyed by path but the watch follows an inode, so every hit
+// also stats the path and checks that it still names the same directory
+// (it may have been renamed and replaced, or reached through a retargeted
+// symlink). Changes made through a hard link in another directory are not
+// seen.
+class ListingCache
+{
+public:
+    static const std::size_t MAX_DIRS = 32;
+    static const std::size_t MAX_ENTRIES = 1 << 20; // all cached listings together
+    static const std::size_t MAX_DIR_ENTRIES = 1 << 18; // larger directories are not cached
+
+    struct Stats
+    {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t invalidations = 0; // listings dropped because of an event
+        std::size_t dirs = 0;
+        std::size_t entries = 0;
+    };
+
+    static ListingCache &instance();
+
+    // The listing of `path` if it is cached and still current.
+    std::shared_ptr<const DirSnapshot> lookup(const std::string &path);
+
+    // Starts watching `path`; call before reading it and pass the ticket to
+    // store(). 0 when the directory cannot be watched (nothing is stored).
+    std::uint64_t prepare(const std::string &path);
+    // `recheck` lists the indices of the entries to re-stat on each hit.
+    void store(const std::string &path, std::uint64_t ticket, const DirSnapshot &listing,
+               std::vector<std::uint32_t> recheck);
+
+    void clear();
+    Stats stats();
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<const DirSnapshot> listing;
+        std::vector<std::uint32_t> recheck;
+        std::uint64_t version = 1; // bumped by every event in the directory
+        std::uint64_t lastUse = 0;
+        std::uint64_t dev = 0; // the watched directory
+        std::uint64_t ino = 0;
+    };
+
+    ListingCache() = default;
+    void drain();
+    void invalidate(Entry &entry);
+    bool current(const std::string &path, const Entry &entry);
+    static bool identify(const std::string &path, std::uint64_t &dev, std::uint64_t &ino);
+    void forget(std::unordered_map<std::string, Entry>::iterator it);
+    void evict();
+
+    std::mutex m_;
+    DirWatch watch_;
+    std::unordered_map<std::string, Entry> map_;
+    std::uint64_t clock_ = 0;
+    std::size_t entries_ = 0;
+    Stats stats_;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// One entry of a manifest. On disk the records follow the header as a
+// fixed 40-byte array; paths (relative to the root, "" for the root itself)
+// live in a blob after it.
+struct ManifestRecord
+{
+    std::uint64_t pathOff;
+    std::uint32_t pathLen;
+    std::uint32_t mode; // st_mode, type bits included
+    std::uint64_t size;
+    std::int64_t mtimeNs;
+    std::uint64_t ino;
+};
+
+struct ManifestScanStats
+{
+    std::uint64_t dirsRead = 0;   // directories listed with getdents
+    std::uint64_t dirsPruned = 0; // directories taken from the previous manifest
+    std::uint64_t errors = 0;
+    bool cancelled = false;
+};
+
+enum class ManifestChange { Added, Removed, Modified };
+
+// Snapshot of a tree, sorted by path with '/' ordered before every other
+// byte, so each directory is directly followed by its whole subtree and two
+// manifests can be compared in one merge pass. Saved files are mmap'ed on
+// load (native endianness, like FileIndex).
+class Manifest
+{
+public:
+    ~Manifest();
+
+    Manifest(const Manifest &) = delete;
+    Manifest &operator=(const Manifest &) = delete;
+
+    // Walks `root` in parallel. With `previous`, a directory whose mtime and
+    // inode still match it is not read: its files are copied from `previous`
+    // and only its subdirectories are visited. A file rewritten in place
+    // leaves its directory's mtime alone, so that change is only seen
+    // without `previous`.
+    static std::unique_ptr<Manifest> scan(const std::string &root, const Manifest *previous,
+                                          ManifestScanStats &stats);
+    static std::unique_ptr<Manifest> load(const std::string &file);
+    // Writes through a temporary file renamed into place; false on I/O errors.
+    bool save(const std::string &file) const;
+
+    const std::string &root() const { return root_; }
+    std::int64_t createdAtNs() const { return createdAtNs_; }
+    std::size_t size() const { return count_; }
+    const ManifestRecord &record(std::size_t i) const { return records_[i]; }
+    const char *pathData(std::size_t i) const { return names_ + records_[i].pathOff; }
+    std::string path(std::size_t i) const { return std::string(pathData(i), records_[i].pathLen); }
+
+    // Index of `path`, or size() when absent.
+    std::size_t find(const std::string &path) const;
+
+    // Reports every entry that differs between `before` and `after`, in path
+    // order. `what` names the changed fields of a Modified entry ("size,mtime").
+    using ChangeCallback = std::function<void(ManifestChange kind, const std::string &path, const std::string &what)>;
+    static void diff(const Manifest &before, const Manifest &after, const ChangeCallback &onChange);
+
+private:
+    Manifest() = default;
+
+    std::string root_;
+    std::int64_t createdAtNs_ = 0;
+    const ManifestRecord *records_ = nullptr;
+    const char *names_ = nullptr;
+    std::size_t count_ = 0;
+
+    // a loaded manifest points into the mapping, a scanned one into its vectors
+    const char *map_ = nullptr;
+    std::size_t mapSize_ = 0;
+    std::vector<ManifestRecord> ownRecords_;
+    std::string ownNames_;
+};
+
+#endif
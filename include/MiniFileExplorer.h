@@ -1,20 +1,39 @@
 #ifndef MINI_FILE_EXPLORER_H
 #define MINI_FILE_EXPLORER_H
 
+#include <istream>
 #include <string>
 
 class MiniFileExplorer {
 public:
+    // What a confirmation prompt is about; --no-clobber only declines overwrites.
+    enum class Confirm { Delete, Overwrite };
+
     MiniFileExplorer();
     MiniFileExplorer(const std::string& startDir); 
     void run();
+    // Runs commands from `in` without prompts: one per line, or several
+    // separated by ';'. Blank lines and lines starting with '#' are skipped.
+    void runBatch(std::istream& in);
     void execute(const std::string& input);
 
     std::string getCurrentDir() const;
     void setCurrentDir(const std::string& path);
 
+    // Asks `question` (y/n) interactively; in batch mode, or with --yes /
+    // --no-clobber, answers from the policy and echoes the answer.
+    bool confirm(Confirm kind, const std::string& question);
+    void setAssumeYes(bool yes) { assumeYes = yes; }
+    void setNoClobber(bool noClobber) { this->noClobber = noClobber; }
+    // Background jobs run on a copy with batch set: they never prompt.
+    void setBatch(bool batch) { this->batch = batch; }
+    bool isBatch() const { return batch; }
+
 private:
     std::string currentDir;
+    bool batch = false;
+    bool assumeYes = false;
+    bool noClobber = false;
 };
 
 #endif
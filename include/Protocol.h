@@ -0,0 +1,112 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// Wire format between `--serve` and `--connect`. Every message is a frame:
+//
+//   u32 length        bytes after this field
+//   u8  op | status   Op in requests, Status in responses
+//   u32 id            chosen by the client, echoed in the response
+//   ...               body
+//
+// Integers are in host byte order (the socket never leaves the machine) and
+// strings are a u32 length followed by the bytes. A connection may have many
+// requests in flight; responses come back as they finish, matched by id.
+//
+// Request and response bodies by op:
+//   ListDir  path                 -> u32 n, n x (u8 isDir, i64 size, i64 mtimeNs, str name)
+//   Search   path, keyword        -> u32 n, n x (u8 isDir, str path)
+//   DirSize  path                 -> u64 apparent, u64 allocated, u64 files, u64 dirs
+//   Stat     path                 -> u8 DT_* type, u32 mode, i64 size, i64 mtimeNs, u64 ino, u64 nlink
+//   Copy     src, dst, u8 overwrite -> u64 bytes
+//   Move     src, dst, u8 overwrite -> (empty)
+// A response with Status::Error carries one string, the message.
+namespace Protocol
+{
+
+enum class Op : std::uint8_t { ListDir = 1, Search, DirSize, Stat, Copy, Move };
+enum class Status : std::uint8_t { Ok = 0, Error = 1 };
+
+const std::size_t HEADER = 4 + 1 + 4;
+const std::uint32_t MAX_REQUEST = 1 << 20;   // longest request frame the server accepts
+const std::uint32_t MAX_RESPONSE = 1u << 31; // and response the client accepts
+
+// Builds one frame; the length is patched in by finish().
+class Writer
+{
+public:
+    Writer(std::uint8_t kind, std::uint32_t id) {
+        buf_.resize(4);
+        u8(kind);
+        u32(id);
+    }
+
+    void u8(std::uint8_t v) { put(&v, sizeof(v)); }
+    void u32(std::uint32_t v) { put(&v, sizeof(v)); }
+    void u64(std::uint64_t v) { put(&v, sizeof(v)); }
+    void i64(std::int64_t v) { put(&v, sizeof(v)); }
+    void str(const char *s, std::size_t n) {
+        u32(static_cast<std::uint32_t>(n));
+        put(s, n);
+    }
+    void str(const std::string &s) { str(s.data(), s.size()); }
+
+    std::string &finish() {
+        std::uint32_t len = static_cast<std::uint32_t>(buf_.size() - 4);
+        std::memcpy(&buf_[0], &len, sizeof(len));
+        return buf_;
+    }
+
+private:
+    void put(const void *p, std::size_t n) { buf_.append(static_cast<const char *>(p), n); }
+
+    std::string buf_;
+};
+
+// Reads the body of one frame; every getter returns zero once the frame is
+// exhausted, and ok() turns false.
+class Reader
+{
+public:
+    Reader(const char *p, std::size_t n) : p_(p), end_(p + n) {}
+
+    std::uint8_t u8() { return get<std::uint8_t>(); }
+    std::uint32_t u32() { return get<std::uint32_t>(); }
+    std::uint64_t u64() { return get<std::uint64_t>(); }
+    std::int64_t i64() { return get<std::int64_t>(); }
+    std::string str() {
+        std::uint32_t n = u32();
+        if (static_cast<std::size_t>(end_ - p_) < n) {
+            ok_ = false;
+            return std::string();
+        }
+        std::string s(p_, n);
+        p_ += n;
+        return s;
+    }
+
+    bool ok() const { return ok_; }
+
+private:
+    template <typename T> T get() {
+        T v = 0;
+        if (static_cast<std::size_t>(end_ - p_) < sizeof(T)) {
+            ok_ = false;
+            return v;
+        }
+        std::memcpy(&v, p_, sizeof(T));
+        p_ += sizeof(T);
+        return v;
+    }
+
+    const char *p_;
+    const char *end_;
+    bool ok_ = true;
+};
+
+} // namespace Protocol
+
+#endif
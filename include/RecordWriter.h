@@ -0,0 +1,130 @@
+#ifndef RECORD_WRITER_H
+#define RECORD_WRITER_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+enum class OutputFormat
+{
+    Text,   // aligned columns for people
+    Ndjson, // one JSON object per line
+    Binary  // RecordHeader + path, see below
+};
+
+const char *outputFormatName(OutputFormat format);
+bool parseOutputFormat(const std::string &name, OutputFormat &out);
+
+// Process-wide output format of the listing commands (--format=...).
+void setOutputFormat(OutputFormat format);
+OutputFormat outputFormat();
+
+// Layout of one record in the binary format. A stream is a sequence of
+// records and nothing else, so a file of them can be mmap'ed and walked by
+// `length`. Each record is this 48-byte header, then `pathLen` bytes of
+// path, a NUL, and zero padding up to the next multiple of 8; records stay
+// 8-byte aligned and the header can be read in place. Integers are in host
+// byte order.
+//
+//   kind    type   flags               mode     v[0]      v[1]       v[2]   v[3]
+//   Entry   DT_*   ENTRY_HAS_* bits    st_mode  size      mtimeNs    ino    0
+//   Total   DT_DIR 0                   0        apparent  allocated  files  dirs
+//   Error   0      0                   0        0         0          0      0
+//   End     0      END_* status        0        entries   0          0      0
+//
+// Entry fields whose bit is clear were not looked up and are zero. The path
+// of an Error is its message and that of an End the command name; every
+// command's records finish with exactly one End.
+struct RecordHeader
+{
+    std::uint32_t length;  // of the whole record, padding included
+    std::uint8_t kind;     // RecordKind
+    std::uint8_t type;     // DT_* value of the entry
+    std::uint16_t flags;
+    std::uint32_t pathLen; // bytes, without the NUL
+    std::uint32_t mode;
+    std::uint64_t v[4];
+};
+static_assert(sizeof(RecordHeader) == 48, "RecordHeader is a wire format");
+
+enum RecordKind : std::uint8_t { RECORD_ENTRY = 1, RECORD_TOTAL = 2, RECORD_ERROR = 3, RECORD_END = 4 };
+
+enum : std::uint16_t {
+    ENTRY_HAS_SIZE = 1 << 0,
+    ENTRY_HAS_MTIME = 1 << 1,
+    ENTRY_HAS_MODE = 1 << 2,
+    ENTRY_HAS_INO = 1 << 3,
+};
+
+enum : std::uint16_t { END_COMPLETE = 0, END_CANCELLED = 1, END_FAILED = 2 };
+
+// One entry of a listing; only the fields named in `fields` are written.
+struct EntryRecord
+{
+    unsigned char type = 0; // DT_* value
+    std::uint16_t fields = 0;
+    std::uint32_t mode = 0;
+    std::int64_t size = 0;
+    std::int64_t mtimeNs = 0;
+    std::uint64_t ino = 0;
+};
+
+// Structured output of one command. Records are encoded straight into one
+// buffer, with raw integers and no locale or padding, and handed to the
+// stream a block at a time. The NDJSON form of the kinds above:
+//   {"kind":"entry","path":"a.txt","type":"f","size":6,"mtime_ns":1700000000000000000,"mode":33188,"ino":42}
+//   {"kind":"total","path":"src","apparent":1,"allocated":4096,"files":1,"dirs":1}
+//   {"kind":"error","message":"Invalid target path"}
+//   {"kind":"end","command":"ls","entries":1,"status":"complete"}
+// with `type` as in find -type (f, d, l, or ? for anything else). Strings are
+// escaped per JSON and always valid UTF-8: invalid bytes become U+FFFD, and a
+// path containing any also gets "path_b64", its exact bytes in base64:
+//   {"kind":"entry","path":"caf\ufffd","path_b64":"Y2Fm6Q==","type":"f"}
+// The binary format carries paths byte for byte.
+// Not thread-safe: callers that produce entries on several threads already
+// serialize their callbacks.
+class RecordWriter
+{
+public:
+    // `command` names the End record.
+    RecordWriter(std::ostream &out, OutputFormat format, const char *command);
+    ~RecordWriter(); // finish()
+
+    RecordWriter(const RecordWriter &) = delete;
+    RecordWriter &operator=(const RecordWriter &) = delete;
+
+    void entry(std::string_view path, const EntryRecord &entry);
+    void entry(std::string_view prefix, std::string_view path, const EntryRecord &entry); // prefix + "/" + path
+    void total(std::string_view path, std::uint64_t apparent, std::uint64_t allocated, std::uint64_t files,
+               std::uint64_t dirs);
+    void error(std::string_view message);
+
+    // Hands what is buffered to the stream and flushes it.
+    void flush();
+
+    // Writes the End record, failed after any error() and cancelled when the
+    // current job was asked to stop, then flushes. Later calls do nothing.
+    void finish();
+
+private:
+    static const std::size_t FLUSH_AT = 64 * 1024;
+
+    void binary(RecordKind kind, unsigned char type, std::uint16_t flags, std::uint32_t mode, std::string_view path,
+                std::uint64_t v0, std::uint64_t v1, std::uint64_t v2, std::uint64_t v3);
+    void spill() {
+        if (buf_.size() >= FLUSH_AT) drain();
+    }
+    void drain();
+
+    std::ostream &out_;
+    OutputFormat format_;
+    const char *command_;
+    std::string buf_;
+    std::string joined_; // reused by the prefix overload of entry()
+    std::uint64_t entries_ = 0;
+    bool failed_ = false;
+    bool finished_ = false;
+};
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <cstddef>
+#include <string>
+
+// `--serve <socket>`: a long-lived process answering FileSystem requests
+// (see Protocol.h) on a Unix domain socket, so short queries skip process
+// startup and hit caches that are already warm: ListingCache, DirSizeCache
+// and any FileIndex. One thread runs an epoll loop that accepts clients,
+// reads request frames and writes responses; requests run on a dedicated
+// WorkPool, and their walks fan out to the shared pool as usual. Each
+// connection has its own JobContext, so a client that disconnects cancels
+// whatever it still had running.
+class Server
+{
+public:
+    static const unsigned DEFAULT_WORKERS = 8;
+    // Requests of one connection in progress at once; further frames wait
+    // in its input buffer.
+    static const unsigned MAX_IN_FLIGHT = 64;
+    // Responses a connection may have waiting to be written, and request
+    // bytes read ahead, before it stops being read: a client that sends
+    // without reading gets no more work done until it catches up.
+    static const std::size_t MAX_PENDING_OUTPUT = 4 << 20;
+    static const std::size_t MAX_PENDING_INPUT = 4 << 20;
+
+    // Serves until SIGINT or SIGTERM; returns the process exit status.
+    static int run(const std::string &socketPath);
+};
+
+#endif
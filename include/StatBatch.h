@@ -0,0 +1,60 @@
+#ifndef STAT_BATCH_H
+#define STAT_BATCH_H
+
+#include "DirReader.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class StatBackend
+{
+    Sync, // one statx/fstatat syscall per entry
+    Uring // statx requests submitted a ring at a time through io_uring
+};
+
+const char *statBackendName(StatBackend backend);
+bool parseStatBackend(const std::string &name, StatBackend &out);
+
+// Process-wide backend selection (--io=...). Selecting Uring on a kernel
+// without io_uring or IORING_OP_STATX silently degrades to Sync.
+void setStatBackend(StatBackend backend);
+StatBackend statBackend();
+
+// Stats a set of names relative to one directory fd. With the io_uring
+// backend all queued requests are submitted at once (one io_uring_enter per
+// ring-full), so on high-latency filesystems the round trips overlap instead
+// of being paid one after another.
+class StatBatch
+{
+public:
+    StatBatch(int dirfd, unsigned fields, bool follow = true);
+
+    // Queues `name` (copied) and returns its index.
+    std::size_t add(const char *name, std::size_t len);
+    std::size_t size() const { return offsets_.size(); }
+    bool empty() const { return offsets_.empty(); }
+
+    // Stats everything queued since the last clear().
+    void run();
+
+    const char *name(std::size_t i) const { return names_.data() + offsets_[i]; }
+    bool ok(std::size_t i) const { return ok_[i] != 0; }
+    const StatInfo &info(std::size_t i) const { return infos_[i]; }
+
+    void clear();
+
+private:
+    bool runUring();
+
+    int dirfd_;
+    unsigned fields_;
+    bool follow_;
+    std::string names_; // NUL-terminated names back to back
+    std::vector<std::uint32_t> offsets_;
+    std::vector<StatInfo> infos_;
+    std::vector<unsigned char> ok_;
+};
+
+#endif
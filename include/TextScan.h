@@ -0,0 +1,25 @@
+#ifndef TEXT_SCAN_H
+#define TEXT_SCAN_H
+
+#include <cstddef>
+#include <string>
+
+// Lowercases ASCII letters only, matching the "C" locale ::tolower used elsewhere.
+inline unsigned char asciiLower(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c | 0x20) : c;
+}
+
+std::string asciiLowerCopy(const std::string &s);
+
+// ASCII case-insensitive substring test. `needleLower` must already be
+// lowercase. Uses an SSE2 first/last-byte filter (16 candidate positions
+// per step) when available and never allocates.
+bool containsIgnoreCase(const char *hay, std::size_t n, const char *needleLower, std::size_t m);
+
+// Offset of the first occurrence of `needle` in `hay`, or `n` when there is
+// none. Same first/last-byte filter; with ignoreCase `needle` must already
+// be lowercase.
+std::size_t findSubstring(const char *hay, std::size_t n, const char *needle, std::size_t m, bool ignoreCase);
+
+#endif
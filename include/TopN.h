@@ -0,0 +1,44 @@
+#ifndef TOP_N_H
+#define TOP_N_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct TopEntry
+{
+    std::uint64_t size = 0;
+    std::string path; // relative to the scanned root
+};
+
+struct TopStats
+{
+    bool ok = false; // false if the root could not be opened
+    std::uint64_t total = 0; // bytes under the root
+    std::uint64_t files = 0;
+    std::uint64_t dirs = 0;
+    std::uint64_t errors = 0;
+    bool cancelled = false;
+    double seconds = 0;
+};
+
+// The largest files and directories of a tree from one parallel DiskUsage
+// walk. Files are offered to a bounded min-heap as they are stat'ed, and
+// each directory is offered to a second one when the walk leaves it, with
+// its subtree total already folded bottom-up. Anything not larger than the
+// smallest kept entry of a full heap is rejected with one atomic load and
+// never builds a path, so memory is O(n) plus the directories still open,
+// whatever the size of the tree. Hard links are counted once in directory
+// totals and listed once among files.
+class TopN
+{
+public:
+    static const std::size_t MAX_COUNT = 100000; // largest n `top` accepts
+
+    // Both lists are ordered largest first; `allocated` ranks by allocated
+    // blocks instead of apparent size. The root itself is not listed.
+    static TopStats scan(const std::string &root, std::size_t n, bool allocated, std::vector<TopEntry> &files,
+                         std::vector<TopEntry> &dirs);
+};
+
+#endif
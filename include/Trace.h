@@ -0,0 +1,49 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <string>
+
+// Chrome trace-event output, switched on by MFE_TRACE=<file>. Every span is
+// written as one complete ("X") event on the calling thread; open the file
+// in chrome://tracing or ui.perfetto.dev. When the variable is unset a span
+// costs one branch.
+class Trace
+{
+public:
+    static bool enabled();
+
+    // Microseconds on the steady clock, the timebase of every event.
+    static std::int64_t nowUs();
+
+    // `args` is the body of a JSON object ("\"k\":1,\"j\":2") or empty.
+    static void complete(const std::string &name, const char *category, std::int64_t startUs,
+                         std::int64_t durationUs, const std::string &args = std::string());
+
+    // Pushes buffered events to the file; called after every command.
+    static void flush();
+};
+
+// Records the enclosing scope as one event.
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name, const char *category = "phase");
+    TraceSpan(std::string name, const char *category);
+    ~TraceSpan();
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+    // Attached to the event as its "args" object.
+    void setArgs(std::string args) { args_ = std::move(args); }
+
+private:
+    bool on_;
+    std::string name_;
+    const char *category_;
+    std::int64_t start_ = 0;
+    std::string args_;
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef TREE_COPY_H
+#define TREE_COPY_H
+
+#include <cstdint>
+#include <string>
+
+struct TreeCopyStats
+{
+    bool ok = false; // false if the source or target root could not be opened/created
+    std::uint64_t files = 0;
+    std::uint64_t dirs = 0;
+    std::uint64_t symlinks = 0;
+    std::uint64_t bytes = 0;
+    std::uint64_t errors = 0; // entries that failed or had an unsupported type
+    std::uint64_t skipped = 0; // sync: files and symlinks already up to date
+    std::uint64_t deleted = 0; // sync: entries removed from the target (subtrees counted in full)
+    bool cancelled = false;   // the job was cancelled; the copy is incomplete
+    double seconds = 0;
+};
+
+struct SyncOptions
+{
+    bool deleteExtra = false; // remove target entries missing from the source
+    bool dryRun = false;      // count what would change; nothing is written
+};
+
+// Pipelined recursive copy:
+//  1. the calling thread walks the source, creating each directory in the
+//     target as it is reached and recreating symlinks;
+//  2. files are handed to the work pool in batches of up to 32 and copied
+//     concurrently through CopyEngine, with their mode and times set on the
+//     open fd; a batch is also cut where its bytes pass 1 MiB, so a large
+//     file does not hold up the small ones queued behind it;
+//  3. directory modes and times are applied in a final bottom-up pass, after
+//     their contents stop changing.
+// sync() runs the same pipeline as a mirror: each worker first compares the
+// file with its counterpart in the target and skips it when size and mtime
+// match (copies keep the source mtime, so a second run finds nothing to do).
+class TreeCopy
+{
+public:
+    // Copies the directory `src` to `dst`. If `dst` already exists it must be a
+    // directory and `overwrite` must be set; existing files are then replaced.
+    static TreeCopyStats copy(const std::string &src, const std::string &dst, bool overwrite);
+
+    // Makes `dst` (created if missing) a mirror of the directory `src`. Target
+    // entries of another type than their source entry are replaced. In a dry
+    // run, files/symlinks/bytes/deleted are what would be copied and removed.
+    static TreeCopyStats sync(const std::string &src, const std::string &dst, const SyncOptions &options);
+};
+
+#endif
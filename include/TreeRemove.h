@@ -0,0 +1,35 @@
+#ifndef TREE_REMOVE_H
+#define TREE_REMOVE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+struct TreeRemoveStats
+{
+    bool ok = false; // false if the root could not be opened or stat'ed
+    std::uint64_t files = 0; // non-directories, symlinks included
+    std::uint64_t dirs = 0;
+    std::uint64_t errors = 0; // entries that could not be read or removed
+    bool cancelled = false;   // the job was cancelled; the tree is partly removed
+    double seconds = 0;
+};
+
+// Parallel recursive delete on top of TreeWalk:
+//  1. directories are read through their fds on the work pool;
+//  2. the entries of each directory are unlinked with unlinkat() in batches
+//     that are themselves spread over the pool;
+//  3. a directory is removed (AT_REMOVEDIR, relative to its parent's fd) as
+//     soon as the last of its entries and subdirectories is gone.
+// Symlinks are removed, never followed.
+class TreeRemove
+{
+public:
+    // Called with running totals at most every PROGRESS_INTERVAL, from
+    // whichever thread is finishing work; never concurrently.
+    using Progress = std::function<void(std::uint64_t files, std::uint64_t dirs)>;
+
+    static TreeRemoveStats remove(const std::string &path, const Progress &progress = Progress());
+};
+
+#endif
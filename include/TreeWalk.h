@@ -0,0 +1,103 @@
+#ifndef TREE_WALK_H
+#define TREE_WALK_H
+
+#include "DirReader.h"
+#include "WorkPool.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A directory being walked. The fd stays open until the directory and all of
+// its descendants are finished, so children are opened with openat() and
+// visitors can fstatat() relative to it.
+struct WalkDir : std::enable_shared_from_this<WalkDir>
+{
+    int fd = -1;
+    std::string path; // relative to the walk root, "" for the root itself
+    std::string name; // name inside the parent
+    int depth = 0;
+    bool incomplete = false; // reading the entries failed part-way
+    std::shared_ptr<WalkDir> parent;
+
+    // Subtree accumulators: visitors add to them, and when the subtree is
+    // complete the walker folds them into the parent's.
+    std::atomic<std::uint64_t> sum[2] = {{0}, {0}};
+
+    std::atomic<long> pending{1};
+
+    WalkDir() = default;
+    WalkDir(const WalkDir &) = delete;
+    WalkDir &operator=(const WalkDir &) = delete;
+    virtual ~WalkDir();
+
+    // Path of a child entry relative to the walk root.
+    std::string childPath(const char *child) const;
+};
+
+class JobContext;
+class TreeWalk;
+
+// Callbacks run concurrently on pool workers, but never concurrently for the
+// same directory.
+class TreeVisitor
+{
+public:
+    virtual ~TreeVisitor() = default;
+
+    // Visitors needing per-directory state return a WalkDir subclass here.
+    virtual std::shared_ptr<WalkDir> makeDir() { return std::make_shared<WalkDir>(); }
+
+    // Called after the directory is opened. Returning false skips reading it
+    // (the visitor may still call TreeWalk::descend() for known children).
+    virtual bool enterDir(TreeWalk &, WalkDir &) { return true; }
+
+    // Called for each entry; `type` is d_type, resolved with a no-follow stat
+    // only when the filesystem reports DT_UNKNOWN. Return true to descend
+    // into a directory entry.
+    virtual bool visit(TreeWalk &walk, WalkDir &dir, const DirEntry &entry, unsigned char type) = 0;
+
+    // Called after the directory's last entry was visited, before any of its
+    // subdirectories are walked; visitors that batch per-entry work flush it here.
+    virtual void entriesDone(TreeWalk &, WalkDir &) {}
+
+    // Called bottom-up once the directory and all of its descendants are done.
+    virtual void leaveDir(TreeWalk &, WalkDir &) {}
+};
+
+// Parallel directory walker: subdirectories are spread over the work-stealing
+// pool while the queue is shallow and recursed into inline otherwise, which
+// bounds the number of open directory fds. Once the current job is cancelled,
+// directories not yet opened are skipped.
+class TreeWalk
+{
+public:
+    explicit TreeWalk(TreeVisitor &visitor, WorkPool &pool = WorkPool::shared());
+
+    // Walks `root`; returns false if it cannot be opened.
+    bool run(const std::string &root);
+
+    // Schedules `name` (a directory inside `parent`) for walking.
+    void descend(const std::shared_ptr<WalkDir> &parent, const std::string &name);
+
+    // Runs `task` on the pool as part of `dir`: the directory is not left
+    // (leaveDir) until the task has returned. Runs inline when the queue is deep.
+    void spawn(const std::shared_ptr<WalkDir> &dir, WorkPool::Task task);
+
+    std::uint64_t errors() const { return errors_.load(std::memory_order_relaxed); }
+    const std::shared_ptr<WalkDir> &root() const { return root_; }
+
+private:
+    void walkDir(const std::shared_ptr<WalkDir> &dir);
+    void finish(std::shared_ptr<WalkDir> dir);
+
+    TreeVisitor &visitor_;
+    JobContext *job_;
+    TaskGroup group_;
+    std::shared_ptr<WalkDir> root_;
+    std::atomic<std::uint64_t> errors_{0};
+};
+
+#endif
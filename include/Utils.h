@@ -1,9 +1,20 @@
 #ifndef UTILS_H
 #define UTILS_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
 std::vector<std::string> split(const std::string& input);
 
+// Directory for persistent caches ($MFE_CACHE_DIR, $XDG_CACHE_HOME or
+// ~/.cache, plus "/minifileexplorer"); created on first use.
+std::string cacheDir();
+
+// Local time "YYYY-MM-DD HH:MM:SS" of an epoch timestamp in nanoseconds.
+std::string formatTime(std::int64_t epochNs);
+
+// "512B", "1.5KB", "3.2GB": binary units, one decimal above bytes.
+std::string formatBytes(std::uint64_t bytes);
+
 #endif
@@ -0,0 +1,90 @@
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobContext;
+
+// Work-stealing thread pool. Every worker owns a deque: tasks submitted from
+// a worker go to the back of its own deque and are popped LIFO (depth-first,
+// keeps the working set of open directories small); idle workers steal from
+// the front of the other deques (breadth, big subtrees first). A task runs
+// under the JobContext that was current when it was submitted.
+class WorkPool
+{
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkPool(unsigned threads);
+    ~WorkPool();
+
+    WorkPool(const WorkPool &) = delete;
+    WorkPool &operator=(const WorkPool &) = delete;
+
+    // Process-wide pool; size from $MFE_THREADS, default max(4, cores) since
+    // the walkers are bound by metadata latency rather than CPU.
+    static WorkPool &shared();
+
+    unsigned threads() const { return static_cast<unsigned>(threads_.size()); }
+    std::size_t queued() const { return queued_.load(std::memory_order_relaxed); }
+
+    void submit(Task task);
+    // Runs one queued task on the calling thread, if any; used by waiters to help.
+    bool tryRunOne();
+
+private:
+    struct Item
+    {
+        Task task;
+        JobContext *job;
+    };
+
+    struct Queue
+    {
+        std::mutex m;
+        std::deque<Item> tasks;
+    };
+
+    void loop(unsigned index);
+    bool take(int self, Item &item);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<std::size_t> queued_{0};
+    std::atomic<unsigned> next_{0};
+    std::mutex sleepM_;
+    std::condition_variable sleepCv_;
+    bool stop_ = false;
+};
+
+// Tracks a set of tasks (which may spawn more tasks into the same group) and
+// lets the caller wait for all of them while helping to run queued work.
+class TaskGroup
+{
+public:
+    explicit TaskGroup(WorkPool &pool = WorkPool::shared());
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    WorkPool &pool() { return pool_; }
+    void run(WorkPool::Task task);
+    void wait();
+
+private:
+    WorkPool &pool_;
+    std::atomic<std::size_t> pending_{0};
+    std::mutex m_;
+    std::condition_variable cv_;
+};
+
+#endif
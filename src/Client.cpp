@@ -0,0 +1,211 @@
+#include "Client.h"
+#include "Utils.h"
+
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+
+using namespace Protocol;
+
+namespace {
+
+// Paths travel absolute: the server has its own working directory.
+std::string absolute(const std::string &path) {
+    return std::filesystem::absolute(path).lexically_normal().string();
+}
+
+bool sendAll(int fd, const std::string &data) {
+    std::size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = ::send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        done += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+const char *typeName(unsigned type) {
+    switch (type) {
+    case DT_DIR: return "Folder";
+    case DT_REG: return "File";
+    case DT_LNK: return "Symlink";
+    default: return "Other";
+    }
+}
+
+} // namespace
+
+Client::~Client() {
+    if (fd_ >= 0) ::close(fd_);
+}
+
+bool Client::connect(const std::string &socketPath) {
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) return false;
+    std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    return fd_ >= 0 && ::connect(fd_, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == 0;
+}
+
+bool Client::readFull(char *p, std::size_t n) {
+    while (n > 0) {
+        ssize_t r = ::read(fd_, p, n);
+        if (r <= 0) return false;
+        p += r;
+        n -= static_cast<std::size_t>(r);
+    }
+    return true;
+}
+
+bool Client::call(Writer &request, Status &status, std::string &body) {
+    std::string &frame = request.finish();
+    std::uint32_t id;
+    std::memcpy(&id, frame.data() + 5, sizeof(id));
+    if (!sendAll(fd_, frame)) return false;
+
+    std::uint32_t len;
+    if (!readFull(reinterpret_cast<char *>(&len), sizeof(len))) return false;
+    if (len < HEADER - 4 || len > MAX_RESPONSE) return false;
+    std::string response(len, '\0');
+    if (!readFull(&response[0], len)) return false;
+
+    Reader header(response.data(), HEADER - 4);
+    status = static_cast<Status>(header.u8());
+    if (header.u32() != id) return false; // one request at a time: anything else is a protocol error
+    body = response.substr(HEADER - 4);
+    return true;
+}
+
+bool Client::command(const std::vector<std::string> &args, std::ostream &out) {
+    const std::string &cmd = args[0];
+    std::vector<std::string> rest(args.begin() + 1, args.end());
+    bool force = !rest.empty() && rest[0] == "-f" && (cmd == "cp" || cmd == "mv");
+    if (force) rest.erase(rest.begin());
+
+    Op op;
+    Writer request(0, 0);
+    if (cmd == "ls" && rest.size() <= 1) {
+        op = Op::ListDir;
+        request = Writer(static_cast<std::uint8_t>(op), nextId());
+        request.str(absolute(rest.empty() ? "." : rest[0]));
+    } else if (cmd == "search" && (rest.size() == 1 || rest.size() == 2)) {
+        op = Op::Search;
+        request = Writer(static_cast<std::uint8_t>(op), nextId());
+        request.str(absolute(rest.size() > 1 ? rest[1] : "."));
+        request.str(rest[0]);
+    } else if (cmd == "du" && rest.size() <= 1) {
+        op = Op::DirSize;
+        request = Writer(static_cast<std::uint8_t>(op), nextId());
+        request.str(absolute(rest.empty() ? "." : rest[0]));
+    } else if (cmd == "stat" && rest.size() == 1) {
+        op = Op::Stat;
+        request = Writer(static_cast<std::uint8_t>(op), nextId());
+        request.str(absolute(rest[0]));
+    } else if ((cmd == "cp" || cmd == "mv") && rest.size() == 2) {
+        op = cmd == "cp" ? Op::Copy : Op::Move;
+        request = Writer(static_cast<std::uint8_t>(op), nextId());
+        request.str(absolute(rest[0]));
+        request.str(absolute(rest[1]));
+        request.u8(force);
+    } else {
+        out << "Usage: ls [dir] | search <keyword> [dir] | du [dir] | stat <path> | cp [-f] <src> <dst> | mv [-f] <src> <dst>\n";
+        return false;
+    }
+
+    Status status;
+    std::string body;
+    if (!call(request, status, body)) {
+        out << "Connection to the server lost\n";
+        return false;
+    }
+    Reader in(body.data(), body.size());
+    if (status != Status::Ok) {
+        out << in.str() << "\n";
+        return false;
+    }
+
+    switch (op) {
+    case Op::ListDir: {
+        std::uint32_t n = in.u32();
+        for (std::uint32_t i = 0; i < n && in.ok(); ++i) {
+            bool isDir = in.u8() != 0;
+            std::int64_t size = in.i64();
+            std::int64_t mtime = in.i64();
+            std::string name = in.str();
+            out << std::left << std::setw(8) << (isDir ? "Dir" : "File") << std::right << std::setw(14)
+                << (isDir ? std::string("-") : std::to_string(size)) << "  " << formatTime(mtime) << "  " << name
+                << (isDir ? "/" : "") << "\n";
+        }
+        break;
+    }
+    case Op::Search: {
+        std::uint32_t n = in.u32();
+        for (std::uint32_t i = 0; i < n && in.ok(); ++i) {
+            bool isDir = in.u8() != 0;
+            std::string path = in.str();
+            out << path << " (" << (isDir ? "Dir" : "File") << ")\n";
+        }
+        out << "(" << n << " items)\n";
+        break;
+    }
+    case Op::DirSize: {
+        std::uint64_t apparent = in.u64(), allocated = in.u64(), files = in.u64(), dirs = in.u64();
+        out << apparent << " bytes (" << formatBytes(apparent) << ", " << formatBytes(allocated) << " allocated) in "
+            << files << " files, " << dirs << " dirs\n";
+        break;
+    }
+    case Op::Stat: {
+        unsigned type = in.u8();
+        std::uint32_t mode = in.u32();
+        std::int64_t size = in.i64(), mtime = in.i64();
+        std::uint64_t ino = in.u64(), nlink = in.u64();
+        out << "Type: " << typeName(type) << "\n"
+            << "Size(B): " << size << "\n"
+            << "Mode: " << std::oct << (mode & 07777) << std::dec << "\n"
+            << "Modification Time: " << formatTime(mtime) << "\n"
+            << "Inode: " << ino << " (" << nlink << " links)\n";
+        break;
+    }
+    case Op::Copy:
+        out << "Copied " << in.u64() << " bytes\n";
+        break;
+    case Op::Move:
+        break;
+    }
+    if (!in.ok()) {
+        out << "Malformed response\n";
+        return false;
+    }
+    return true;
+}
+
+int Client::run(const std::string &socketPath, const std::vector<std::string> &args, std::istream &script) {
+    Client client;
+    if (!client.connect(socketPath)) {
+        std::cout << "Cannot connect to " << socketPath << ": " << std::strerror(errno) << "\n";
+        return 1;
+    }
+    if (!args.empty()) return client.command(args, std::cout) ? 0 : 1;
+
+    int status = 0;
+    std::string line;
+    while (std::getline(script, line)) {
+        std::size_t begin = 0;
+        while (begin <= line.size()) {
+            std::size_t end = line.find(';', begin);
+            if (end == std::string::npos) end = line.size();
+            std::vector<std::string> command = split(line.substr(begin, end - begin));
+            begin = end + 1;
+            if (command.empty() || command[0][0] == '#') continue;
+            if (!client.command(command, std::cout)) status = 1;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,144 @@
+#include "CommandStats.h"
+#include "JobContext.h"
+#include "Utils.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+namespace {
+
+// Latency histogram buckets: one per decade from 10us to 10s.
+const double BUCKET_LIMITS[] = {1e-5, 1e-4, 1e-3, 1e-2, 1e-1, 1.0, 10.0};
+const char *const BUCKET_LABELS[] = {"< 10us", "< 100us", "< 1ms", "< 10ms", "< 100ms", "< 1s", "< 10s", ">= 10s"};
+const std::size_t BUCKETS = sizeof(BUCKET_LABELS) / sizeof(BUCKET_LABELS[0]);
+const std::size_t BAR_WIDTH = 40;
+
+std::string formatSeconds(double s) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(2);
+    if (s < 1e-3) out << s * 1e6 << "us";
+    else if (s < 1) out << s * 1e3 << "ms";
+    else out << s << "s";
+    return out.str();
+}
+
+// Nearest-rank percentile of sorted samples.
+double percentile(const std::vector<double> &sorted, double p) {
+    std::size_t rank = static_cast<std::size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+void addSample(CommandSample &total, const CommandSample &s) {
+    total.wallSeconds += s.wallSeconds;
+    total.cpuSeconds += s.cpuSeconds;
+    total.entries += s.entries;
+    total.bytesRead += s.bytesRead;
+    total.bytesWritten += s.bytesWritten;
+    total.syscalls += s.syscalls;
+}
+
+} // namespace
+
+CommandProbe::CommandProbe()
+    : job_(JobContext::current()), start_(std::chrono::steady_clock::now()), cpuStart_(cpuNow()),
+      io_(ioNow()) {}
+
+IoSnapshot CommandProbe::ioNow() const {
+    return job_ ? ioSnapshot(job_->io()) : ioSnapshot();
+}
+
+double CommandProbe::cpuNow() const {
+    if (job_) return job_->cpuSeconds();
+    struct rusage ru{};
+    ::getrusage(RUSAGE_SELF, &ru);
+    auto seconds = [](const timeval &tv) { return static_cast<double>(tv.tv_sec) + tv.tv_usec / 1e6; };
+    return seconds(ru.ru_utime) + seconds(ru.ru_stime);
+}
+
+CommandSample CommandProbe::finish() const {
+    IoSnapshot io = ioNow() - io_;
+    CommandSample s;
+    s.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    s.cpuSeconds = cpuNow() - cpuStart_;
+    s.entries = io.entries;
+    s.bytesRead = io.bytesRead;
+    s.bytesWritten = io.bytesWritten;
+    s.syscalls = io.syscalls();
+    return s;
+}
+
+CommandStats &CommandStats::instance() {
+    static CommandStats stats;
+    return stats;
+}
+
+void CommandStats::record(const std::string &command, const CommandSample &sample) {
+    std::lock_guard<std::mutex> lock(m_);
+    Series &series = commands_[command];
+    series.wall.push_back(sample.wallSeconds);
+    addSample(series.total, sample);
+}
+
+void CommandStats::clear() {
+    std::lock_guard<std::mutex> lock(m_);
+    commands_.clear();
+}
+
+void CommandStats::print(std::ostream &out, const std::string &command) const {
+    std::lock_guard<std::mutex> lock(m_);
+    if (commands_.empty()) {
+        out << "No commands recorded yet\n";
+        return;
+    }
+    if (!command.empty() && commands_.find(command) == commands_.end()) {
+        out << "No runs of " << command << " recorded\n";
+        return;
+    }
+
+    out << std::left << std::setw(10) << "Command" << std::right << std::setw(6) << "Runs"
+        << std::setw(11) << "Total" << std::setw(11) << "Mean" << std::setw(11) << "p50" << std::setw(11) << "p99"
+        << std::setw(11) << "CPU" << std::setw(10) << "Entries" << std::setw(10) << "Read" << std::setw(10) << "Written"
+        << std::setw(10) << "Syscalls" << "\n";
+
+    std::vector<double> selected;
+    for (const auto &kv : commands_) {
+        if (!command.empty() && command != kv.first) continue;
+        const Series &s = kv.second;
+        std::vector<double> sorted = s.wall;
+        std::sort(sorted.begin(), sorted.end());
+        double runs = static_cast<double>(sorted.size());
+        out << std::left << std::setw(10) << kv.first << std::right << std::setw(6) << sorted.size()
+            << std::setw(11) << formatSeconds(s.total.wallSeconds) << std::setw(11) << formatSeconds(s.total.wallSeconds / runs)
+            << std::setw(11) << formatSeconds(percentile(sorted, 0.5)) << std::setw(11) << formatSeconds(percentile(sorted, 0.99))
+            << std::setw(11) << formatSeconds(s.total.cpuSeconds) << std::setw(10) << s.total.entries
+            << std::setw(10) << formatBytes(s.total.bytesRead) << std::setw(10) << formatBytes(s.total.bytesWritten)
+            << std::setw(10) << s.total.syscalls << "\n";
+        selected.insert(selected.end(), s.wall.begin(), s.wall.end());
+    }
+
+    std::size_t counts[BUCKETS] = {};
+    for (double w : selected) {
+        std::size_t b = 0;
+        while (b < BUCKETS - 1 && w >= BUCKET_LIMITS[b]) ++b;
+        ++counts[b];
+    }
+    std::size_t peak = *std::max_element(counts, counts + BUCKETS);
+
+    out << "\nLatency histogram (" << (command.empty() ? "all commands" : command) << ", "
+        << selected.size() << " runs):\n";
+    for (std::size_t b = 0; b < BUCKETS; ++b) {
+        std::size_t bar = peak ? (counts[b] * BAR_WIDTH + peak - 1) / peak : 0;
+        out << "  " << std::left << std::setw(9) << BUCKET_LABELS[b] << "|" << std::setw(BAR_WIDTH)
+            << std::string(bar, '#') << std::right << " " << counts[b] << "\n";
+    }
+}
+
+void CommandStats::printSample(std::ostream &out, const std::string &command, const CommandSample &sample) {
+    out << "[" << command << "] " << formatSeconds(sample.wallSeconds) << " wall, "
+        << formatSeconds(sample.cpuSeconds) << " cpu, " << sample.entries << " entries, "
+        << formatBytes(sample.bytesRead) << " read, " << formatBytes(sample.bytesWritten) << " written, "
+        << sample.syscalls << " syscalls\n";
+}
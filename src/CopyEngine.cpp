@@ -0,0 +1,195 @@
+#include "CopyEngine.h"
+#include "IoStats.h"
+#include "JobContext.h"
+#include "Trace.h"
+
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <memory>
+
+namespace {
+
+const std::size_t CHUNK = 64ULL * 1024 * 1024; // per copy_file_range/sendfile call
+const std::size_t RW_BUFFER = 1024 * 1024;
+
+// Errors meaning "this mechanism is not available here", as opposed to I/O errors.
+bool unsupported(int err) {
+    return err == EXDEV || err == ENOSYS || err == EOPNOTSUPP || err == EINVAL ||
+           err == ENOTSUP || err == EBADF || err == ETXTBSY || err == EPERM;
+}
+
+// In-kernel copies count as read and written too: the bytes still pass
+// through the page cache, just not through user space.
+void countTransfer(std::uint64_t n) {
+    ioCount(&IoCounters::bytesRead, n);
+    ioCount(&IoCounters::bytesWritten, n);
+    JobContext::addBytes(n);
+}
+
+// Checked between chunks; a cancelled copy fails with ECANCELED.
+bool stopped() {
+    if (!JobContext::stopRequested()) return false;
+    errno = ECANCELED;
+    return true;
+}
+
+// Each copier continues from `off` and returns false only on a hard I/O
+// error; `fallback` is set when the mechanism is unsupported.
+bool viaCopyFileRange(int in, int out, std::uint64_t &off, bool &fallback) {
+    for (;;) {
+        if (stopped()) return false;
+        loff_t inOff = static_cast<loff_t>(off), outOff = static_cast<loff_t>(off);
+        ssize_t n = ::copy_file_range(in, &inOff, out, &outOff, CHUNK, 0);
+        ioCount(&IoCounters::dataCalls);
+        if (n > 0) {
+            countTransfer(static_cast<std::uint64_t>(n));
+            off += static_cast<std::uint64_t>(n);
+            continue;
+        }
+        if (n == 0) return true;
+        if (errno == EINTR) continue;
+        fallback = unsupported(errno);
+        return false;
+    }
+}
+
+bool viaSendfile(int in, int out, std::uint64_t &off, bool &fallback) {
+    if (::lseek(out, static_cast<off_t>(off), SEEK_SET) < 0) {
+        fallback = true;
+        return false;
+    }
+    for (;;) {
+        if (stopped()) return false;
+        off_t inOff = static_cast<off_t>(off);
+        ssize_t n = ::sendfile(out, in, &inOff, CHUNK);
+        ioCount(&IoCounters::dataCalls);
+        if (n > 0) {
+            countTransfer(static_cast<std::uint64_t>(n));
+            off += static_cast<std::uint64_t>(n);
+            continue;
+        }
+        if (n == 0) return true;
+        if (errno == EINTR) continue;
+        fallback = unsupported(errno);
+        return false;
+    }
+}
+
+bool viaReadWrite(int in, int out, std::uint64_t &off) {
+    std::unique_ptr<char[]> buf(new char[RW_BUFFER]);
+    for (;;) {
+        if (stopped()) return false;
+        ssize_t n = ::pread(in, buf.get(), RW_BUFFER, static_cast<off_t>(off));
+        ioCount(&IoCounters::dataCalls);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) return true;
+        ssize_t done = 0;
+        while (done < n) {
+            ssize_t w = ::pwrite(out, buf.get() + done, static_cast<std::size_t>(n - done),
+                                 static_cast<off_t>(off) + done);
+            ioCount(&IoCounters::dataCalls);
+            if (w < 0 && errno == EINTR) continue;
+            if (w <= 0) return false;
+            done += w;
+        }
+        countTransfer(static_cast<std::uint64_t>(n));
+        off += static_cast<std::uint64_t>(n);
+    }
+}
+
+} // namespace
+
+const char *copyMethodName(CopyMethod method) {
+    switch (method) {
+    case CopyMethod::Reflink: return "reflink";
+    case CopyMethod::CopyFileRange: return "copy_file_range";
+    case CopyMethod::Sendfile: return "sendfile";
+    case CopyMethod::ReadWrite: return "read/write";
+    default: return "none";
+    }
+}
+
+bool CopyEngine::copyData(int srcFd, int dstFd, std::uint64_t sizeHint, CopyReport &report) {
+    auto t0 = std::chrono::steady_clock::now();
+    auto finish = [&](CopyMethod method, std::uint64_t bytes) {
+        report.method = method;
+        report.bytes = bytes;
+        report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        return true;
+    };
+    // fallocate sized dst from the hint; a source that shrank meanwhile
+    // would leave it padded with zeroes past what was actually copied
+    auto trimmed = [&](std::uint64_t copied) {
+        return copied >= sizeHint || ::ftruncate(dstFd, static_cast<off_t>(copied)) == 0;
+    };
+
+    ioCount(&IoCounters::dataCalls);
+    if (::ioctl(dstFd, FICLONE, srcFd) == 0) {
+        // the clone is exact whatever the size is now
+        struct stat st{};
+        return finish(CopyMethod::Reflink, ::fstat(dstFd, &st) == 0 ? static_cast<std::uint64_t>(st.st_size) : sizeHint);
+    }
+
+    // reserve the extents up front: less fragmentation, early ENOSPC
+    if (sizeHint > 0) ::fallocate(dstFd, 0, 0, static_cast<off_t>(sizeHint));
+    ::posix_fadvise(srcFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    std::uint64_t off = 0;
+    bool fallback = false;
+    // Pseudo-files report size 0 and return nothing to in-kernel copies, so
+    // an in-kernel path that made no progress falls through as well.
+    if (sizeHint > 0) {
+        bool ok = viaCopyFileRange(srcFd, dstFd, off, fallback);
+        if (ok && off > 0) return trimmed(off) && finish(CopyMethod::CopyFileRange, off);
+        if (!ok && !fallback) return false;
+
+        fallback = false;
+        ok = viaSendfile(srcFd, dstFd, off, fallback);
+        if (ok && off > 0) return trimmed(off) && finish(CopyMethod::Sendfile, off);
+        if (!ok && !fallback) return false;
+    }
+
+    if (!viaReadWrite(srcFd, dstFd, off)) return false;
+    return trimmed(off) && finish(CopyMethod::ReadWrite, off);
+}
+
+bool CopyEngine::copyFile(const std::string &src, const std::string &dst, bool overwrite, CopyReport &report) {
+    TraceSpan span("copy");
+    int in = ::open(src.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) return false;
+
+    struct stat st{};
+    if (::fstat(in, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(in);
+        return false;
+    }
+
+    // never truncate the source through another name for it
+    struct stat dstSt{};
+    if (::stat(dst.c_str(), &dstSt) == 0 && dstSt.st_dev == st.st_dev && dstSt.st_ino == st.st_ino) {
+        ::close(in);
+        return false;
+    }
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | (overwrite ? 0 : O_EXCL);
+    int out = ::open(dst.c_str(), flags, st.st_mode & 07777);
+    if (out < 0) {
+        ::close(in);
+        return false;
+    }
+    ::fchmod(out, st.st_mode & 07777);
+
+    bool ok = copyData(in, out, static_cast<std::uint64_t>(st.st_size), report);
+    ok = (::close(out) == 0) && ok;
+    ::close(in);
+    if (!ok) ::unlink(dst.c_str());
+    return ok;
+}
@@ -0,0 +1,251 @@
+#include "DirSizeCache.h"
+#include "Utils.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <unistd.h>
+
+namespace {
+
+const char MAGIC[8] = {'M', 'F', 'E', 'D', 'S', 'C', '1', '\0'};
+
+struct Record
+{
+    std::uint64_t dev;
+    std::uint64_t ino;
+    std::int64_t mtimeNs;
+    std::int64_t ctimeNs;
+    std::uint64_t apparent;
+    std::uint64_t allocated;
+    std::uint64_t files;
+    std::uint64_t subdirs;
+    std::uint64_t links;
+};
+
+std::atomic<bool> enabledFlag{[] {
+    const char *env = std::getenv("MFE_DIR_CACHE");
+    return env && *env && std::strcmp(env, "0") != 0;
+}()};
+
+// Rough heap footprint of an entry, for MAX_BYTES.
+std::size_t footprint(const DirSizeEntry &e) {
+    std::size_t bytes = sizeof(DirSizeEntry) + 96; // node, key, slot, control block
+    for (const std::string &name : e.subdirs) bytes += sizeof(std::string) + name.size();
+    return bytes + e.links.size() * sizeof(LinkedFile);
+}
+
+template <typename T>
+bool readRaw(const char *&p, const char *end, T &out) {
+    if (static_cast<std::size_t>(end - p) < sizeof(T)) return false;
+    std::memcpy(&out, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+}
+
+} // namespace
+
+std::size_t DirSizeCache::KeyHash::operator()(const Key &k) const {
+    return std::hash<std::uint64_t>()(k.ino * 0x9E3779B97F4A7C15ULL ^ k.dev);
+}
+
+DirSizeCache::DirSizeCache() : path_(cacheDir() + "/dirsize.cache") {}
+
+DirSizeCache &DirSizeCache::instance() {
+    static DirSizeCache cache;
+    return cache;
+}
+
+void DirSizeCache::setEnabled(bool enabled) {
+    enabledFlag.store(enabled, std::memory_order_relaxed);
+}
+
+bool DirSizeCache::enabled() {
+    return enabledFlag.load(std::memory_order_relaxed);
+}
+
+void DirSizeCache::load() {
+    FILE *f = std::fopen(path_.c_str(), "rb");
+    if (!f) return;
+
+    std::string data;
+    char buf[1 << 16];
+    std::size_t n;
+    while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0) data.append(buf, n);
+    std::fclose(f);
+
+    const char *p = data.data();
+    const char *end = p + data.size();
+    if (data.size() < sizeof(MAGIC) || std::memcmp(p, MAGIC, sizeof(MAGIC)) != 0) return;
+    p += sizeof(MAGIC);
+
+    std::uint64_t count = 0;
+    if (!readRaw(p, end, count)) return;
+
+    for (std::uint64_t i = 0; i < count; ++i) {
+        Record r;
+        if (!readRaw(p, end, r)) break;
+        if (r.subdirs > static_cast<std::size_t>(end - p) / sizeof(std::uint16_t) ||
+            r.links > static_cast<std::size_t>(end - p) / sizeof(LinkedFile))
+            break;
+
+        DirSizeEntry e;
+        e.mtimeNs = r.mtimeNs;
+        e.ctimeNs = r.ctimeNs;
+        e.apparent = r.apparent;
+        e.allocated = r.allocated;
+        e.files = r.files;
+        e.subdirs.reserve(r.subdirs);
+        bool ok = true;
+        for (std::uint64_t j = 0; j < r.subdirs && ok; ++j) {
+            std::uint16_t len = 0;
+            ok = readRaw(p, end, len) && static_cast<std::size_t>(end - p) >= len;
+            if (ok) {
+                e.subdirs.emplace_back(p, len);
+                p += len;
+            }
+        }
+        e.links.resize(r.links);
+        for (std::uint64_t j = 0; j < r.links && ok; ++j) ok = readRaw(p, end, e.links[j]);
+        if (!ok) break;
+        Key key{r.dev, r.ino};
+        Shard &s = shard(key);
+        std::lock_guard<std::mutex> lk(s.m);
+        insert(s, key, std::move(e));
+    }
+}
+
+void DirSizeCache::insert(Shard &s, const Key &key, DirSizeEntry entry) {
+    Slot &slot = s.map[key];
+    s.bytes -= slot.bytes;
+    slot.bytes = footprint(entry);
+    slot.entry = std::make_shared<const DirSizeEntry>(std::move(entry));
+    slot.lastUse = clock_.fetch_add(1, std::memory_order_relaxed);
+    s.bytes += slot.bytes;
+    if (s.bytes > MAX_BYTES / SHARDS) evict(s);
+}
+
+void DirSizeCache::evict(Shard &s) {
+    // down to three quarters of the shard's share at once, so eviction is
+    // paid for once per many stores rather than on every one
+    std::vector<std::pair<std::uint64_t, Key>> byAge;
+    byAge.reserve(s.map.size());
+    for (const auto &kv : s.map) byAge.emplace_back(kv.second.lastUse, kv.first);
+    std::sort(byAge.begin(), byAge.end(),
+              [](const std::pair<std::uint64_t, Key> &a, const std::pair<std::uint64_t, Key> &b) {
+                  return a.first < b.first;
+              });
+    for (const auto &old : byAge) {
+        if (s.bytes <= MAX_BYTES / SHARDS / 4 * 3) break;
+        auto it = s.map.find(old.second);
+        s.bytes -= it->second.bytes;
+        s.map.erase(it);
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+        dirty_.store(true, std::memory_order_relaxed);
+    }
+}
+
+std::shared_ptr<const DirSizeEntry> DirSizeCache::lookup(std::uint64_t dev, std::uint64_t ino, std::int64_t mtimeNs,
+                                                         std::int64_t ctimeNs) {
+    ensureLoaded();
+    Key key{dev, ino};
+    Shard &s = shard(key);
+    std::shared_ptr<const DirSizeEntry> hit;
+    {
+        std::lock_guard<std::mutex> lk(s.m);
+        auto it = s.map.find(key);
+        if (it != s.map.end() && it->second.entry->mtimeNs == mtimeNs && it->second.entry->ctimeNs == ctimeNs) {
+            it->second.lastUse = clock_.fetch_add(1, std::memory_order_relaxed);
+            hit = it->second.entry;
+        }
+    }
+    (hit ? hits_ : misses_).fetch_add(1, std::memory_order_relaxed);
+    return hit;
+}
+
+void DirSizeCache::store(std::uint64_t dev, std::uint64_t ino, DirSizeEntry entry) {
+    ensureLoaded();
+    Key key{dev, ino};
+    Shard &s = shard(key);
+    {
+        std::lock_guard<std::mutex> lk(s.m);
+        insert(s, key, std::move(entry));
+    }
+    stores_.fetch_add(1, std::memory_order_relaxed);
+    dirty_.store(true, std::memory_order_relaxed);
+}
+
+bool DirSizeCache::save() {
+    std::lock_guard<std::mutex> fileLock(fileM_);
+    if (!dirty_.exchange(false)) return true;
+
+    // write to a temp file and rename so a crash never leaves a torn cache
+    std::string tmp = path_ + ".tmp" + std::to_string(::getpid());
+    FILE *f = std::fopen(tmp.c_str(), "wb");
+    if (!f) {
+        dirty_.store(true);
+        return false;
+    }
+
+    std::vector<char> buf(1 << 20);
+    std::setvbuf(f, buf.data(), _IOFBF, buf.size());
+
+    // the count is patched once every shard has been written
+    std::uint64_t count = 0;
+    bool ok = std::fwrite(MAGIC, sizeof(MAGIC), 1, f) == 1 && std::fwrite(&count, sizeof(count), 1, f) == 1;
+    for (Shard &s : shards_) {
+        std::lock_guard<std::mutex> lk(s.m);
+        for (auto it = s.map.begin(); ok && it != s.map.end(); ++it) {
+            const DirSizeEntry &e = *it->second.entry;
+            Record r{it->first.dev, it->first.ino, e.mtimeNs, e.ctimeNs,
+                     e.apparent, e.allocated, e.files, e.subdirs.size(), e.links.size()};
+            ok = std::fwrite(&r, sizeof(r), 1, f) == 1;
+            for (const std::string &name : e.subdirs) {
+                std::uint16_t len = static_cast<std::uint16_t>(name.size());
+                ok = ok && std::fwrite(&len, sizeof(len), 1, f) == 1 && std::fwrite(name.data(), 1, len, f) == len;
+            }
+            if (!e.links.empty())
+                ok = ok && std::fwrite(e.links.data(), sizeof(LinkedFile), e.links.size(), f) == e.links.size();
+            ++count;
+        }
+    }
+    ok = ok && std::fseek(f, sizeof(MAGIC), SEEK_SET) == 0 && std::fwrite(&count, sizeof(count), 1, f) == 1;
+    ok = (std::fclose(f) == 0) && ok;
+
+    if (!ok || std::rename(tmp.c_str(), path_.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        dirty_.store(true);
+        return false;
+    }
+    return true;
+}
+
+void DirSizeCache::clear() {
+    ensureLoaded(); // so a later load cannot bring the entries back
+    for (Shard &s : shards_) {
+        std::lock_guard<std::mutex> lk(s.m);
+        s.map.clear();
+        s.bytes = 0;
+    }
+    hits_ = misses_ = stores_ = evictions_ = 0;
+    dirty_ = false;
+    std::remove(path_.c_str());
+}
+
+DirSizeCache::Stats DirSizeCache::stats() {
+    ensureLoaded();
+    Stats st;
+    st.hits = hits_.load();
+    st.misses = misses_.load();
+    st.stores = stores_.load();
+    st.evictions = evictions_.load();
+    st.path = path_;
+    for (Shard &s : shards_) {
+        std::lock_guard<std::mutex> lk(s.m);
+        st.entries += s.map.size();
+        st.bytes += s.bytes;
+    }
+    return st;
+}
@@ -0,0 +1,46 @@
+#include "DirSnapshot.h"
+#include "FileSystem.h"
+#include "Utils.h"
+
+void DirSnapshot::reserve(std::size_t entries, std::size_t nameBytes) {
+    names_.reserve(nameBytes);
+    nameOff_.reserve(entries + 1);
+    isDir_.reserve(entries);
+    type_.reserve(entries);
+    size_.reserve(entries);
+    mtime_.reserve(entries);
+}
+
+void DirSnapshot::clear() {
+    names_.clear();
+    nameOff_.assign(1, 0);
+    isDir_.clear();
+    type_.clear();
+    size_.clear();
+    mtime_.clear();
+}
+
+void DirSnapshot::add(const char *name, std::size_t len, bool isDir, unsigned char type, std::int64_t size,
+                      std::int64_t mtimeNs) {
+    names_.insert(names_.end(), name, name + len);
+    names_.push_back('\0');
+    nameOff_.push_back(static_cast<std::uint32_t>(names_.size()));
+    isDir_.push_back(isDir ? 1 : 0);
+    type_.push_back(type);
+    size_.push_back(size);
+    mtime_.push_back(mtimeNs);
+}
+
+std::string DirSnapshot::mtimeString(std::size_t i) const {
+    return formatTime(mtime_[i]);
+}
+
+FileInfo DirSnapshot::info(std::size_t i) const {
+    FileInfo f;
+    f.name.assign(name(i));
+    f.isDir = isDir(i);
+    f.size = fileSize(i);
+    f.mtime = mtimeString(i);
+    f.mtimeNs = mtimeNs(i);
+    return f;
+}
@@ -0,0 +1,262 @@
+#include "DirWatch.h"
+#include "Trace.h"
+#include "TreeWalk.h"
+
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+
+namespace {
+
+const std::uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO |
+                                 IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_EXCL_UNLINK;
+
+const std::size_t READ_BUFFER = 64 * 1024;
+
+std::string join(const std::string &dir, const std::string &name) {
+    if (name.empty()) return dir;
+    return dir == "/" ? "/" + name : dir + "/" + name;
+}
+
+// Adds a watch on every directory of a tree; optionally records every
+// entry met, for directories that appeared before their watch did.
+class WatchVisitor : public TreeVisitor
+{
+public:
+    WatchVisitor(const std::string &root, const std::function<void(const std::string &)> &addDir,
+                 const std::function<void(const std::string &, const char *, bool)> *onEntry)
+        : root_(root), addDir_(addDir), onEntry_(onEntry) {}
+
+    bool enterDir(TreeWalk &, WalkDir &dir) override {
+        addDir_(join(root_, dir.path));
+        return true;
+    }
+
+    bool visit(TreeWalk &, WalkDir &dir, const DirEntry &entry, unsigned char type) override {
+        if (onEntry_) (*onEntry_)(join(root_, dir.path), entry.name, type == DT_DIR);
+        return type == DT_DIR;
+    }
+
+private:
+    std::string root_;
+    const std::function<void(const std::string &)> &addDir_;
+    const std::function<void(const std::string &, const char *, bool)> *onEntry_;
+};
+
+} // namespace
+
+DirWatch::DirWatch() : fd_(::inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) {}
+
+DirWatch::~DirWatch() {
+    if (fd_ >= 0) ::close(fd_);
+}
+
+bool DirWatch::addOne(const std::string &path, bool recursive, bool root) {
+    int wd = ::inotify_add_watch(fd_, path.c_str(), WATCH_MASK);
+    std::lock_guard<std::mutex> lock(m_);
+    if (wd < 0) {
+        ++failed_;
+        return false;
+    }
+    auto it = dirs_.find(wd);
+    if (it != dirs_.end()) {
+        // the same directory under another name: keep the newest
+        wds_.erase(it->second.path);
+        root = root || it->second.root;
+    }
+    dirs_[wd] = {path, recursive, root};
+    wds_[path] = wd;
+    return true;
+}
+
+void DirWatch::addTree(const std::string &path, bool root, std::vector<Raw> *found) {
+    TraceSpan span("watch tree");
+    std::mutex foundM;
+    std::function<void(const std::string &)> addDir = [&](const std::string &dir) {
+        addOne(dir, true, root && dir == path);
+    };
+    std::function<void(const std::string &, const char *, bool)> onEntry =
+        [&](const std::string &dir, const char *name, bool isDir) {
+            std::lock_guard<std::mutex> lock(foundM);
+            found->push_back({IN_CREATE | (isDir ? IN_ISDIR : 0u), 0, dir, name});
+        };
+    WatchVisitor visitor(path, addDir, found ? &onEntry : nullptr);
+    TreeWalk walk(visitor);
+    walk.run(path);
+}
+
+bool DirWatch::add(const std::string &path, bool recursive) {
+    if (fd_ < 0) return false;
+    if (!recursive) return addOne(path, false, true);
+    addTree(path, true, nullptr);
+    std::lock_guard<std::mutex> lock(m_);
+    return wds_.count(path) != 0;
+}
+
+void DirWatch::remove(const std::string &path) {
+    std::lock_guard<std::mutex> lock(m_);
+    auto it = wds_.find(path);
+    if (it == wds_.end()) return;
+    ::inotify_rm_watch(fd_, it->second);
+    dirs_.erase(it->second);
+    wds_.erase(it);
+}
+
+std::size_t DirWatch::watches() const {
+    std::lock_guard<std::mutex> lock(m_);
+    return dirs_.size();
+}
+
+void DirWatch::drain(std::vector<Raw> &raw) {
+    alignas(struct inotify_event) char buffer[READ_BUFFER];
+    std::vector<std::string> newDirs;
+    for (;;) {
+        ssize_t n = ::read(fd_, buffer, sizeof(buffer));
+        if (n <= 0) break; // EAGAIN: the queue is empty
+
+        std::lock_guard<std::mutex> lock(m_);
+        for (char *p = buffer; p < buffer + n;) {
+            auto *ev = reinterpret_cast<struct inotify_event *>(p);
+            p += sizeof(struct inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                raw.push_back({ev->mask, 0, std::string(), std::string()});
+                continue;
+            }
+            auto it = dirs_.find(ev->wd);
+            if (it == dirs_.end()) continue; // removed, or its IN_IGNORED already seen
+            const Watched &w = it->second;
+            if (ev->mask & IN_IGNORED) {
+                wds_.erase(w.path);
+                dirs_.erase(it);
+                continue;
+            }
+            // below a recursive root, a directory going away is already reported by its parent
+            if ((ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) && !w.root) continue;
+
+            std::string name = ev->len ? std::string(ev->name) : std::string();
+            if (w.recursive && (ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO)))
+                newDirs.push_back(join(w.path, name));
+            raw.push_back({ev->mask, ev->cookie, w.path, std::move(name)});
+        }
+    }
+    // new directories may have been filled before their watch existed
+    for (const std::string &dir : newDirs) addTree(dir, false, &raw);
+}
+
+bool DirWatch::read(std::vector<WatchEvent> &batch, int timeoutMs) {
+    batch.clear();
+    if (fd_ < 0) return false;
+    struct pollfd p = {fd_, POLLIN, 0};
+    if (::poll(&p, 1, timeoutMs) <= 0) return false;
+
+    std::vector<Raw> raw;
+    drain(raw);
+    if (timeoutMs != 0) {
+        // keep reading while the burst goes on
+        auto start = std::chrono::steady_clock::now();
+        for (;;) {
+            int elapsed = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                               std::chrono::steady_clock::now() - start).count());
+            int wait = std::min(COALESCE_MS, MAX_BATCH_MS - elapsed);
+            if (wait <= 0 || ::poll(&p, 1, wait) <= 0) break;
+            drain(raw);
+        }
+    }
+    raw_ += raw.size();
+    coalesce(raw, batch);
+    return !batch.empty();
+}
+
+void DirWatch::coalesce(const std::vector<Raw> &raw, std::vector<WatchEvent> &batch) {
+    // MOVED_FROM index by cookie, to pair with the MOVED_TO that follows it
+    std::unordered_map<std::uint32_t, std::size_t> movedFrom;
+    std::unordered_map<std::string, std::size_t> latest; // dir/name -> index in `events`
+    std::vector<WatchEvent> events;
+    std::vector<bool> live;
+
+    auto key = [](const std::string &dir, const std::string &name) { return dir + '\0' + name; };
+    auto drop = [&](const std::string &k) {
+        auto it = latest.find(k);
+        if (it == latest.end()) return;
+        live[it->second] = false;
+        latest.erase(it);
+    };
+    auto emit = [&](WatchEvent ev) {
+        std::string k = key(ev.dir, ev.name);
+        drop(k);
+        latest[k] = events.size();
+        events.push_back(std::move(ev));
+        live.push_back(true);
+    };
+    auto pending = [&](const std::string &k) -> WatchEvent * {
+        auto it = latest.find(k);
+        return it == latest.end() ? nullptr : &events[it->second];
+    };
+
+    for (std::size_t i = 0; i < raw.size(); ++i) {
+        const Raw &r = raw[i];
+        WatchEvent ev{WatchEvent::Modified, (r.mask & IN_ISDIR) != 0, r.dir, r.name, std::string(), std::string()};
+        std::string k = key(r.dir, r.name);
+        WatchEvent *prev = pending(k);
+
+        if (r.mask & IN_Q_OVERFLOW) {
+            ev.kind = WatchEvent::Overflow;
+            events.push_back(ev);
+            live.push_back(true);
+        } else if (r.mask & (IN_CREATE | IN_MOVED_TO)) {
+            auto from = (r.mask & IN_MOVED_TO) ? movedFrom.find(r.cookie) : movedFrom.end();
+            if (from != movedFrom.end()) {
+                const Raw &f = raw[from->second];
+                movedFrom.erase(from);
+                std::string fk = key(f.dir, f.name);
+                WatchEvent *before = pending(fk);
+                if (before && before->kind == WatchEvent::Created) {
+                    // created and renamed within the burst: it is simply new here
+                    ev.kind = WatchEvent::Created;
+                } else {
+                    ev.kind = WatchEvent::Moved;
+                    ev.fromDir = f.dir;
+                    ev.fromName = f.name;
+                }
+                drop(fk);
+            } else {
+                // replacing an entry deleted in the same burst reads as a modification
+                ev.kind = prev && prev->kind == WatchEvent::Deleted ? WatchEvent::Modified : WatchEvent::Created;
+            }
+            emit(std::move(ev));
+        } else if (r.mask & (IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF)) {
+            if (prev && prev->kind == WatchEvent::Created) {
+                drop(k); // came and went
+                continue;
+            }
+            ev.kind = WatchEvent::Deleted;
+            emit(std::move(ev));
+        } else if (r.mask & IN_MOVED_FROM) {
+            // a delete unless a MOVED_TO with the same cookie follows
+            movedFrom[r.cookie] = i;
+            if (prev && prev->kind == WatchEvent::Created) {
+                continue; // resolved when the pair is found, or below
+            }
+            ev.kind = WatchEvent::Deleted;
+            emit(std::move(ev));
+        } else if (r.mask & (IN_MODIFY | IN_ATTRIB)) {
+            if (prev) continue; // created, modified or moved here already says it changed
+            emit(std::move(ev));
+        }
+    }
+    // moved out of every watched directory
+    for (const auto &kv : movedFrom) {
+        const Raw &f = raw[kv.second];
+        WatchEvent *prev = pending(key(f.dir, f.name));
+        if (prev && prev->kind == WatchEvent::Created) drop(key(f.dir, f.name));
+    }
+
+    batch.clear();
+    for (std::size_t i = 0; i < events.size(); ++i)
+        if (live[i]) batch.push_back(std::move(events[i]));
+}
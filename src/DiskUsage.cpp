@@ -0,0 +1,227 @@
+#include "DiskUsage.h"
+#include "DirSizeCache.h"
+#include "StatBatch.h"
+#include "Trace.h"
+#include "TreeWalk.h"
+
+#include <dirent.h>
+
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <unordered_set>
+
+namespace {
+
+struct InodeKey
+{
+    std::uint64_t dev;
+    std::uint64_t ino;
+    bool operator==(const InodeKey &o) const { return dev == o.dev && ino == o.ino; }
+};
+
+struct InodeHash
+{
+    std::size_t operator()(const InodeKey &k) const {
+        return std::hash<std::uint64_t>()(k.ino * 0x9E3779B97F4A7C15ULL ^ k.dev);
+    }
+};
+
+// (dev, ino) of multiply-linked files already counted, sharded to keep
+// workers from serialising on one lock.
+class SeenInodes
+{
+public:
+    bool insert(const InodeKey &key) {
+        Shard &s = shards_[InodeHash()(key) % SHARDS];
+        std::lock_guard<std::mutex> lk(s.m);
+        return s.set.insert(key).second;
+    }
+
+private:
+    static const std::size_t SHARDS = 64;
+    struct Shard
+    {
+        std::mutex m;
+        std::unordered_set<InodeKey, InodeHash> set;
+    };
+    Shard shards_[SHARDS];
+};
+
+struct DuDir : WalkDir
+{
+    bool cacheable = false;
+    std::uint64_t dev = 0;
+    std::uint64_t ino = 0;
+    DirSizeEntry own; // this directory's direct contribution, stored in the cache
+    std::unique_ptr<StatBatch> batch; // entries waiting for the batched stat backend
+};
+
+// Directories modified within this window may change again inside the same
+// timestamp tick, so they are not cached.
+const std::int64_t RACY_WINDOW_NS = 2000000000LL;
+
+// Entries queued per StatBatch before it is flushed, bounding memory on huge directories.
+const std::size_t BATCH_FLUSH = 4096;
+
+const unsigned FILE_FIELDS = STAT_TYPE | STAT_SIZE | STAT_BLOCKS | STAT_INO;
+
+class DuVisitor : public TreeVisitor
+{
+public:
+    DuVisitor(bool useCache, const DiskUsage::FileCallback *onFile, const DiskUsage::DirCallback *onDir)
+        : useCache_(useCache && DirSizeCache::enabled()), batched_(statBackend() == StatBackend::Uring), cache_(nullptr), onFile_(onFile),
+          onDir_(onDir) {
+        if (useCache_) cache_ = &DirSizeCache::instance();
+        now_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    std::shared_ptr<WalkDir> makeDir() override { return std::make_shared<DuDir>(); }
+
+    bool enterDir(TreeWalk &walk, WalkDir &base) override {
+        if (!useCache_) return true;
+        auto &dir = static_cast<DuDir &>(base);
+
+        StatInfo self;
+        if (!statAt(dir.fd, "", STAT_INO | STAT_MTIME | STAT_CTIME, self)) return true;
+
+        if (std::shared_ptr<const DirSizeEntry> hit = cache_->lookup(self.dev, self.ino, self.mtimeNs, self.ctimeNs)) {
+            std::uint64_t files = hit->files, apparent = hit->apparent, allocated = hit->allocated;
+            for (const LinkedFile &link : hit->links) {
+                if (!seen_.insert({self.dev, link.ino})) continue;
+                files += 1;
+                apparent += link.apparent;
+                allocated += link.allocated;
+            }
+            files_.fetch_add(files, std::memory_order_relaxed);
+            dirs_.fetch_add(hit->subdirs.size(), std::memory_order_relaxed);
+            dir.sum[0].fetch_add(apparent, std::memory_order_relaxed);
+            dir.sum[1].fetch_add(allocated, std::memory_order_relaxed);
+            auto shared = dir.shared_from_this();
+            for (const std::string &name : hit->subdirs) walk.descend(shared, name);
+            return false;
+        }
+
+        dir.cacheable = now_ - self.mtimeNs > RACY_WINDOW_NS && now_ - self.ctimeNs > RACY_WINDOW_NS;
+        dir.dev = self.dev;
+        dir.ino = self.ino;
+        dir.own.mtimeNs = self.mtimeNs;
+        dir.own.ctimeNs = self.ctimeNs;
+        return true;
+    }
+
+    bool visit(TreeWalk &, WalkDir &base, const DirEntry &entry, unsigned char type) override {
+        auto &dir = static_cast<DuDir &>(base);
+        if (type == DT_DIR) {
+            dirs_.fetch_add(1, std::memory_order_relaxed);
+            if (dir.cacheable) dir.own.subdirs.emplace_back(entry.name, entry.nameLen);
+            return true;
+        }
+
+        if (batched_) {
+            if (!dir.batch) dir.batch.reset(new StatBatch(dir.fd, FILE_FIELDS, false));
+            dir.batch->add(entry.name, entry.nameLen);
+            if (dir.batch->size() >= BATCH_FLUSH) flush(dir);
+            return false;
+        }
+
+        StatInfo st;
+        bool ok = statAt(dir.fd, entry.name, FILE_FIELDS, st, false);
+        account(dir, entry.name, ok, st);
+        return false;
+    }
+
+    void entriesDone(TreeWalk &, WalkDir &base) override {
+        auto &dir = static_cast<DuDir &>(base);
+        if (dir.batch) {
+            flush(dir);
+            dir.batch.reset();
+        }
+    }
+
+    void leaveDir(TreeWalk &, WalkDir &base) override {
+        auto &dir = static_cast<DuDir &>(base);
+        // a listing cut short by a read error is never stored
+        if (dir.cacheable && !dir.incomplete) cache_->store(dir.dev, dir.ino, std::move(dir.own));
+        if (onDir_) (*onDir_)(dir);
+    }
+
+    std::atomic<std::uint64_t> files_{0};
+    std::atomic<std::uint64_t> dirs_{0};
+    std::atomic<std::uint64_t> errors_{0};
+
+private:
+    void flush(DuDir &dir) {
+        dir.batch->run();
+        for (std::size_t i = 0; i < dir.batch->size(); ++i) account(dir, dir.batch->name(i), dir.batch->ok(i), dir.batch->info(i));
+        dir.batch->clear();
+    }
+
+    // Adds one non-directory entry's stat result to the directory's totals.
+    void account(DuDir &dir, const char *name, bool ok, const StatInfo &st) {
+        if (!ok) {
+            errors_.fetch_add(1, std::memory_order_relaxed);
+            dir.cacheable = false;
+            return;
+        }
+        if (st.type != DT_REG) return;
+        if (onFile_) (*onFile_)(dir, name, st);
+
+        std::uint64_t apparent = static_cast<std::uint64_t>(st.size);
+        std::uint64_t allocated = st.blocks * 512ULL;
+        if (st.nlink > 1) {
+            if (dir.cacheable) dir.own.links.push_back({st.ino, apparent, allocated});
+            if (!seen_.insert({st.dev, st.ino})) return;
+        } else {
+            dir.own.apparent += apparent;
+            dir.own.allocated += allocated;
+            dir.own.files += 1;
+        }
+
+        files_.fetch_add(1, std::memory_order_relaxed);
+        dir.sum[0].fetch_add(apparent, std::memory_order_relaxed);
+        dir.sum[1].fetch_add(allocated, std::memory_order_relaxed);
+    }
+
+    bool useCache_;
+    bool batched_;
+    DirSizeCache *cache_;
+    const DiskUsage::FileCallback *onFile_;
+    const DiskUsage::DirCallback *onDir_;
+    std::int64_t now_;
+    SeenInodes seen_;
+};
+
+DuResult runScan(const std::string &path, bool useCache, const DiskUsage::FileCallback *onFile,
+                 const DiskUsage::DirCallback *onDir) {
+    DuResult result;
+    TraceSpan span("walk");
+    DuVisitor visitor(useCache, onFile, onDir);
+    TreeWalk walk(visitor);
+    if (!walk.run(path)) return result;
+
+    result.ok = true;
+    result.apparent = walk.root()->sum[0].load();
+    result.allocated = walk.root()->sum[1].load();
+    result.files = visitor.files_.load();
+    result.dirs = visitor.dirs_.load();
+    result.errors = visitor.errors_.load() + walk.errors();
+    if (Trace::enabled())
+        span.setArgs("\"dirs\":" + std::to_string(result.dirs) + ",\"files\":" + std::to_string(result.files));
+    return result;
+}
+
+} // namespace
+
+DuResult DiskUsage::scan(const std::string &path, bool useCache) {
+    return runScan(path, useCache, nullptr, nullptr);
+}
+
+DuResult DiskUsage::scan(const std::string &path, const FileCallback &onFile) {
+    return runScan(path, false, &onFile, nullptr);
+}
+
+DuResult DiskUsage::scan(const std::string &path, const FileCallback &onFile, const DirCallback &onDir) {
+    return runScan(path, false, &onFile, &onDir);
+}
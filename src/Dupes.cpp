@@ -0,0 +1,206 @@
+#include "Dupes.h"
+#include "DiskUsage.h"
+#include "Hash64.h"
+#include "IoStats.h"
+#include "JobContext.h"
+#include "Trace.h"
+#include "TreeWalk.h"
+#include "WorkPool.h"
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <tuple>
+
+namespace {
+
+// Files hashed per pool task.
+const std::size_t BATCH_FILES = 16;
+// Block size of the reads, into a per-thread buffer.
+const std::size_t READ_CHUNK = 1 << 20;
+
+struct Candidate
+{
+    std::uint64_t size;
+    std::uint64_t dev;
+    std::uint64_t ino;
+    std::string path;
+    std::uint64_t hash = 0; // prefix hash, then full hash
+    bool ok = true;         // false once the file could not be read
+};
+
+// Hashes the first `limit` bytes of `path` (all of it when limit is 0).
+bool hashFile(const std::string &path, std::uint64_t size, std::uint64_t limit, std::uint64_t &out,
+              std::uint64_t &bytes) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    ioCount(&IoCounters::opens);
+    if (fd < 0) return false;
+
+    std::uint64_t want = limit && limit < size ? limit : size;
+    Hash64 hash;
+    bool ok = true;
+    // pread, not mmap: a file truncated while it is hashed would raise SIGBUS
+    // and take the whole process (or the --serve daemon) down
+    if (want > Dupes::PREFIX_BYTES) ::posix_fadvise(fd, 0, static_cast<off_t>(want), POSIX_FADV_SEQUENTIAL);
+    thread_local std::vector<char> buffer(READ_CHUNK);
+    std::uint64_t done = 0;
+    while (done < want) {
+        std::size_t chunk = static_cast<std::size_t>(std::min<std::uint64_t>(READ_CHUNK, want - done));
+        ssize_t n = ::pread(fd, buffer.data(), chunk, static_cast<off_t>(done));
+        ioCount(&IoCounters::dataCalls);
+        if (n <= 0) {
+            ok = false; // error, or the file shrank since the walk
+            break;
+        }
+        hash.update(buffer.data(), static_cast<std::size_t>(n));
+        done += static_cast<std::uint64_t>(n);
+    }
+    ::close(fd);
+    ioCount(&IoCounters::closes);
+    if (!ok) return false;
+
+    ioCount(&IoCounters::bytesRead, want);
+    JobContext::addBytes(want);
+    bytes += want;
+    // the size is part of the identity: equal prefixes of different lengths must not collide
+    hash.update(&size, sizeof(size));
+    out = hash.digest();
+    return true;
+}
+
+// Hashes every candidate on the pool; `limit` as in hashFile.
+void hashAll(std::vector<Candidate *> &files, std::uint64_t limit, std::atomic<std::uint64_t> &bytes,
+             std::atomic<std::uint64_t> &errors) {
+    TaskGroup group;
+    for (std::size_t i = 0; i < files.size(); i += BATCH_FILES) {
+        std::size_t end = std::min(files.size(), i + BATCH_FILES);
+        group.run([&files, i, end, limit, &bytes, &errors] {
+            std::uint64_t read = 0, failed = 0;
+            for (std::size_t k = i; k < end; ++k) {
+                if (JobContext::stopRequested()) break;
+                Candidate &c = *files[k];
+                if (!hashFile(c.path, c.size, limit, c.hash, read)) {
+                    c.ok = false;
+                    ++failed;
+                }
+            }
+            bytes.fetch_add(read, std::memory_order_relaxed);
+            errors.fetch_add(failed, std::memory_order_relaxed);
+        });
+    }
+    group.wait();
+}
+
+// Keeps the readable candidates whose (size, hash) is shared with another,
+// in runs of equal keys.
+std::vector<Candidate *> keepShared(std::vector<Candidate *> &files) {
+    std::sort(files.begin(), files.end(), [](const Candidate *a, const Candidate *b) {
+        return std::tie(a->size, a->hash, a->path) < std::tie(b->size, b->hash, b->path);
+    });
+    std::vector<Candidate *> kept;
+    for (std::size_t i = 0; i < files.size();) {
+        std::size_t j = i + 1;
+        while (j < files.size() && files[j]->size == files[i]->size && files[j]->hash == files[i]->hash) ++j;
+        std::size_t readable = 0;
+        for (std::size_t k = i; k < j; ++k) readable += files[k]->ok;
+        if (readable > 1) {
+            for (std::size_t k = i; k < j; ++k)
+                if (files[k]->ok) kept.push_back(files[k]);
+        }
+        i = j;
+    }
+    return kept;
+}
+
+} // namespace
+
+DupesStats Dupes::find(const std::string &root, std::vector<DupeSet> &sets) {
+    TraceSpan span("dupes");
+    auto t0 = std::chrono::steady_clock::now();
+    DupesStats stats;
+
+    char resolved[PATH_MAX];
+    std::string base = ::realpath(root.c_str(), resolved) ? resolved : root;
+    if (base == "/") base.clear();
+
+    // 1. sizes and identities from the du walk
+    std::vector<Candidate> all;
+    std::mutex allM;
+    DuResult du = DiskUsage::scan(root, [&](const WalkDir &dir, const char *name, const StatInfo &st) {
+        if (st.size <= 0) return; // empty files are all equal and free nothing
+        std::string path = base + "/" + dir.childPath(name);
+        std::lock_guard<std::mutex> lock(allM);
+        all.push_back({static_cast<std::uint64_t>(st.size), st.dev, st.ino, std::move(path)});
+    });
+    if (!du.ok) return stats;
+    stats.ok = true;
+    stats.errors = du.errors;
+
+    // one entry per inode (the smallest path), then only sizes held by several inodes
+    std::sort(all.begin(), all.end(), [](const Candidate &a, const Candidate &b) {
+        return std::tie(a.size, a.dev, a.ino, a.path) < std::tie(b.size, b.dev, b.ino, b.path);
+    });
+    all.erase(std::unique(all.begin(), all.end(), [](const Candidate &a, const Candidate &b) {
+                  return a.dev == b.dev && a.ino == b.ino;
+              }), all.end());
+    stats.files = all.size();
+
+    std::vector<Candidate *> files;
+    for (std::size_t i = 0; i < all.size();) {
+        std::size_t j = i + 1;
+        while (j < all.size() && all[j].size == all[i].size) ++j;
+        if (j - i > 1)
+            for (std::size_t k = i; k < j; ++k) files.push_back(&all[k]);
+        i = j;
+    }
+    stats.sizeMatches = files.size();
+
+    std::atomic<std::uint64_t> bytes{0}, errors{0};
+    {
+        // 2. prefixes; for files no larger than the prefix this is already the full hash
+        TraceSpan prefix("hash prefix", "phase");
+        hashAll(files, PREFIX_BYTES, bytes, errors);
+        files = keepShared(files);
+    }
+    stats.prefixMatches = files.size();
+
+    {
+        // 3. full contents of the files the prefix could not separate
+        TraceSpan full("hash full", "phase");
+        std::vector<Candidate *> large;
+        for (Candidate *c : files)
+            if (c->size > PREFIX_BYTES) large.push_back(c);
+        hashAll(large, 0, bytes, errors);
+        files = keepShared(files);
+    }
+
+    stats.cancelled = JobContext::stopRequested();
+    if (!stats.cancelled) {
+        for (std::size_t i = 0; i < files.size();) {
+            DupeSet set;
+            set.size = files[i]->size;
+            std::size_t j = i;
+            for (; j < files.size() && files[j]->size == set.size && files[j]->hash == files[i]->hash; ++j)
+                set.paths.push_back(files[j]->path);
+            stats.duplicates += set.paths.size() - 1;
+            stats.reclaimable += set.reclaimable();
+            sets.push_back(std::move(set));
+            i = j;
+        }
+        std::stable_sort(sets.begin(), sets.end(), [](const DupeSet &a, const DupeSet &b) {
+            return a.reclaimable() > b.reclaimable();
+        });
+    }
+
+    stats.bytesHashed = bytes.load();
+    stats.errors += errors.load();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    span.setArgs("\"files\":" + std::to_string(stats.files) + ",\"hashed\":" + std::to_string(stats.bytesHashed));
+    return stats;
+}
@@ -0,0 +1,546 @@
+#include "FileIndex.h"
+#include "JobContext.h"
+#include "TextScan.h"
+#include "TreeWalk.h"
+#include "Utils.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// ---- on-disk layout (native endianness, every section 8-byte aligned) ----
+
+const char MAGIC[8] = {'M', 'F', 'E', 'I', 'D', 'X', '1', '\0'};
+const std::uint32_t NONE = 0xFFFFFFFFu;
+
+struct Header
+{
+    char magic[8];
+    std::uint64_t dirCount;
+    std::uint64_t entryCount;
+    std::uint64_t trigramCount;
+    std::uint64_t postingCount;
+    std::uint64_t dirsOff;
+    std::uint64_t entriesOff;
+    std::uint64_t trigramsOff;
+    std::uint64_t postingsOff;
+    std::uint64_t namesOff;
+    std::uint64_t namesSize;
+    std::uint64_t rootLen; // the root path is stored at the start of the name blob
+    std::int64_t builtAtNs;
+};
+
+// Children of a directory are stored contiguously: entries[firstChild, firstChild + childCount).
+struct DirRec
+{
+    std::uint32_t entry; // entry describing this directory, NONE for the root
+    std::uint32_t firstChild;
+    std::uint32_t childCount;
+    std::uint32_t pad;
+    std::int64_t mtimeNs;
+};
+
+struct EntryRec
+{
+    std::uint32_t parentDir;
+    std::uint32_t nameOffLo;
+    std::uint16_t nameOffHi;
+    std::uint8_t nameLen;
+    std::uint8_t type; // DT_*
+    std::uint32_t dir; // DirRec index if this is an indexed directory, else NONE
+
+    std::uint64_t nameOff() const { return (static_cast<std::uint64_t>(nameOffHi) << 32) | nameOffLo; }
+};
+
+struct TrigramRec
+{
+    std::uint32_t key;
+    std::uint32_t count;
+    std::uint64_t offset; // into the posting array
+};
+
+static_assert(sizeof(EntryRec) == 16, "EntryRec must stay 16 bytes");
+
+// ---- helpers ----
+
+// True if `count` records of `size` bytes starting at `off` lie inside a file
+// of `fileSize` bytes, 8-byte aligned; no sum or product here can overflow.
+bool sectionFits(std::uint64_t off, std::uint64_t count, std::uint64_t size, std::uint64_t fileSize) {
+    return off % 8 == 0 && off <= fileSize && count <= (fileSize - off) / size;
+}
+
+// The name of `e` lies inside the name blob (nameOff is below 2^48, so the sum is exact).
+bool nameFits(const Header *h, const EntryRec &e) {
+    return e.nameOff() + e.nameLen <= h->namesSize;
+}
+
+std::uint32_t trigramKey(const char *s) {
+    return (static_cast<std::uint32_t>(asciiLower(s[0])) << 16) |
+           (static_cast<std::uint32_t>(asciiLower(s[1])) << 8) |
+           asciiLower(s[2]);
+}
+
+// Unique trigram keys of a name, in ascending order.
+void trigramsOf(const char *name, std::size_t len, std::vector<std::uint32_t> &out) {
+    out.clear();
+    for (std::size_t i = 0; i + 3 <= len; ++i) out.push_back(trigramKey(name + i));
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+}
+
+std::string canonical(const std::string &path) {
+    char resolved[PATH_MAX];
+    if (::realpath(path.c_str(), resolved)) return resolved;
+    return path;
+}
+
+std::int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// ---- build ----
+
+struct Child
+{
+    std::string name;
+    unsigned char type;
+};
+
+struct DirListing
+{
+    std::int64_t mtimeNs = 0;
+    std::vector<Child> children;
+};
+
+struct IndexDir : WalkDir
+{
+    DirListing listing;
+};
+
+// Collects the listing of every directory, reusing the previous index for
+// directories whose mtime did not change.
+class IndexVisitor : public TreeVisitor
+{
+public:
+    IndexVisitor(const std::unordered_map<std::string, DirListing> *previous) : previous_(previous) {}
+
+    std::shared_ptr<WalkDir> makeDir() override { return std::make_shared<IndexDir>(); }
+
+    bool enterDir(TreeWalk &walk, WalkDir &base) override {
+        auto &dir = static_cast<IndexDir &>(base);
+        StatInfo self;
+        if (statAt(dir.fd, "", STAT_MTIME, self)) dir.listing.mtimeNs = self.mtimeNs;
+
+        if (previous_) {
+            auto it = previous_->find(dir.path);
+            if (it != previous_->end() && it->second.mtimeNs == dir.listing.mtimeNs) {
+                dir.listing.children = it->second.children;
+                reused_.fetch_add(1, std::memory_order_relaxed);
+                auto shared = dir.shared_from_this();
+                for (const Child &c : dir.listing.children)
+                    if (c.type == DT_DIR) walk.descend(shared, c.name);
+                return false;
+            }
+        }
+        rescanned_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool visit(TreeWalk &, WalkDir &base, const DirEntry &entry, unsigned char type) override {
+        auto &dir = static_cast<IndexDir &>(base);
+        dir.listing.children.push_back({std::string(entry.name, entry.nameLen), type});
+        return type == DT_DIR;
+    }
+
+    void leaveDir(TreeWalk &, WalkDir &base) override {
+        auto &dir = static_cast<IndexDir &>(base);
+        if (dir.fd < 0) return;
+        std::lock_guard<std::mutex> lk(m_);
+        collected_[dir.path] = std::move(dir.listing);
+    }
+
+    std::unordered_map<std::string, DirListing> collected_;
+    std::atomic<std::uint64_t> rescanned_{0};
+    std::atomic<std::uint64_t> reused_{0};
+
+private:
+    const std::unordered_map<std::string, DirListing> *previous_;
+    std::mutex m_;
+};
+
+std::string joinRel(const std::string &dir, const std::string &name) {
+    return dir.empty() ? name : dir + "/" + name;
+}
+
+} // namespace
+
+FileIndex::~FileIndex() {
+    if (base_) ::munmap(const_cast<char *>(base_), size_);
+}
+
+std::string FileIndex::indexPath(const std::string &root) {
+    // FNV-1a of the canonical root keeps one index file per root
+    std::uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : canonical(root)) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "/index-%016llx.idx", static_cast<unsigned long long>(h));
+    return cacheDir() + name;
+}
+
+std::unique_ptr<FileIndex> FileIndex::open(const std::string &root) {
+    std::string path = indexPath(root);
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(Header)) {
+        ::close(fd);
+        return nullptr;
+    }
+    void *map = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return nullptr;
+
+    std::unique_ptr<FileIndex> index(new FileIndex());
+    index->base_ = static_cast<const char *>(map);
+    index->size_ = static_cast<std::size_t>(st.st_size);
+
+    // A truncated or corrupt file must not send a lookup outside the mapping:
+    // every section has to fit, and ids are 32-bit with NONE reserved.
+    const Header *h = reinterpret_cast<const Header *>(index->base_);
+    std::uint64_t size = index->size_;
+    if (std::memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        h->dirCount == 0 || h->dirCount >= NONE || h->entryCount >= NONE ||
+        !sectionFits(h->dirsOff, h->dirCount, sizeof(DirRec), size) ||
+        !sectionFits(h->entriesOff, h->entryCount, sizeof(EntryRec), size) ||
+        !sectionFits(h->trigramsOff, h->trigramCount, sizeof(TrigramRec), size) ||
+        !sectionFits(h->postingsOff, h->postingCount, sizeof(std::uint32_t), size) ||
+        !sectionFits(h->namesOff, h->namesSize, 1, size) ||
+        h->rootLen > h->namesSize)
+        return nullptr;
+
+    index->root_.assign(index->base_ + h->namesOff, h->rootLen);
+    if (index->root_ != canonical(root)) return nullptr;
+    return index;
+}
+
+std::unique_ptr<FileIndex> FileIndex::openCovering(const std::string &path) {
+    std::string p = canonical(path);
+    for (;;) {
+        if (::access(indexPath(p).c_str(), R_OK) == 0) {
+            if (auto index = open(p)) return index;
+        }
+        if (p == "/" || p.empty()) return nullptr;
+        std::size_t slash = p.find_last_of('/');
+        p = (slash == 0 || slash == std::string::npos) ? "/" : p.substr(0, slash);
+    }
+}
+
+bool FileIndex::drop(const std::string &root) {
+    return ::unlink(indexPath(root).c_str()) == 0;
+}
+
+std::uint64_t FileIndex::dirCount() const {
+    return reinterpret_cast<const Header *>(base_)->dirCount;
+}
+
+std::uint64_t FileIndex::entryCount() const {
+    return reinterpret_cast<const Header *>(base_)->entryCount;
+}
+
+std::uint64_t FileIndex::trigramCount() const {
+    return reinterpret_cast<const Header *>(base_)->trigramCount;
+}
+
+std::int64_t FileIndex::builtAtNs() const {
+    return reinterpret_cast<const Header *>(base_)->builtAtNs;
+}
+
+std::string FileIndex::relPath(std::uint32_t entry) const {
+    const Header *h = reinterpret_cast<const Header *>(base_);
+    const DirRec *dirs = reinterpret_cast<const DirRec *>(base_ + h->dirsOff);
+    const EntryRec *entries = reinterpret_cast<const EntryRec *>(base_ + h->entriesOff);
+    const char *names = base_ + h->namesOff;
+
+    // the links are checked as they are followed; a corrupt chain yields ""
+    std::vector<std::uint32_t> chain;
+    for (std::uint32_t e = entry; e != NONE; e = dirs[entries[e].parentDir].entry) {
+        if (e >= h->entryCount || entries[e].parentDir >= h->dirCount || chain.size() >= h->dirCount ||
+            !nameFits(h, entries[e]))
+            return std::string();
+        chain.push_back(e);
+    }
+
+    std::string path;
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        if (!path.empty()) path += '/';
+        path.append(names + entries[*it].nameOff(), entries[*it].nameLen);
+    }
+    return path;
+}
+
+void FileIndex::search(const std::string &under, const std::string &keyword,
+                       const std::function<void(const std::string &, bool)> &onMatch) const {
+    const Header *h = reinterpret_cast<const Header *>(base_);
+    const EntryRec *entries = reinterpret_cast<const EntryRec *>(base_ + h->entriesOff);
+    const TrigramRec *trigrams = reinterpret_cast<const TrigramRec *>(base_ + h->trigramsOff);
+    const std::uint32_t *postings = reinterpret_cast<const std::uint32_t *>(base_ + h->postingsOff);
+    const char *names = base_ + h->namesOff;
+
+    // results are limited to `under`, which must be the root or inside it
+    std::string prefix;
+    std::string canonUnder = canonical(under);
+    if (canonUnder != root_) {
+        std::string rootSlash = root_ == "/" ? root_ : root_ + "/";
+        if (canonUnder.compare(0, rootSlash.size(), rootSlash) != 0) return;
+        prefix = canonUnder.substr(rootSlash.size()) + "/";
+    }
+
+    std::string key = asciiLowerCopy(keyword);
+
+    auto emit = [&](std::uint32_t id) {
+        if (id >= h->entryCount || !nameFits(h, entries[id])) return;
+        const EntryRec &e = entries[id];
+        if (!containsIgnoreCase(names + e.nameOff(), e.nameLen, key.data(), key.size())) return;
+        std::string rel = relPath(id);
+        if (rel.empty()) return;
+        if (!prefix.empty() && rel.compare(0, prefix.size(), prefix) != 0) return;
+        std::string full = root_ == "/" ? "/" + rel : root_ + "/" + rel;
+        bool isDir = e.type == DT_DIR;
+        if (e.type == DT_LNK) {
+            // symlinks report their target's type, as the walking search does
+            StatInfo st;
+            isDir = statAt(AT_FDCWD, full.c_str(), STAT_TYPE, st) && st.type == DT_DIR;
+        }
+        onMatch(full, isDir);
+    };
+
+    if (key.size() < 3) {
+        // too short for trigrams: scan the name table
+        for (std::uint32_t id = 0; id < h->entryCount; ++id) emit(id);
+        return;
+    }
+
+    std::vector<std::uint32_t> keys;
+    trigramsOf(key.data(), key.size(), keys);
+
+    std::vector<const TrigramRec *> lists;
+    for (std::uint32_t k : keys) {
+        const TrigramRec *end = trigrams + h->trigramCount;
+        const TrigramRec *it = std::lower_bound(trigrams, end, k,
+                                                [](const TrigramRec &r, std::uint32_t v) { return r.key < v; });
+        if (it == end || it->key != k) return; // some trigram occurs nowhere
+        if (it->offset > h->postingCount || it->count > h->postingCount - it->offset) return;
+        lists.push_back(it);
+    }
+    std::sort(lists.begin(), lists.end(),
+              [](const TrigramRec *a, const TrigramRec *b) { return a->count < b->count; });
+
+    // intersect from the rarest list up
+    std::vector<std::uint32_t> cand(postings + lists[0]->offset, postings + lists[0]->offset + lists[0]->count);
+    for (std::size_t i = 1; i < lists.size() && !cand.empty(); ++i) {
+        const std::uint32_t *b = postings + lists[i]->offset;
+        const std::uint32_t *bend = b + lists[i]->count;
+        std::size_t out = 0;
+        for (std::uint32_t id : cand) {
+            b = std::lower_bound(b, bend, id);
+            if (b == bend) break;
+            if (*b == id) cand[out++] = id;
+        }
+        cand.resize(out);
+    }
+    for (std::uint32_t id : cand) emit(id);
+}
+
+IndexBuildStats FileIndex::build(const std::string &rootIn, bool incremental) {
+    auto t0 = std::chrono::steady_clock::now();
+    IndexBuildStats stats;
+    const std::string root = canonical(rootIn);
+
+    // listings of the previous index, keyed by path relative to the root
+    std::unordered_map<std::string, DirListing> previous;
+    if (incremental) {
+        if (auto old = open(root)) {
+            const Header *h = reinterpret_cast<const Header *>(old->base_);
+            const DirRec *dirs = reinterpret_cast<const DirRec *>(old->base_ + h->dirsOff);
+            const EntryRec *entries = reinterpret_cast<const EntryRec *>(old->base_ + h->entriesOff);
+            const char *names = old->base_ + h->namesOff;
+
+            // directories are stored breadth-first, so a parent always comes
+            // before its children; anything else means the file is corrupt and
+            // the whole tree is rescanned instead
+            std::vector<std::string> dirPaths(h->dirCount);
+            for (std::uint64_t d = 0; d < h->dirCount; ++d) {
+                const DirRec &dir = dirs[d];
+                bool ok = dir.firstChild <= h->entryCount && dir.childCount <= h->entryCount - dir.firstChild;
+                if (ok && dir.entry != NONE) {
+                    ok = dir.entry < h->entryCount && entries[dir.entry].parentDir < d &&
+                         nameFits(h, entries[dir.entry]);
+                    if (ok) {
+                        const EntryRec &self = entries[dir.entry];
+                        dirPaths[d] = joinRel(dirPaths[self.parentDir],
+                                              std::string(names + self.nameOff(), self.nameLen));
+                    }
+                }
+                for (std::uint32_t c = 0; ok && c < dir.childCount; ++c) ok = nameFits(h, entries[dir.firstChild + c]);
+                if (!ok) {
+                    previous.clear();
+                    break;
+                }
+                DirListing &l = previous[dirPaths[d]];
+                l.mtimeNs = dir.mtimeNs;
+                l.children.reserve(dir.childCount);
+                for (std::uint32_t c = 0; c < dir.childCount; ++c) {
+                    const EntryRec &e = entries[dir.firstChild + c];
+                    l.children.push_back({std::string(names + e.nameOff(), e.nameLen), e.type});
+                }
+            }
+        }
+    }
+
+    IndexVisitor visitor(incremental ? &previous : nullptr);
+    TreeWalk walk(visitor);
+    if (!walk.run(root)) return stats;
+    if (JobContext::stopRequested()) return stats; // a partial walk must not replace the index
+    previous.clear();
+
+    // Lay out directories breadth-first so every directory's children are contiguous.
+    std::vector<DirRec> dirs;
+    std::vector<EntryRec> entries;
+    std::string names = root;
+    std::vector<std::string> dirPaths;
+
+    dirs.push_back({NONE, 0, 0, 0, 0});
+    dirPaths.push_back("");
+    for (std::size_t d = 0; d < dirs.size(); ++d) {
+        auto it = visitor.collected_.find(dirPaths[d]);
+        if (it == visitor.collected_.end()) continue;
+        DirListing &listing = it->second;
+
+        dirs[d].mtimeNs = listing.mtimeNs;
+        dirs[d].firstChild = static_cast<std::uint32_t>(entries.size());
+        dirs[d].childCount = static_cast<std::uint32_t>(listing.children.size());
+
+        for (Child &c : listing.children) {
+            EntryRec e{};
+            e.parentDir = static_cast<std::uint32_t>(d);
+            std::uint64_t off = names.size();
+            e.nameOffLo = static_cast<std::uint32_t>(off);
+            e.nameOffHi = static_cast<std::uint16_t>(off >> 32);
+            e.nameLen = static_cast<std::uint8_t>(std::min<std::size_t>(c.name.size(), 255));
+            e.type = c.type;
+            e.dir = NONE;
+            names.append(c.name, 0, e.nameLen);
+
+            if (c.type == DT_DIR) {
+                std::string childPath = joinRel(dirPaths[d], c.name);
+                if (visitor.collected_.count(childPath)) {
+                    e.dir = static_cast<std::uint32_t>(dirs.size());
+                    dirs.push_back({static_cast<std::uint32_t>(entries.size()), 0, 0, 0, 0});
+                    dirPaths.push_back(std::move(childPath));
+                }
+            }
+            entries.push_back(e);
+        }
+        visitor.collected_.erase(it);
+    }
+    dirPaths.clear();
+
+    // Trigram postings by counting sort: ids are visited in ascending order,
+    // so every posting list comes out sorted.
+    std::vector<std::uint32_t> counts(1u << 24, 0);
+    std::vector<std::uint32_t> grams;
+    for (const EntryRec &e : entries) {
+        trigramsOf(names.data() + e.nameOff(), e.nameLen, grams);
+        for (std::uint32_t k : grams) ++counts[k];
+    }
+    std::vector<TrigramRec> table;
+    std::uint64_t total = 0;
+    for (std::uint32_t k = 0; k < counts.size(); ++k) {
+        if (!counts[k]) continue;
+        table.push_back({k, counts[k], total});
+        total += counts[k];
+        counts[k] = static_cast<std::uint32_t>(table.size() - 1); // reuse as key -> table slot
+    }
+    std::vector<std::uint32_t> postings(total);
+    std::vector<std::uint64_t> fill(table.size());
+    for (std::size_t i = 0; i < table.size(); ++i) fill[i] = table[i].offset;
+    for (std::uint32_t id = 0; id < entries.size(); ++id) {
+        trigramsOf(names.data() + entries[id].nameOff(), entries[id].nameLen, grams);
+        for (std::uint32_t k : grams) postings[fill[counts[k]]++] = id;
+    }
+    counts.clear();
+    counts.shrink_to_fit();
+
+    Header h{};
+    std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.dirCount = dirs.size();
+    h.entryCount = entries.size();
+    h.trigramCount = table.size();
+    h.postingCount = postings.size();
+    h.rootLen = root.size();
+    h.builtAtNs = nowNs();
+
+    std::string path = indexPath(root);
+    std::string tmp = path + ".tmp" + std::to_string(::getpid());
+    FILE *f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return stats;
+    std::vector<char> buf(1 << 20);
+    std::setvbuf(f, buf.data(), _IOFBF, buf.size());
+
+    bool ok = true;
+    std::uint64_t pos = 0;
+    auto put = [&](const void *data, std::size_t bytes) {
+        ok = ok && std::fwrite(data, 1, bytes, f) == bytes;
+        pos += bytes;
+    };
+    auto section = [&](std::uint64_t &off, const void *data, std::size_t bytes) {
+        static const char zeros[8] = {};
+        put(zeros, (8 - pos % 8) % 8);
+        off = pos;
+        put(data, bytes);
+    };
+
+    put(&h, sizeof(h)); // placeholder, rewritten once the offsets are known
+    section(h.dirsOff, dirs.data(), dirs.size() * sizeof(DirRec));
+    section(h.entriesOff, entries.data(), entries.size() * sizeof(EntryRec));
+    section(h.trigramsOff, table.data(), table.size() * sizeof(TrigramRec));
+    section(h.postingsOff, postings.data(), postings.size() * sizeof(std::uint32_t));
+    section(h.namesOff, names.data(), names.size());
+    h.namesSize = names.size();
+    ok = ok && std::fseek(f, 0, SEEK_SET) == 0 && std::fwrite(&h, sizeof(h), 1, f) == 1;
+    ok = (std::fclose(f) == 0) && ok;
+
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return stats;
+    }
+
+    stats.ok = true;
+    stats.dirs = dirs.size();
+    stats.entries = entries.size();
+    stats.trigrams = table.size();
+    stats.rescanned = visitor.rescanned_.load();
+    stats.reused = visitor.reused_.load();
+    stats.bytes = pos;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return stats;
+}
@@ -1,16 +1,27 @@
 #include "FileSystem.h"
+#include "CopyEngine.h"
+#include "DirReader.h"
+#include "DirSnapshot.h"
+#include "DiskUsage.h"
+#include "FileIndex.h"
+#include "ListingCache.h"
+#include "StatBatch.h"
+#include "TextScan.h"
+#include "Trace.h"
+#include "TreeCopy.h"
+#include "TreeRemove.h"
+#include "TreeWalk.h"
 
 #include <dirent.h>
 #include <sys/stat.h>
 
-#include <ctime>
-#include <iomanip>
-#include <sstream>
 #include <fcntl.h>
 #include <unistd.h>
 #include <filesystem>
 #include <system_error>
-#include <filesystem>
+#include <limits.h>
+#include <mutex>
+#include <cstring>
 
 bool FileSystem::exists(const std::string& path) {
     struct stat st{};
@@ -23,40 +34,127 @@ bool FileSystem::isDir(const std::string& path) {
     return S_ISDIR(st.st_mode);
 }
 
-std::vector<FileInfo> FileSystem::listDir(const std::string& path) {
+std::vector<FileInfo> FileSystem::listDir(const std::string& path, bool withStat) {
     std::vector<FileInfo> result;
 
-    DIR* dir = ::opendir(path.c_str());
-    if (!dir) return result;
+    if (withStat) {
+        DirSnapshot snap;
+        if (!listDir(path, snap)) return result;
+        result.reserve(snap.size());
+        for (std::size_t i = 0; i < snap.size(); ++i) result.push_back(snap.info(i));
+        return result;
+    }
 
-    while (dirent* entry = ::readdir(dir)) {
-        const char* name = entry->d_name;
-        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
-            continue; // skip "." and ".."
+    DirReader reader(path);
+    if (!reader.ok()) return result;
 
-        const std::string fullPath = path + "/" + name;
+    DirEntry entry;
+    while (reader.next(entry)) {
+        // names and types only: d_type answers without touching the inode
+        unsigned char type = resolveType(reader.fd(), entry);
+        if (type == DT_UNKNOWN) continue;
+        FileInfo info;
+        info.name.assign(entry.name, entry.nameLen);
+        info.isDir = type == DT_DIR;
+        info.size = info.isDir ? -1 : 0;
+        result.push_back(std::move(info));
+    }
+    return result;
+}
 
-        struct stat st{};
-        if (::stat(fullPath.c_str(), &st) != 0) continue;
+namespace {
+
+// Reads `reader` into `out` a batch at a time, so the stat backend can issue
+// each batch's stats together; onBatch (if set) runs after every batch.
+// `recheck` receives the positions in the whole listing of the directories
+// and symlinks, the rows ListingCache has to re-stat on a hit.
+void readSnapshot(DirReader &reader, DirSnapshot &out, std::size_t batchSize,
+                  const std::function<void()> &onBatch, std::vector<std::uint32_t> &recheck) {
+    TraceSpan span("walk");
+    StatBatch batch(reader.fd(), STAT_TYPE | STAT_SIZE | STAT_MTIME);
+    std::vector<unsigned char> types; // d_type of each queued entry
+    std::uint32_t listed = 0;
+    auto flush = [&] {
+        {
+            TraceSpan statSpan("stat");
+            batch.run();
+        }
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            if (!batch.ok(i)) continue;
+            const StatInfo &st = batch.info(i);
+            const char *name = batch.name(i);
+            bool isDir = st.type == DT_DIR;
+            // the stat followed links; only a filesystem without d_type needs an lstat to spot one
+            unsigned char type = types[i] == DT_LNK ? static_cast<unsigned char>(DT_LNK) : st.type;
+            StatInfo own;
+            if (types[i] == DT_UNKNOWN && statAt(reader.fd(), name, STAT_TYPE, own, false) && own.type == DT_LNK)
+                type = DT_LNK;
+            out.add(name, std::strlen(name), isDir, type, isDir ? -1 : st.size, st.mtimeNs);
+            if (isDir || type == DT_LNK) recheck.push_back(listed);
+            ++listed;
+        }
+        batch.clear();
+        types.clear();
+        if (onBatch) onBatch();
+    };
+
+    DirEntry entry;
+    while (reader.next(entry)) {
+        batch.add(entry.name, entry.nameLen);
+        types.push_back(entry.type);
+        if (batch.size() >= batchSize) flush();
+    }
+    if (!batch.empty()) flush();
+}
 
-        FileInfo info;
-        info.name = name;
-        info.isDir = S_ISDIR(st.st_mode);
-        info.size = info.isDir ? -1 : static_cast<std::int64_t>(st.st_size);
+} // namespace
 
-        std::tm tm{};
-        std::time_t t = st.st_mtime;
-        if (std::tm* p = std::localtime(&t)) tm = *p;
+bool FileSystem::listDir(const std::string &path, DirSnapshot &out) {
+    ListingCache &cache = ListingCache::instance();
+    if (auto hit = cache.lookup(path)) {
+        out = *hit;
+        return true;
+    }
 
-        std::ostringstream oss;
-        oss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
-        info.mtime = oss.str();
+    std::uint64_t ticket = cache.prepare(path); // watch first: changes during the read must count
+    out.clear();
+    DirReader reader(path);
+    if (!reader.ok()) return false;
+    std::vector<std::uint32_t> recheck;
+    readSnapshot(reader, out, 4096, nullptr, recheck);
+    if (!reader.failed()) cache.store(path, ticket, out, std::move(recheck));
+    return true;
+}
 
-        result.push_back(std::move(info));
+bool FileSystem::listDir(const std::string &path, const ListCallback &onBatch, std::size_t batchSize) {
+    ListingCache &cache = ListingCache::instance();
+    if (auto hit = cache.lookup(path)) {
+        if (!hit->empty()) onBatch(*hit);
+        return true;
     }
 
-    ::closedir(dir);
-    return result;
+    std::uint64_t ticket = cache.prepare(path);
+    DirReader reader(path);
+    if (!reader.ok()) return false;
+
+    // batches are handed out as they come; a copy of the whole listing is kept for the cache
+    DirSnapshot snap, whole;
+    std::vector<std::uint32_t> recheck;
+    bool keep = ticket != 0;
+    readSnapshot(reader, snap, batchSize, [&] {
+        if (snap.empty()) return;
+        if (keep && whole.size() + snap.size() <= ListingCache::MAX_DIR_ENTRIES) {
+            for (std::size_t i = 0; i < snap.size(); ++i)
+                whole.add(snap.nameCStr(i), snap.name(i).size(), snap.isDir(i), snap.type(i), snap.fileSize(i),
+                          snap.mtimeNs(i));
+        } else {
+            keep = false;
+        }
+        onBatch(snap);
+        snap.clear();
+    }, recheck);
+    if (keep && !reader.failed()) cache.store(path, ticket, whole, std::move(recheck));
+    return true;
 }
 
 bool FileSystem::createFile(const std::string& path) {
@@ -94,55 +192,98 @@ bool FileSystem::removeDir(const std::string& path) {
 }
 
 unsigned long long FileSystem::calcDirSize(const std::string &path) {
-    namespace fs = std::filesystem;
-    unsigned long long total = 0;
-    try {
-        for (auto it = fs::recursive_directory_iterator(path, fs::directory_options::skip_permission_denied);
-             it != fs::recursive_directory_iterator(); ++it) {
-            try {
-                if (fs::is_regular_file(it->path())) {
-                    total += fs::file_size(it->path());
-                }
-            } catch (...) {
-                // ignore unreadable files
+    return DiskUsage::scan(path).apparent;
+}
+
+namespace {
+
+struct SearchDir : WalkDir
+{
+    std::unique_ptr<StatBatch> links; // matching symlinks whose target type is still unknown
+};
+
+// Matches entry names against the keyword straight from the getdents buffer;
+// only hits pay for building a path (and, for symlinks, a stat).
+class SearchVisitor : public TreeVisitor {
+public:
+    SearchVisitor(const std::string &root, const std::string &keyword, const FileSystem::SearchCallback &onMatch)
+        : root_(root == "/" ? "" : root), key_(asciiLowerCopy(keyword)), onMatch_(onMatch),
+          batched_(statBackend() == StatBackend::Uring) {}
+
+    std::shared_ptr<WalkDir> makeDir() override { return std::make_shared<SearchDir>(); }
+
+    bool visit(TreeWalk &, WalkDir &base, const DirEntry &entry, unsigned char type) override {
+        if (containsIgnoreCase(entry.name, entry.nameLen, key_.data(), key_.size())) {
+            auto &dir = static_cast<SearchDir &>(base);
+            if (type == DT_LNK && batched_) {
+                if (!dir.links) dir.links.reset(new StatBatch(dir.fd, STAT_TYPE));
+                dir.links->add(entry.name, entry.nameLen);
+                return false;
+            }
+            bool isDir = type == DT_DIR;
+            if (type == DT_LNK) {
+                StatInfo st;
+                isDir = statAt(dir.fd, entry.name, STAT_TYPE, st) && st.type == DT_DIR;
             }
+            report(dir, entry.name, isDir);
         }
-    } catch (...) {
-        // ignore errors
+        return type == DT_DIR;
     }
-    return total;
-}
 
-void FileSystem::search(const std::string &path, const std::string &keyword, std::vector<std::pair<std::string,bool>> &results) {
-    namespace fs = std::filesystem;
-    auto toLower = [](const std::string &s){ std::string r = s; for (auto &c : r) c = static_cast<char>(::tolower(c)); return r; };
-    std::string keyl = toLower(keyword);
+    void entriesDone(TreeWalk &, WalkDir &base) override {
+        auto &dir = static_cast<SearchDir &>(base);
+        if (!dir.links) return;
+        dir.links->run();
+        for (std::size_t i = 0; i < dir.links->size(); ++i)
+            report(dir, dir.links->name(i), dir.links->ok(i) && dir.links->info(i).type == DT_DIR);
+        dir.links.reset();
+    }
 
-    try {
-        for (auto it = fs::recursive_directory_iterator(path, fs::directory_options::skip_permission_denied);
-             it != fs::recursive_directory_iterator(); ++it) {
-            try {
-                fs::path p = it->path();
-                std::string name = p.filename().string();
-                if (toLower(name).find(keyl) != std::string::npos) {
-                    std::string display;
-                    char resolved[PATH_MAX];
-                    if (::realpath(p.string().c_str(), resolved)) display = resolved;
-                    else display = p.string();
-                    bool isDir = fs::is_directory(p);
-                    if (isDir) display += "/";
-                    results.emplace_back(display, isDir);
-                }
-            } catch (...) {
-                // ignore entry
-            }
+private:
+    void report(const WalkDir &dir, const char *name, bool isDir) {
+        std::string display = root_ + "/" + dir.childPath(name);
+        if (isDir) display += "/";
+        std::lock_guard<std::mutex> lk(m_);
+        onMatch_(display, isDir);
+    }
+
+    std::string root_;
+    std::string key_;
+    const FileSystem::SearchCallback &onMatch_;
+    bool batched_;
+    std::mutex m_;
+};
+
+} // namespace
+
+void FileSystem::search(const std::string &path, const std::string &keyword, const SearchCallback &onMatch, bool useIndex) {
+    if (useIndex) {
+        TraceSpan span("index");
+        if (auto index = FileIndex::openCovering(path)) {
+            index->search(path, keyword, [&](const std::string &p, bool isDir) {
+                onMatch(isDir ? p + "/" : p, isDir);
+            });
+            return;
         }
-    } catch (...) {
-        // ignore iteration errors
     }
+
+    // resolve the root once; hits are displayed as root + relative path
+    char resolved[PATH_MAX];
+    std::string root = ::realpath(path.c_str(), resolved) ? resolved : path;
+
+    TraceSpan span("walk");
+    SearchVisitor visitor(root, keyword, onMatch);
+    TreeWalk walk(visitor);
+    walk.run(root);
+}
+
+void FileSystem::search(const std::string &path, const std::string &keyword, std::vector<std::pair<std::string,bool>> &results, bool useIndex) {
+    search(path, keyword, [&](const std::string &display, bool isDir) {
+        results.emplace_back(display, isDir);
+    }, useIndex);
 }
 
-bool FileSystem::copyFile(const std::string &src, const std::string &dst, bool overwrite) {
+bool FileSystem::copyFile(const std::string &src, const std::string &dst, bool overwrite, CopyReport *report) {
     namespace fs = std::filesystem;
     try {
         fs::path s(src);
@@ -154,45 +295,95 @@ bool FileSystem::copyFile(const std::string &src, const std::string &dst, bool o
         if (fs::exists(d)) {
             if (fs::is_directory(d)) d /= s.filename();
             if (!overwrite) return false;
-            fs::copy_file(s, d, fs::copy_options::overwrite_existing);
         } else {
             if (d.has_parent_path() && !fs::exists(d.parent_path())) return false;
-            fs::copy_file(s, d);
         }
-        return true;
+
+        CopyReport local;
+        return CopyEngine::copyFile(s.string(), d.string(), overwrite, report ? *report : local);
     } catch (...) {
         return false;
     }
 }
 
+bool FileSystem::copyDir(const std::string &src, const std::string &dst, bool overwrite, TreeCopyStats *stats) {
+    if (!isDir(src)) return false;
+    if (exists(dst) && (!overwrite || !isDir(dst))) return false;
+
+    TreeCopyStats result = TreeCopy::copy(src, dst, overwrite);
+    if (stats) *stats = result;
+    return result.ok && result.errors == 0 && !result.cancelled;
+}
+
+bool FileSystem::removeTree(const std::string &path, TreeRemoveStats *stats) {
+    TreeRemoveStats result = TreeRemove::remove(path);
+    if (stats) *stats = result;
+    return result.ok && result.errors == 0 && !result.cancelled;
+}
+
+std::string FileSystem::entryPath(const std::string &path) {
+    namespace fs = std::filesystem;
+    fs::path p = fs::absolute(path).lexically_normal();
+    if (!p.has_filename()) p = p.parent_path(); // "dir/" names dir
+    if (p == p.root_path()) return p.string();
+    char resolved[PATH_MAX];
+    std::string parent = p.parent_path().string();
+    if (!::realpath(parent.c_str(), resolved)) return p.string();
+    std::string out = resolved;
+    if (out != "/") out += "/";
+    return out + p.filename().string();
+}
+
+std::string FileSystem::moveTarget(const std::string &src, const std::string &dst) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    if (!fs::is_directory(dst, ec)) return dst;
+    return (fs::path(dst) / fs::path(src).lexically_normal().filename()).string();
+}
+
+bool FileSystem::canReplace(const std::string &src, const std::string &dst) {
+    namespace fs = std::filesystem;
+    // replacing the source or a directory above it would destroy the source itself
+    std::string realSrc = entryPath(src), realDst = entryPath(dst);
+    if (realDst == realSrc || realSrc.compare(0, realDst.size() + 1, realDst + "/") == 0 || realDst == "/")
+        return false;
+    std::error_code ec;
+    return fs::is_directory(fs::symlink_status(src, ec)) == fs::is_directory(fs::symlink_status(dst, ec));
+}
+
 bool FileSystem::move(const std::string &src, const std::string &dst, bool overwrite) {
     namespace fs = std::filesystem;
     try {
         fs::path s(src);
         fs::path d(dst);
 
-        if (!fs::exists(s)) return false;
-
-        if (fs::exists(d)) {
-            if (fs::is_directory(d)) d /= s.filename();
-            if (!overwrite) return false;
-            if (fs::is_directory(d)) fs::remove_all(d);
-            else fs::remove(d);
+        std::error_code ec;
+        fs::file_status sst = fs::symlink_status(s, ec);
+        if (!fs::exists(sst)) return false;
+
+        fs::file_status dstStatus = fs::symlink_status(d, ec);
+        if (fs::exists(dstStatus)) {
+            if (!overwrite || !canReplace(s.string(), d.string())) return false;
+            // rename(2) only replaces an empty directory
+            if (fs::is_directory(dstStatus) && !isEmptyDir(d.string()) && !removeTree(d.string())) return false;
         } else {
             if (d.has_parent_path() && !fs::exists(d.parent_path())) return false;
         }
 
-        std::error_code ec;
         fs::rename(s, d, ec);
         if (!ec) return true;
+        if (ec != std::errc::cross_device_link) return false;
 
         // Fallback: copy then remove (handles cross-device moves)
         if (fs::is_regular_file(s)) {
-            fs::copy_file(s, d, fs::copy_options::overwrite_existing);
+            CopyReport report;
+            if (!CopyEngine::copyFile(s.string(), d.string(), true, report)) return false;
             fs::remove(s);
         } else if (fs::is_directory(s)) {
-            fs::copy(s, d, fs::copy_options::recursive | fs::copy_options::overwrite_existing);
-            fs::remove_all(s);
+            // keep the source unless every entry made it across
+            TreeCopyStats stats = TreeCopy::copy(s.string(), d.string(), true);
+            if (!stats.ok || stats.errors != 0 || stats.cancelled) return false;
+            if (!removeTree(s.string())) return false;
         } else {
             return false;
         }
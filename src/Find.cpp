@@ -0,0 +1,329 @@
+#include "Find.h"
+#include "JobContext.h"
+#include "StatBatch.h"
+#include "TextScan.h"
+#include "Trace.h"
+#include "TreeWalk.h"
+
+#include <dirent.h>
+#include <fnmatch.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <regex>
+
+namespace {
+
+// Entries queued per StatBatch before it is flushed.
+const std::size_t BATCH_FLUSH = 4096;
+
+const std::int64_t SECOND_NS = 1000000000LL;
+
+// A glob compiled to the cheapest test that implements it.
+class Glob
+{
+public:
+    Glob(const std::string &pattern, bool fold) : fold_(fold) {
+        std::size_t first = 0, last = pattern.size();
+        bool lead = first < last && pattern[first] == '*';
+        if (lead) ++first;
+        bool trail = first < last && pattern[last - 1] == '*';
+        if (trail) --last;
+        std::string body = pattern.substr(first, last - first);
+
+        if (body.find_first_of("*?[\\") != std::string::npos) {
+            kind_ = PATTERN;
+            text_ = pattern;
+            return;
+        }
+        kind_ = lead && trail ? CONTAINS : lead ? SUFFIX : trail ? PREFIX : EXACT;
+        text_ = fold ? asciiLowerCopy(body) : body;
+    }
+
+    bool match(const char *name, std::size_t len) const {
+        std::size_t m = text_.size();
+        switch (kind_) {
+        case EXACT: return len == m && equal(name, m);
+        case PREFIX: return len >= m && equal(name, m);
+        case SUFFIX: return len >= m && equal(name + len - m, m);
+        case CONTAINS: return m == 0 || findSubstring(name, len, text_.data(), m, fold_) != len;
+        case PATTERN: break;
+        }
+        return ::fnmatch(text_.c_str(), name, fold_ ? FNM_CASEFOLD : 0) == 0;
+    }
+
+private:
+    enum Kind { EXACT, PREFIX, SUFFIX, CONTAINS, PATTERN };
+
+    bool equal(const char *s, std::size_t m) const {
+        if (!fold_) return std::memcmp(s, text_.data(), m) == 0;
+        for (std::size_t i = 0; i < m; ++i)
+            if (asciiLower(static_cast<unsigned char>(s[i])) != static_cast<unsigned char>(text_[i])) return false;
+        return true;
+    }
+
+    Kind kind_;
+    std::string text_; // the literal part (lowercase when folding), or the whole pattern
+    bool fold_;
+};
+
+std::regex::flag_type regexFlags(bool ignoreCase) {
+    return ignoreCase ? std::regex::ECMAScript | std::regex::icase : std::regex::ECMAScript;
+}
+
+char typeChar(unsigned char type) {
+    switch (type) {
+    case DT_REG: return 'f';
+    case DT_DIR: return 'd';
+    case DT_LNK: return 'l';
+    default: return '?';
+    }
+}
+
+// "+N" (more than N), "-N" (less than N) or "N" (exactly N), with an
+// optional unit suffix, as an inclusive range of the raw value. As in GNU
+// find, an age counts whole units elapsed (rounded down) and a size the units
+// it occupies (rounded up): "-mtime 1" is 1 to 2 days ago, "-size 1k" is 1 to
+// 1024 bytes and "-size -1k" only empty files.
+bool parseRange(const std::string &text, const char *units, const std::int64_t *scales, std::int64_t defaultScale,
+                bool roundUp, std::int64_t &lo, std::int64_t &hi) {
+    char sign = 0;
+    std::size_t i = 0;
+    if (!text.empty() && (text[0] == '+' || text[0] == '-')) sign = text[i++];
+    if (i >= text.size() || text[i] < '0' || text[i] > '9') return false;
+    char *end = nullptr;
+    long long n = std::strtoll(text.c_str() + i, &end, 10);
+    std::int64_t scale = defaultScale;
+    if (*end) {
+        const char *unit = end[1] ? nullptr : std::strchr(units, *end);
+        if (!unit) return false;
+        scale = scales[unit - units];
+    }
+    if (n > std::numeric_limits<std::int64_t>::max() / scale - 1) return false;
+    // [first, last] is the range of values that count as exactly n units.
+    std::int64_t value = static_cast<std::int64_t>(n) * scale;
+    std::int64_t first = roundUp ? value - scale + 1 : value;
+    std::int64_t last = roundUp ? value : value + scale - 1;
+    if (sign == '+') lo = last + 1;
+    else if (sign == '-') hi = first - 1;
+    else {
+        lo = first;
+        hi = last;
+    }
+    return true;
+}
+
+struct FindDir : WalkDir
+{
+    std::unique_ptr<StatBatch> batch; // name matches waiting for their size/mtime
+    std::vector<char> types;          // type of each queued entry
+};
+
+class FindVisitor : public TreeVisitor
+{
+public:
+    FindVisitor(const FindQuery &query, const Find::MatchCallback &onMatch)
+        : query_(query), onMatch_(onMatch), needsStat_(query.needsStat()),
+          batched_(statBackend() == StatBackend::Uring) {
+        for (const std::string &g : query.names) names_.emplace_back(g, query.ignoreCase);
+        for (const std::string &g : query.excludes) excludes_.emplace_back(g, query.ignoreCase);
+        if (!query.regex.empty()) regex_.reset(new std::regex(query.regex, regexFlags(query.ignoreCase)));
+        now_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    std::shared_ptr<WalkDir> makeDir() override { return std::make_shared<FindDir>(); }
+
+    bool visit(TreeWalk &, WalkDir &base, const DirEntry &entry, unsigned char type) override {
+        auto &dir = static_cast<FindDir &>(base);
+        entries_.fetch_add(1, std::memory_order_relaxed);
+        int depth = dir.depth + 1;
+
+        bool descend = type == DT_DIR;
+        if (descend) {
+            for (const Glob &g : excludes_) {
+                if (g.match(entry.name, entry.nameLen)) {
+                    pruned_.fetch_add(1, std::memory_order_relaxed);
+                    return false; // neither reported nor entered
+                }
+            }
+            if (query_.maxDepth >= 0 && depth >= query_.maxDepth) {
+                pruned_.fetch_add(1, std::memory_order_relaxed);
+                descend = false;
+            }
+        }
+
+        // stat-free predicates first: depth, d_type, name, regex
+        if (depth < query_.minDepth) return descend;
+        if (query_.type && typeChar(type) != query_.type) return descend;
+        for (const Glob &g : names_)
+            if (!g.match(entry.name, entry.nameLen)) return descend;
+        if (regex_ && !std::regex_search(entry.name, entry.name + entry.nameLen, *regex_)) return descend;
+
+        if (!needsStat_) {
+            report(dir, entry.name, typeChar(type));
+            return descend;
+        }
+        if (batched_) {
+            if (!dir.batch) dir.batch.reset(new StatBatch(dir.fd, STAT_SIZE | STAT_MTIME, false));
+            dir.batch->add(entry.name, entry.nameLen);
+            dir.types.push_back(typeChar(type));
+            if (dir.batch->size() >= BATCH_FLUSH) flush(dir);
+            return descend;
+        }
+        StatInfo st;
+        bool ok = statAt(dir.fd, entry.name, STAT_SIZE | STAT_MTIME, st, false);
+        checkStat(dir, entry.name, typeChar(type), ok, st);
+        return descend;
+    }
+
+    void entriesDone(TreeWalk &, WalkDir &base) override {
+        auto &dir = static_cast<FindDir &>(base);
+        if (!dir.batch) return;
+        flush(dir);
+        dir.batch.reset();
+    }
+
+    std::atomic<std::uint64_t> entries_{0};
+    std::atomic<std::uint64_t> stats_{0};
+    std::atomic<std::uint64_t> matches_{0};
+    std::atomic<std::uint64_t> pruned_{0};
+    std::atomic<std::uint64_t> errors_{0};
+
+private:
+    void flush(FindDir &dir) {
+        dir.batch->run();
+        for (std::size_t i = 0; i < dir.batch->size(); ++i)
+            checkStat(dir, dir.batch->name(i), dir.types[i], dir.batch->ok(i), dir.batch->info(i));
+        dir.batch->clear();
+        dir.types.clear();
+    }
+
+    void checkStat(const WalkDir &dir, const char *name, char type, bool ok, const StatInfo &st) {
+        stats_.fetch_add(1, std::memory_order_relaxed);
+        if (!ok) {
+            errors_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (st.size < query_.minSize || st.size > query_.maxSize) return;
+        std::int64_t age = (now_ - st.mtimeNs) / SECOND_NS;
+        if (age < query_.minAge || age > query_.maxAge) return;
+        report(dir, name, type);
+    }
+
+    void report(const WalkDir &dir, const char *name, char type) {
+        std::string path = dir.childPath(name);
+        matches_.fetch_add(1, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(m_);
+        onMatch_(path, type);
+    }
+
+    const FindQuery &query_;
+    const Find::MatchCallback &onMatch_;
+    bool needsStat_;
+    bool batched_;
+    std::vector<Glob> names_;
+    std::vector<Glob> excludes_;
+    std::unique_ptr<std::regex> regex_;
+    std::int64_t now_;
+    std::mutex m_;
+};
+
+} // namespace
+
+bool FindQuery::parse(const std::vector<std::string> &args, std::string &error) {
+    static const char SIZE_UNITS[] = "ckMG";
+    static const std::int64_t SIZE_SCALES[] = {1, 1LL << 10, 1LL << 20, 1LL << 30};
+    static const char AGE_UNITS[] = "smhd";
+    static const std::int64_t AGE_SCALES[] = {1, 60, 3600, 86400};
+
+    for (std::size_t i = 0; i < args.size(); ++i) {
+        const std::string &opt = args[i];
+        if (i + 1 >= args.size()) {
+            error = opt.empty() || opt[0] != '-' ? "Unexpected argument: " + opt : "Missing value for " + opt;
+            return false;
+        }
+        const std::string &value = args[++i];
+        if (opt == "-name" || opt == "-iname") {
+            names.push_back(value);
+            ignoreCase = ignoreCase || opt == "-iname";
+        } else if (opt == "-regex" || opt == "-iregex") {
+            regex = value;
+            ignoreCase = ignoreCase || opt == "-iregex";
+        } else if (opt == "-exclude") {
+            excludes.push_back(value);
+        } else if (opt == "-type") {
+            if (value != "f" && value != "d" && value != "l") {
+                error = "Unknown type: " + value + " (use f, d or l)";
+                return false;
+            }
+            type = value[0];
+        } else if (opt == "-size") {
+            // units c (bytes, the default), k, M, G
+            if (!parseRange(value, SIZE_UNITS, SIZE_SCALES, 1, true, minSize, maxSize)) {
+                error = "Invalid size: " + value;
+                return false;
+            }
+        } else if (opt == "-mtime") {
+            // units s, m, h, d (the default)
+            if (!parseRange(value, AGE_UNITS, AGE_SCALES, 86400, false, minAge, maxAge)) {
+                error = "Invalid age: " + value;
+                return false;
+            }
+        } else if (opt == "-mindepth" || opt == "-maxdepth") {
+            char *end = nullptr;
+            long d = std::strtol(value.c_str(), &end, 10);
+            if (value.empty() || *end || d < 0) {
+                error = "Invalid depth: " + value;
+                return false;
+            }
+            (opt == "-mindepth" ? minDepth : maxDepth) = static_cast<int>(d);
+        } else {
+            error = "Unknown predicate: " + opt;
+            return false;
+        }
+    }
+
+    if (!regex.empty()) {
+        try {
+            std::regex check(regex, regexFlags(ignoreCase));
+        } catch (const std::regex_error &) {
+            error = "Invalid regex: " + regex;
+            return false;
+        }
+    }
+    if (minDepth < 1) minDepth = 1;
+    return true;
+}
+
+FindStats Find::run(const std::string &root, const FindQuery &query, const MatchCallback &onMatch) {
+    TraceSpan span("find");
+    auto t0 = std::chrono::steady_clock::now();
+    FindStats stats;
+    if (query.minSize > query.maxSize || query.minAge > query.maxAge ||
+        (query.maxDepth >= 0 && query.maxDepth < query.minDepth)) {
+        stats.ok = true; // cannot match anything; don't walk
+        return stats;
+    }
+
+    FindVisitor visitor(query, onMatch);
+    TreeWalk walk(visitor);
+    if (!walk.run(root)) return stats;
+
+    stats.ok = true;
+    stats.entries = visitor.entries_.load();
+    stats.stats = visitor.stats_.load();
+    stats.matches = visitor.matches_.load();
+    stats.pruned = visitor.pruned_.load();
+    stats.errors = visitor.errors_.load() + walk.errors();
+    stats.cancelled = JobContext::stopRequested();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (Trace::enabled())
+        span.setArgs("\"entries\":" + std::to_string(stats.entries) + ",\"stats\":" + std::to_string(stats.stats));
+    return stats;
+}
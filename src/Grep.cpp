@@ -0,0 +1,317 @@
+#include "Grep.h"
+#include "IoStats.h"
+#include "JobContext.h"
+#include "TextScan.h"
+#include "Trace.h"
+#include "TreeWalk.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+const std::size_t BATCH_FILES = 32;
+// Files are read this much at a time into a per-thread buffer.
+const std::size_t READ_BLOCK = 1024 * 1024;
+// A line may grow the buffer to this much; past it the line is scanned in pieces.
+const std::size_t MAX_BUFFER = 16 * 1024 * 1024;
+// As in grep and git: a NUL byte in the first block marks a binary file.
+const std::size_t BINARY_PROBE = 8192;
+// Longer lines are shown as a window around the hit.
+const std::size_t MAX_LINE = 512;
+
+// Reads a file block by block and hands it out in runs of whole lines, so a
+// line never straddles two runs; a line longer than the buffer grows it, up
+// to MAX_BUFFER. A longer line is handed out MAX_BUFFER at a time, each run
+// repeating the last `overlap` bytes of the one before so that a match
+// across the cut is still found. The first block is checked for a NUL before
+// anything else, so a binary file costs one read however large it is.
+// Reading instead of mapping means a file truncated while it is scanned just
+// ends early, where a mapping would raise SIGBUS on the pages past the end.
+class BlockReader
+{
+public:
+    BlockReader(int fd, std::size_t size, std::size_t overlap) : fd_(fd), size_(size), overlap_(overlap) {
+        if (buffer_.size() < READ_BLOCK) buffer_.resize(READ_BLOCK);
+    }
+
+    ~BlockReader() {
+        // a huge line grew the buffer; don't keep that much per thread
+        if (buffer_.size() > READ_BLOCK) {
+            buffer_.resize(READ_BLOCK);
+            buffer_.shrink_to_fit();
+        }
+    }
+
+    // The next run of lines, the last without its newline; false at the end
+    // of the file, for a binary file, or on a read error.
+    bool next(const char *&data, std::size_t &n) {
+        if (binary_) return false;
+        ::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+        end_ -= begin_;
+        begin_ = 0;
+        for (;;) {
+            if (!eof_) {
+                if (end_ == buffer_.size()) buffer_.resize(std::min(buffer_.size() * 2, MAX_BUFFER));
+                std::size_t want = std::min(buffer_.size() - end_, size_ - offset_);
+                ssize_t got = want ? ::pread(fd_, buffer_.data() + end_, want, static_cast<off_t>(offset_)) : 0;
+                ioCount(&IoCounters::dataCalls);
+                if (got < 0) {
+                    failed_ = true;
+                    return false;
+                }
+                if (got == 0) eof_ = true; // reached the size from fstat, or the file shrank
+                end_ += static_cast<std::size_t>(got);
+                offset_ += static_cast<std::size_t>(got);
+                ioCount(&IoCounters::bytesRead, static_cast<std::size_t>(got));
+                if (offset_ == end_ && ::memchr(buffer_.data(), '\0', std::min(end_, BINARY_PROBE))) {
+                    binary_ = true; // still the first block: nothing has been handed out
+                    return false;
+                }
+            }
+            const void *nl = end_ ? ::memrchr(buffer_.data(), '\n', end_) : nullptr;
+            if (nl || eof_) {
+                begin_ = nl && !eof_ ? static_cast<std::size_t>(static_cast<const char *>(nl) - buffer_.data()) + 1 : end_;
+                data = buffer_.data();
+                n = begin_;
+                return n > 0;
+            }
+            if (end_ == buffer_.size() && end_ >= MAX_BUFFER) {
+                // no newline in MAX_BUFFER bytes: hand out the piece, keep its tail
+                begin_ = end_ - std::min(overlap_, end_);
+                data = buffer_.data();
+                n = end_;
+                return true;
+            }
+        }
+    }
+
+    bool binary() const { return binary_; }
+    bool failed() const { return failed_; }
+
+private:
+    static thread_local std::vector<char> buffer_;
+
+    int fd_;
+    std::size_t size_;
+    std::size_t overlap_;
+    std::size_t offset_ = 0; // bytes of the file read so far
+    std::size_t begin_ = 0;  // buffer_[begin_, end_) is read but not handed out yet
+    std::size_t end_ = 0;
+    bool eof_ = false;
+    bool binary_ = false;
+    bool failed_ = false;
+};
+
+thread_local std::vector<char> BlockReader::buffer_;
+
+struct Counters
+{
+    std::atomic<std::uint64_t> files{0};
+    std::atomic<std::uint64_t> binary{0};
+    std::atomic<std::uint64_t> matchedFiles{0};
+    std::atomic<std::uint64_t> lines{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> errors{0};
+};
+
+class Scanner
+{
+public:
+    Scanner(const std::string &pattern, const GrepOptions &options, const Grep::FileCallback &onFile)
+        : key_(options.ignoreCase ? asciiLowerCopy(pattern) : pattern), options_(options), onFile_(onFile) {}
+
+    // Scans `name` under `dirFd`; `display` is the path printed for it.
+    void scan(int dirFd, const char *name, const std::string &display) {
+        if (JobContext::stopRequested()) return;
+        int fd = ::openat(dirFd, name, O_RDONLY | O_CLOEXEC);
+        ioCount(&IoCounters::opens);
+        if (fd < 0) {
+            counters.errors.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        struct stat st{};
+        if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+            ::close(fd);
+            ioCount(&IoCounters::closes);
+            counters.errors.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        BlockReader reader(fd, static_cast<std::size_t>(st.st_size), key_.empty() ? 0 : key_.size() - 1);
+        std::string text;
+        std::uint64_t lines = 0, lineNo = 1, bytes = 0;
+        const char *data;
+        std::size_t n;
+        while (reader.next(data, n)) {
+            bytes += n;
+            JobContext::addBytes(n);
+            lines += match(data, n, display, lineNo, text);
+            if ((options_.filesOnly && lines) || JobContext::stopRequested()) break;
+        }
+        ::close(fd);
+        ioCount(&IoCounters::closes);
+        if (reader.failed()) {
+            counters.errors.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        counters.files.fetch_add(1, std::memory_order_relaxed);
+        if (reader.binary()) {
+            counters.binary.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+        if (!lines) return;
+        counters.matchedFiles.fetch_add(1, std::memory_order_relaxed);
+        counters.lines.fetch_add(lines, std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(outM_);
+        onFile_(text);
+    }
+
+    Counters counters;
+
+private:
+    // Appends the output for every matching line of data[0, n), which starts
+    // on line `lineNo`, to `text`; returns the line count and leaves lineNo at
+    // the line that follows.
+    std::uint64_t match(const char *data, std::size_t n, const std::string &display, std::uint64_t &lineNo,
+                        std::string &text) {
+        std::uint64_t lines = 0;
+        std::size_t counted = 0; // lineNo is the number of the line starting at `counted`
+        std::size_t pos = 0;     // always a line start
+        while (pos < n) {
+            std::size_t hit = pos + findSubstring(data + pos, n - pos, key_.data(), key_.size(), options_.ignoreCase);
+            if (hit >= n) break;
+            ++lines;
+            if (options_.filesOnly) {
+                text += display;
+                text += '\n';
+                return lines;
+            }
+
+            const void *nl = ::memrchr(data + pos, '\n', hit - pos);
+            std::size_t start = nl ? static_cast<std::size_t>(static_cast<const char *>(nl) - data) + 1 : pos;
+            nl = ::memchr(data + hit, '\n', n - hit);
+            std::size_t end = nl ? static_cast<std::size_t>(static_cast<const char *>(nl) - data) : n;
+
+            lineNo += static_cast<std::uint64_t>(std::count(data + counted, data + start, '\n'));
+            counted = start;
+            appendLine(text, display, lineNo, data, start, end, hit);
+            pos = end + 1;
+        }
+        lineNo += static_cast<std::uint64_t>(std::count(data + counted, data + n, '\n'));
+        return lines;
+    }
+
+    static void appendLine(std::string &text, const std::string &display, std::uint64_t lineNo,
+                           const char *data, std::size_t start, std::size_t end, std::size_t hit) {
+        text += display;
+        text += ':';
+        text += std::to_string(lineNo);
+        text += ':';
+        if (end > start && data[end - 1] == '\r') --end;
+        if (end - start <= MAX_LINE) {
+            text.append(data + start, end - start);
+        } else {
+            std::size_t from = hit - start > MAX_LINE / 2 ? hit - MAX_LINE / 2 : start;
+            std::size_t to = std::min(end, from + MAX_LINE);
+            if (from > start) text += "...";
+            text.append(data + from, to - from);
+            if (to < end) text += "...";
+        }
+        text += '\n';
+    }
+
+    std::string key_;
+    GrepOptions options_;
+    const Grep::FileCallback &onFile_;
+    std::mutex outM_;
+};
+
+struct GrepDir : WalkDir
+{
+    std::vector<std::string> batch; // regular files not yet handed to the pool
+};
+
+class GrepVisitor : public TreeVisitor
+{
+public:
+    GrepVisitor(const std::string &root, Scanner &scanner) : root_(root == "/" ? "" : root), scanner_(scanner) {}
+
+    std::shared_ptr<WalkDir> makeDir() override { return std::make_shared<GrepDir>(); }
+
+    bool visit(TreeWalk &walk, WalkDir &dir, const DirEntry &entry, unsigned char type) override {
+        if (type == DT_DIR) return true;
+        if (type != DT_REG) return false; // symlinks are not followed
+        auto &d = static_cast<GrepDir &>(dir);
+        d.batch.emplace_back(entry.name, entry.nameLen);
+        if (d.batch.size() == BATCH_FILES) flush(walk, d);
+        return false;
+    }
+
+    void entriesDone(TreeWalk &walk, WalkDir &dir) override {
+        auto &d = static_cast<GrepDir &>(dir);
+        if (!d.batch.empty()) flush(walk, d);
+    }
+
+private:
+    void flush(TreeWalk &walk, GrepDir &dir) {
+        auto self = std::static_pointer_cast<GrepDir>(dir.shared_from_this());
+        walk.spawn(self, [this, self, names = std::move(dir.batch)] {
+            for (const std::string &name : names)
+                scanner_.scan(self->fd, name.c_str(), root_ + "/" + self->childPath(name.c_str()));
+        });
+        dir.batch.clear();
+    }
+
+    std::string root_;
+    Scanner &scanner_;
+};
+
+} // namespace
+
+GrepStats Grep::run(const std::string &path, const std::string &pattern, const GrepOptions &options,
+                    const FileCallback &onFile) {
+    TraceSpan span("grep");
+    auto t0 = std::chrono::steady_clock::now();
+    GrepStats stats;
+
+    struct stat st{};
+    if (::stat(path.c_str(), &st) != 0) return stats;
+
+    Scanner scanner(pattern, options, onFile);
+    if (S_ISDIR(st.st_mode)) {
+        // resolve the root once; hits are displayed as root + relative path, as in search
+        char resolved[PATH_MAX];
+        std::string root = ::realpath(path.c_str(), resolved) ? resolved : path;
+        GrepVisitor visitor(root, scanner);
+        TreeWalk walk(visitor);
+        if (!walk.run(root)) return stats;
+        stats.errors += walk.errors();
+    } else {
+        scanner.scan(AT_FDCWD, path.c_str(), path);
+    }
+
+    stats.ok = true;
+    stats.files = scanner.counters.files.load();
+    stats.binary = scanner.counters.binary.load();
+    stats.matchedFiles = scanner.counters.matchedFiles.load();
+    stats.lines = scanner.counters.lines.load();
+    stats.bytes = scanner.counters.bytes.load();
+    stats.errors += scanner.counters.errors.load();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    span.setArgs("\"files\":" + std::to_string(stats.files) + ",\"bytes\":" + std::to_string(stats.bytes));
+    return stats;
+}
@@ -0,0 +1,121 @@
+#include "Hash64.h"
+
+#include <cstring>
+
+namespace {
+
+const std::uint64_t P1 = 11400714785074694791ULL;
+const std::uint64_t P2 = 14029467366897019727ULL;
+const std::uint64_t P3 = 1609587929392839161ULL;
+const std::uint64_t P4 = 9650029242287828579ULL;
+const std::uint64_t P5 = 2870177450012600261ULL;
+
+inline std::uint64_t rotl(std::uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+// Unaligned little-endian loads (the x86 and arm64 byte order).
+inline std::uint64_t read64(const unsigned char *p) {
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline std::uint32_t read32(const unsigned char *p) {
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline std::uint64_t round(std::uint64_t acc, std::uint64_t input) {
+    acc += input * P2;
+    acc = rotl(acc, 31);
+    return acc * P1;
+}
+
+inline std::uint64_t mergeRound(std::uint64_t acc, std::uint64_t v) {
+    acc ^= round(0, v);
+    return acc * P1 + P4;
+}
+
+} // namespace
+
+Hash64::Hash64(std::uint64_t seed) : seed_(seed) {
+    v_[0] = seed + P1 + P2;
+    v_[1] = seed + P2;
+    v_[2] = seed;
+    v_[3] = seed - P1;
+}
+
+void Hash64::update(const void *data, std::size_t n) {
+    const unsigned char *p = static_cast<const unsigned char *>(data);
+    total_ += n;
+
+    if (buffered_) {
+        std::size_t take = sizeof(buf_) - buffered_ < n ? sizeof(buf_) - buffered_ : n;
+        std::memcpy(buf_ + buffered_, p, take);
+        buffered_ += take;
+        p += take;
+        n -= take;
+        if (buffered_ < sizeof(buf_)) return;
+        for (int i = 0; i < 4; ++i) v_[i] = round(v_[i], read64(buf_ + 8 * i));
+        buffered_ = 0;
+    }
+
+    // 32-byte stripes, one 8-byte lane per accumulator
+    std::uint64_t v0 = v_[0], v1 = v_[1], v2 = v_[2], v3 = v_[3];
+    for (; n >= 32; p += 32, n -= 32) {
+        v0 = round(v0, read64(p));
+        v1 = round(v1, read64(p + 8));
+        v2 = round(v2, read64(p + 16));
+        v3 = round(v3, read64(p + 24));
+    }
+    v_[0] = v0;
+    v_[1] = v1;
+    v_[2] = v2;
+    v_[3] = v3;
+
+    std::memcpy(buf_, p, n);
+    buffered_ = n;
+}
+
+std::uint64_t Hash64::digest() const {
+    std::uint64_t h;
+    if (total_ >= 32) {
+        h = rotl(v_[0], 1) + rotl(v_[1], 7) + rotl(v_[2], 12) + rotl(v_[3], 18);
+        for (int i = 0; i < 4; ++i) h = mergeRound(h, v_[i]);
+    } else {
+        h = seed_ + P5;
+    }
+    h += total_;
+
+    const unsigned char *p = buf_;
+    std::size_t n = buffered_;
+    for (; n >= 8; p += 8, n -= 8) {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * P1 + P4;
+    }
+    if (n >= 4) {
+        h ^= static_cast<std::uint64_t>(read32(p)) * P1;
+        h = rotl(h, 23) * P2 + P3;
+        p += 4;
+        n -= 4;
+    }
+    for (; n > 0; ++p, --n) {
+        h ^= *p * P5;
+        h = rotl(h, 11) * P1;
+    }
+
+    h ^= h >> 33;
+    h *= P2;
+    h ^= h >> 29;
+    h *= P3;
+    h ^= h >> 32;
+    return h;
+}
+
+std::uint64_t Hash64::of(const void *data, std::size_t n, std::uint64_t seed) {
+    Hash64 h(seed);
+    h.update(data, n);
+    return h.digest();
+}
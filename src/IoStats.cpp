@@ -0,0 +1,57 @@
+#include "IoStats.h"
+#include "JobContext.h"
+
+namespace {
+const std::uint64_t LEGACY_READDIR_BUF = 32768;
+}
+
+IoCounters &ioCounters() {
+    static IoCounters counters;
+    return counters;
+}
+
+IoSnapshot ioSnapshot(const IoCounters &c) {
+    IoSnapshot s;
+    s.opens = c.opens.load(std::memory_order_relaxed);
+    s.closes = c.closes.load(std::memory_order_relaxed);
+    s.getdents = c.getdents.load(std::memory_order_relaxed);
+    s.direntBytes = c.direntBytes.load(std::memory_order_relaxed);
+    s.entries = c.entries.load(std::memory_order_relaxed);
+    s.stats = c.stats.load(std::memory_order_relaxed);
+    s.statsSkipped = c.statsSkipped.load(std::memory_order_relaxed);
+    s.ringEnters = c.ringEnters.load(std::memory_order_relaxed);
+    s.ringStats = c.ringStats.load(std::memory_order_relaxed);
+    s.dataCalls = c.dataCalls.load(std::memory_order_relaxed);
+    s.bytesRead = c.bytesRead.load(std::memory_order_relaxed);
+    s.bytesWritten = c.bytesWritten.load(std::memory_order_relaxed);
+    return s;
+}
+
+void ioCount(std::atomic<std::uint64_t> IoCounters::*counter, std::uint64_t n) {
+    (ioCounters().*counter).fetch_add(n, std::memory_order_relaxed);
+    if (JobContext *job = JobContext::current()) (job->io().*counter).fetch_add(n, std::memory_order_relaxed);
+}
+
+IoSnapshot operator-(const IoSnapshot &a, const IoSnapshot &b) {
+    IoSnapshot d;
+    d.opens = a.opens - b.opens;
+    d.closes = a.closes - b.closes;
+    d.getdents = a.getdents - b.getdents;
+    d.direntBytes = a.direntBytes - b.direntBytes;
+    d.entries = a.entries - b.entries;
+    d.stats = a.stats - b.stats;
+    d.statsSkipped = a.statsSkipped - b.statsSkipped;
+    d.ringEnters = a.ringEnters - b.ringEnters;
+    d.ringStats = a.ringStats - b.ringStats;
+    d.dataCalls = a.dataCalls - b.dataCalls;
+    d.bytesRead = a.bytesRead - b.bytesRead;
+    d.bytesWritten = a.bytesWritten - b.bytesWritten;
+    return d;
+}
+
+std::uint64_t IoSnapshot::legacySyscalls() const {
+    // opendir + closedir, one getdents per 32 KiB plus the final empty read,
+    // and one path-based stat for every entry.
+    std::uint64_t reads = direntBytes / LEGACY_READDIR_BUF + opens;
+    return opens + closes + reads + entries;
+}
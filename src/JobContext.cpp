@@ -0,0 +1,56 @@
+#include "JobContext.h"
+
+#include <time.h>
+
+#include <iostream>
+
+namespace {
+thread_local JobContext *tlsJob = nullptr;
+thread_local std::uint64_t tlsCpuMark = 0; // thread CPU time when tlsJob was entered
+
+std::uint64_t threadCpuNs() {
+    struct timespec ts{};
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<std::uint64_t>(ts.tv_nsec);
+}
+}
+
+JobContext *JobContext::current() {
+    return tlsJob;
+}
+
+void JobContext::addEntries(std::uint64_t n) {
+    if (tlsJob) tlsJob->entries_.fetch_add(n, std::memory_order_relaxed);
+}
+
+void JobContext::addBytes(std::uint64_t n) {
+    if (tlsJob) tlsJob->bytes_.fetch_add(n, std::memory_order_relaxed);
+}
+
+double JobContext::cpuSeconds() const {
+    std::uint64_t ns = cpuNs_.load(std::memory_order_relaxed);
+    if (tlsJob == this) ns += threadCpuNs() - tlsCpuMark; // the calling thread's share so far
+    return static_cast<double>(ns) / 1e9;
+}
+
+std::ostream &JobContext::output() {
+    return tlsJob && tlsJob->out ? *tlsJob->out : std::cout;
+}
+
+// Charges the CPU time since the last switch to the context being left.
+// Threads outside any command (e.g. the benchmark) never read the clock.
+void JobScope::enter(JobContext *job) {
+    if (job == tlsJob) return;
+    std::uint64_t now = threadCpuNs();
+    if (tlsJob) tlsJob->cpuNs_.fetch_add(now - tlsCpuMark, std::memory_order_relaxed);
+    tlsCpuMark = now;
+    tlsJob = job;
+}
+
+JobScope::JobScope(JobContext *job) : previous_(tlsJob) {
+    enter(job);
+}
+
+JobScope::~JobScope() {
+    enter(previous_);
+}
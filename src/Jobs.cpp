@@ -0,0 +1,145 @@
+#include "Jobs.h"
+#include "Utils.h"
+
+#include <csignal>
+#include <iomanip>
+
+namespace {
+
+std::atomic<JobContext *> foregroundJob{nullptr};
+
+void onInterrupt(int) {
+    JobContext *job = foregroundJob.load();
+    if (job && !job->cancelled()) {
+        job->cancel();
+        return;
+    }
+    ::signal(SIGINT, SIG_DFL);
+    ::raise(SIGINT);
+}
+
+} // namespace
+
+JobTable &JobTable::instance() {
+    static JobTable table;
+    return table;
+}
+
+JobTable::~JobTable() {
+    std::lock_guard<std::mutex> lock(m_);
+    for (auto &kv : jobs_) kv.second->context.cancel();
+    for (auto &kv : jobs_)
+        if (kv.second->thread.joinable()) kv.second->thread.join();
+}
+
+int JobTable::start(const std::string &command, std::function<void()> body) {
+    std::lock_guard<std::mutex> lock(m_);
+    std::unique_ptr<Job> job(new Job);
+    Job *raw = job.get();
+    raw->id = nextId_++;
+    raw->command = command;
+    raw->context.out = &raw->output;
+    raw->started = std::chrono::steady_clock::now();
+    raw->thread = std::thread([raw, body = std::move(body)] {
+        {
+            JobScope scope(&raw->context);
+            body();
+        }
+        raw->ended = std::chrono::steady_clock::now();
+        raw->finished.store(true, std::memory_order_release);
+    });
+    jobs_[raw->id] = std::move(job);
+    return raw->id;
+}
+
+void JobTable::printJob(std::ostream &out, const Job &job) {
+    bool finished = job.finished.load(std::memory_order_acquire);
+    auto end = finished ? job.ended : std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - job.started).count();
+    const char *state = !finished ? (job.context.cancelled() ? "Stopping" : "Running")
+                                  : (job.context.cancelled() ? "Cancelled" : "Done");
+
+    out << "[" << job.id << "] " << std::left << std::setw(10) << state << std::right << std::fixed
+        << std::setprecision(1) << std::setw(7) << seconds << "s  " << job.context.entries() << " entries, "
+        << formatBytes(job.context.bytes()) << "  " << job.command << "\n";
+}
+
+void JobTable::list(std::ostream &out) {
+    std::lock_guard<std::mutex> lock(m_);
+    if (jobs_.empty()) {
+        out << "No jobs\n";
+        return;
+    }
+    for (auto &kv : jobs_) {
+        printJob(out, *kv.second);
+        if (kv.second->finished.load(std::memory_order_acquire)) kv.second->reported = true;
+    }
+}
+
+bool JobTable::foreground(int id, std::ostream &out) {
+    Job *job = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_);
+        if (id == 0 && !jobs_.empty()) id = jobs_.rbegin()->first;
+        auto it = jobs_.find(id);
+        if (it == jobs_.end()) return false;
+        job = it->second.get();
+    }
+
+    out << job->command << "\n";
+    out.flush();
+    {
+        Foreground fg(&job->context);
+        job->thread.join();
+    }
+    out << job->output.str();
+    printJob(out, *job);
+
+    std::lock_guard<std::mutex> lock(m_);
+    jobs_.erase(id);
+    return true;
+}
+
+void JobTable::waitAll(std::ostream &out) {
+    for (;;) {
+        int id;
+        {
+            std::lock_guard<std::mutex> lock(m_);
+            if (jobs_.empty()) return;
+            id = jobs_.begin()->first;
+        }
+        foreground(id, out);
+    }
+}
+
+bool JobTable::cancel(int id) {
+    std::lock_guard<std::mutex> lock(m_);
+    auto it = jobs_.find(id);
+    if (it == jobs_.end()) return false;
+    it->second->context.cancel();
+    return true;
+}
+
+void JobTable::reportFinished(std::ostream &out) {
+    std::lock_guard<std::mutex> lock(m_);
+    for (auto &kv : jobs_) {
+        Job &job = *kv.second;
+        if (job.reported || !job.finished.load(std::memory_order_acquire)) continue;
+        printJob(out, job);
+        job.reported = true;
+    }
+}
+
+void JobTable::installInterruptHandler() {
+    struct sigaction sa{};
+    sa.sa_handler = onInterrupt;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    ::sigaction(SIGINT, &sa, nullptr);
+}
+
+JobTable::Foreground::Foreground(JobContext *job) : previous_(foregroundJob.exchange(job)) {}
+
+JobTable::Foreground::~Foreground() {
+    foregroundJob.store(previous_);
+}
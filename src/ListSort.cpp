@@ -0,0 +1,183 @@
+#include "ListSort.h"
+#include "DirSnapshot.h"
+#include "TextScan.h"
+#include "WorkPool.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Below this many rows a single thread sorts faster than splitting the work.
+const std::size_t PARALLEL_THRESHOLD = 1 << 18;
+
+bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+// Single-threaded radix sort of [data, data + n) using `tmp` as scratch.
+void radixSortRange(SortEntry *data, SortEntry *tmp, std::size_t n) {
+    if (n < 2) return;
+
+    // all eight histograms in one pass over the keys
+    std::size_t counts[8][256];
+    std::memset(counts, 0, sizeof(counts));
+    for (std::size_t i = 0; i < n; ++i) {
+        std::uint64_t k = data[i].key;
+        for (int b = 0; b < 8; ++b) ++counts[b][(k >> (8 * b)) & 0xff];
+    }
+
+    SortEntry *src = data, *dst = tmp;
+    for (int b = 0; b < 8; ++b) {
+        std::size_t *c = counts[b];
+        if (c[(src[0].key >> (8 * b)) & 0xff] == n) continue; // every key has the same byte here
+
+        std::size_t offset = 0;
+        for (int d = 0; d < 256; ++d) {
+            std::size_t count = c[d];
+            c[d] = offset;
+            offset += count;
+        }
+        for (std::size_t i = 0; i < n; ++i) dst[c[(src[i].key >> (8 * b)) & 0xff]++] = src[i];
+        std::swap(src, dst);
+    }
+    if (src != data) std::memcpy(data, src, n * sizeof(SortEntry));
+}
+
+// Sorts `data` in chunks on the shared pool with `sortChunk(begin, end, scratch)`,
+// then merges neighbouring runs pairwise (also in parallel) until one remains.
+template <typename T, typename SortChunk, typename Less>
+void chunkSortMerge(std::vector<T> &data, SortChunk sortChunk, Less less) {
+    WorkPool &pool = WorkPool::shared();
+    std::size_t n = data.size();
+    std::size_t chunks = std::max<std::size_t>(1, std::min<std::size_t>(pool.threads(), n / (PARALLEL_THRESHOLD / 4)));
+    std::size_t width = (n + chunks - 1) / chunks;
+    std::vector<T> scratch(n);
+
+    {
+        TaskGroup group(pool);
+        for (std::size_t lo = 0; lo < n; lo += width) {
+            std::size_t hi = std::min(n, lo + width);
+            group.run([&, lo, hi] { sortChunk(data.data() + lo, data.data() + hi, scratch.data() + lo); });
+        }
+        group.wait();
+    }
+
+    for (; width < n; width *= 2) {
+        TaskGroup group(pool);
+        for (std::size_t lo = 0; lo < n; lo += 2 * width) {
+            std::size_t mid = std::min(n, lo + width), hi = std::min(n, lo + 2 * width);
+            group.run([&, lo, mid, hi] {
+                std::merge(data.begin() + lo, data.begin() + mid, data.begin() + mid, data.begin() + hi,
+                           scratch.begin() + lo, less);
+            });
+        }
+        group.wait();
+        data.swap(scratch);
+    }
+}
+
+// Sorts `idx` (row indices) with a comparison on rows, in parallel when large.
+template <typename Less>
+void sortIndices(std::vector<std::uint32_t> &idx, Less less) {
+    if (idx.size() < PARALLEL_THRESHOLD) {
+        std::sort(idx.begin(), idx.end(), less);
+        return;
+    }
+    chunkSortMerge(idx, [&](std::uint32_t *b, std::uint32_t *e, std::uint32_t *) { std::sort(b, e, less); }, less);
+}
+
+} // namespace
+
+void radixSort(std::vector<SortEntry> &entries) {
+    if (entries.size() < PARALLEL_THRESHOLD) {
+        std::vector<SortEntry> tmp(entries.size());
+        radixSortRange(entries.data(), tmp.data(), entries.size());
+        return;
+    }
+    chunkSortMerge(entries, [](SortEntry *b, SortEntry *e, SortEntry *scratch) {
+        radixSortRange(b, scratch, static_cast<std::size_t>(e - b));
+    }, [](const SortEntry &a, const SortEntry &b) { return a.key < b.key; });
+}
+
+bool naturalLess(std::string_view a, std::string_view b) {
+    std::size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        if (isDigit(a[i]) && isDigit(b[j])) {
+            while (i < a.size() && a[i] == '0') ++i;
+            while (j < b.size() && b[j] == '0') ++j;
+            std::size_t ei = i, ej = j;
+            while (ei < a.size() && isDigit(a[ei])) ++ei;
+            while (ej < b.size() && isDigit(b[ej])) ++ej;
+            // longer run of significant digits is the larger number
+            if (ei - i != ej - j) return ei - i < ej - j;
+            int c = a.compare(i, ei - i, b, j, ej - j);
+            if (c != 0) return c < 0;
+            i = ei;
+            j = ej;
+            continue;
+        }
+        unsigned char ca = asciiLower(static_cast<unsigned char>(a[i]));
+        unsigned char cb = asciiLower(static_cast<unsigned char>(b[j]));
+        if (ca != cb) return ca < cb;
+        ++i;
+        ++j;
+    }
+    if (a.size() - i != b.size() - j) return a.size() - i < b.size() - j;
+    return a < b; // equal ignoring case and leading zeros: fall back to bytes
+}
+
+std::string_view extensionOf(std::string_view name) {
+    std::size_t dot = name.rfind('.');
+    if (dot == std::string_view::npos || dot == 0) return std::string_view();
+    return name.substr(dot + 1);
+}
+
+std::vector<std::uint32_t> sortListing(const DirSnapshot &snap, ListOrder order, const std::vector<std::uint64_t> *sizes) {
+    const std::size_t n = snap.size();
+    std::vector<std::uint32_t> result(n);
+
+    if (order == ListOrder::Name || order == ListOrder::Extension) {
+        for (std::size_t i = 0; i < n; ++i) result[i] = static_cast<std::uint32_t>(i);
+        if (order == ListOrder::Name) {
+            sortIndices(result, [&](std::uint32_t a, std::uint32_t b) { return naturalLess(snap.name(a), snap.name(b)); });
+        } else {
+            sortIndices(result, [&](std::uint32_t a, std::uint32_t b) {
+                std::string_view ea = extensionOf(snap.name(a)), eb = extensionOf(snap.name(b));
+                if (ea != eb) return naturalLess(ea, eb);
+                return naturalLess(snap.name(a), snap.name(b));
+            });
+        }
+        return result;
+    }
+
+    // Integer keys: map "descending, empty directories last" onto an
+    // ascending key and let the radix sort do the work.
+    std::vector<SortEntry> keys(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        std::uint64_t k;
+        if (order == ListOrder::Size) {
+            std::uint64_t size = sizes ? (*sizes)[i] : static_cast<std::uint64_t>(std::max<std::int64_t>(0, snap.fileSize(i)));
+            bool emptyDir = snap.isDir(i) && size == 0;
+            k = emptyDir ? ~0ULL : ~(size + 1); // size + 1 keeps 0-byte files ahead of empty dirs
+        } else {
+            // flipping the sign bit orders signed ns as unsigned; ~ puts the newest first
+            k = ~(static_cast<std::uint64_t>(snap.mtimeNs(i)) ^ (1ULL << 63));
+        }
+        keys[i] = {k, static_cast<std::uint32_t>(i)};
+    }
+    radixSort(keys);
+
+    // the radix sort is stable on row order; equal keys are ordered by name instead
+    for (std::size_t lo = 0; lo < n;) {
+        std::size_t hi = lo + 1;
+        while (hi < n && keys[hi].key == keys[lo].key) ++hi;
+        if (hi - lo > 1)
+            std::sort(keys.begin() + lo, keys.begin() + hi,
+                      [&](const SortEntry &a, const SortEntry &b) { return snap.name(a.index) < snap.name(b.index); });
+        lo = hi;
+    }
+
+    for (std::size_t i = 0; i < n; ++i) result[i] = keys[i].index;
+    return result;
+}
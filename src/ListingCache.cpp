@@ -0,0 +1,169 @@
+#include "ListingCache.h"
+#include "DirReader.h"
+#include "DirSnapshot.h"
+#include "IoStats.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+ListingCache &ListingCache::instance() {
+    static ListingCache cache;
+    return cache;
+}
+
+void ListingCache::invalidate(Entry &entry) {
+    ++entry.version;
+    if (!entry.listing) return;
+    entries_ -= entry.listing->size();
+    entry.listing.reset();
+    entry.recheck.clear();
+    ++stats_.invalidations;
+}
+
+void ListingCache::drain() {
+    std::vector<WatchEvent> batch;
+    watch_.read(batch, 0);
+    for (const WatchEvent &ev : batch) {
+        if (ev.kind == WatchEvent::Overflow) {
+            for (auto &kv : map_) invalidate(kv.second);
+            continue;
+        }
+        if (ev.kind == WatchEvent::Moved && ev.fromDir != ev.dir) {
+            auto from = map_.find(ev.fromDir);
+            if (from != map_.end()) invalidate(from->second);
+        }
+        auto it = map_.find(ev.dir);
+        if (it == map_.end()) continue;
+        invalidate(it->second);
+        if (ev.name.empty()) forget(it); // the directory itself is gone, and its watch with it
+    }
+}
+
+bool ListingCache::identify(const std::string &path, std::uint64_t &dev, std::uint64_t &ino) {
+    StatInfo st;
+    if (!statAt(AT_FDCWD, path.c_str(), STAT_TYPE | STAT_INO, st) || st.type != DT_DIR) return false;
+    dev = st.dev;
+    ino = st.ino;
+    return true;
+}
+
+bool ListingCache::current(const std::string &path, const Entry &entry) {
+    if (entry.recheck.empty()) return true;
+    int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    ioCount(&IoCounters::opens);
+    if (fd < 0) return false;
+    const DirSnapshot &listing = *entry.listing;
+    bool same = true;
+    for (std::uint32_t i : entry.recheck) {
+        StatInfo st;
+        if (!statAt(fd, listing.nameCStr(i), STAT_TYPE | STAT_SIZE | STAT_MTIME, st) ||
+            listing.isDir(i) != (st.type == DT_DIR) || listing.mtimeNs(i) != st.mtimeNs ||
+            (!listing.isDir(i) && listing.fileSize(i) != st.size)) {
+            same = false;
+            break;
+        }
+    }
+    ::close(fd);
+    ioCount(&IoCounters::closes);
+    return same;
+}
+
+void ListingCache::forget(std::unordered_map<std::string, Entry>::iterator it) {
+    if (it->second.listing) entries_ -= it->second.listing->size();
+    watch_.remove(it->first);
+    map_.erase(it);
+}
+
+void ListingCache::evict() {
+    while (map_.size() > MAX_DIRS || entries_ > MAX_ENTRIES) {
+        auto oldest = map_.begin();
+        for (auto it = map_.begin(); it != map_.end(); ++it)
+            if (it->second.lastUse < oldest->second.lastUse) oldest = it;
+        forget(oldest);
+    }
+}
+
+std::shared_ptr<const DirSnapshot> ListingCache::lookup(const std::string &path) {
+    std::lock_guard<std::mutex> lock(m_);
+    drain();
+    auto it = map_.find(path);
+    if (it == map_.end() || !it->second.listing) {
+        ++stats_.misses;
+        return nullptr;
+    }
+    Entry &entry = it->second;
+    std::uint64_t dev, ino;
+    if (!identify(path, dev, ino) || dev != entry.dev || ino != entry.ino) {
+        forget(it); // the path names another directory now; so would the watch
+        ++stats_.misses;
+        return nullptr;
+    }
+    if (!current(path, entry)) {
+        invalidate(entry);
+        ++stats_.misses;
+        return nullptr;
+    }
+    ++stats_.hits;
+    entry.lastUse = ++clock_;
+    return entry.listing;
+}
+
+std::uint64_t ListingCache::prepare(const std::string &path) {
+    std::lock_guard<std::mutex> lock(m_);
+    drain();
+    std::uint64_t dev, ino;
+    if (!identify(path, dev, ino)) return 0;
+    auto it = map_.find(path);
+    if (it != map_.end() && (it->second.dev != dev || it->second.ino != ino)) {
+        forget(it);
+        it = map_.end();
+    }
+    if (it == map_.end()) {
+        if (!watch_.add(path)) return 0;
+        // the watch went to whatever the path named at that moment; make sure it is the one identified
+        std::uint64_t watchedDev, watchedIno;
+        if (!identify(path, watchedDev, watchedIno) || watchedDev != dev || watchedIno != ino) {
+            watch_.remove(path);
+            return 0;
+        }
+        it = map_.emplace(path, Entry()).first;
+        it->second.dev = dev;
+        it->second.ino = ino;
+    }
+    it->second.lastUse = ++clock_;
+    std::uint64_t ticket = it->second.version;
+    evict();
+    return ticket;
+}
+
+void ListingCache::store(const std::string &path, std::uint64_t ticket, const DirSnapshot &listing,
+                         std::vector<std::uint32_t> recheck) {
+    if (!ticket || listing.size() > MAX_DIR_ENTRIES) return;
+    std::lock_guard<std::mutex> lock(m_);
+    drain();
+    auto it = map_.find(path);
+    if (it == map_.end() || it->second.version != ticket) return; // changed while it was read
+    Entry &entry = it->second;
+    if (entry.listing) entries_ -= entry.listing->size();
+    entry.listing = std::make_shared<const DirSnapshot>(listing);
+    entry.recheck = std::move(recheck);
+    entries_ += listing.size();
+    evict();
+}
+
+void ListingCache::clear() {
+    std::lock_guard<std::mutex> lock(m_);
+    while (!map_.empty()) forget(map_.begin());
+    stats_ = Stats();
+}
+
+ListingCache::Stats ListingCache::stats() {
+    std::lock_guard<std::mutex> lock(m_);
+    drain();
+    Stats s = stats_;
+    s.dirs = 0;
+    for (const auto &kv : map_) s.dirs += kv.second.listing ? 1 : 0;
+    s.entries = entries_;
+    return s;
+}
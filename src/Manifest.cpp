@@ -0,0 +1,335 @@
+#include "Manifest.h"
+#include "DirReader.h"
+#include "JobContext.h"
+#include "Trace.h"
+#include "TreeWalk.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+// ---- on-disk layout (native endianness, every section 8-byte aligned) ----
+
+const char MAGIC[8] = {'M', 'F', 'E', 'M', 'A', 'N', '1', '\0'};
+
+struct Header
+{
+    char magic[8];
+    std::uint64_t count;
+    std::uint64_t recordsOff;
+    std::uint64_t namesOff;
+    std::uint64_t namesSize;
+    std::uint64_t rootLen; // the root path is stored at the start of the name blob
+    std::int64_t createdAtNs;
+};
+
+static_assert(sizeof(ManifestRecord) == 40, "ManifestRecord must stay 40 bytes");
+
+const unsigned FIELDS = STAT_TYPE | STAT_SIZE | STAT_MTIME | STAT_INO;
+
+// Byte order with '/' below every other byte: "a" < "a/b" < "a-b", so a
+// subtree is contiguous and follows its directory. '/' takes the place of NUL,
+// the one byte a path cannot contain, so no two paths compare equal.
+inline unsigned char pathByte(char c) {
+    return c == '/' ? 0 : static_cast<unsigned char>(c);
+}
+
+int comparePaths(const char *a, std::size_t na, const char *b, std::size_t nb) {
+    std::size_t n = std::min(na, nb);
+    for (std::size_t i = 0; i < n; ++i) {
+        unsigned char x = pathByte(a[i]), y = pathByte(b[i]);
+        if (x != y) return x < y ? -1 : 1;
+    }
+    return na == nb ? 0 : (na < nb ? -1 : 1);
+}
+
+bool startsWith(const char *s, std::size_t n, const std::string &prefix) {
+    return n >= prefix.size() && std::memcmp(s, prefix.data(), prefix.size()) == 0;
+}
+
+std::int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+struct Item
+{
+    std::string path;
+    std::uint32_t mode;
+    std::uint64_t size;
+    std::int64_t mtimeNs;
+    std::uint64_t ino;
+};
+
+Item makeItem(std::string path, const StatInfo &st) {
+    return {std::move(path), st.mode, static_cast<std::uint64_t>(st.size), st.mtimeNs, st.ino};
+}
+
+struct ScanDir : WalkDir
+{
+    std::vector<Item> items; // this directory and its non-directory entries
+};
+
+class ScanVisitor : public TreeVisitor
+{
+public:
+    explicit ScanVisitor(const Manifest *previous) : previous_(previous) {}
+
+    std::shared_ptr<WalkDir> makeDir() override { return std::make_shared<ScanDir>(); }
+
+    bool enterDir(TreeWalk &walk, WalkDir &base) override {
+        auto &dir = static_cast<ScanDir &>(base);
+        StatInfo self;
+        if (!statAt(dir.fd, "", FIELDS, self)) {
+            errors_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        dir.items.push_back(makeItem(dir.path, self));
+
+        if (previous_) {
+            std::size_t i = previous_->find(dir.path);
+            if (i < previous_->size()) {
+                const ManifestRecord &old = previous_->record(i);
+                if (S_ISDIR(old.mode) && old.mtimeNs == self.mtimeNs && old.ino == self.ino) {
+                    prune(walk, dir, i);
+                    return false;
+                }
+            }
+        }
+        dirsRead_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool visit(TreeWalk &, WalkDir &base, const DirEntry &entry, unsigned char type) override {
+        if (type == DT_DIR) return true; // recorded by its own enterDir
+        auto &dir = static_cast<ScanDir &>(base);
+        StatInfo st;
+        if (!statAt(dir.fd, entry.name, FIELDS, st, false)) {
+            errors_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        dir.items.push_back(makeItem(dir.childPath(entry.name), st));
+        return false;
+    }
+
+    void leaveDir(TreeWalk &, WalkDir &base) override {
+        auto &dir = static_cast<ScanDir &>(base);
+        if (dir.fd < 0 && dir.parent) {
+            // unreadable: still record it, so it does not show up as removed
+            StatInfo st;
+            if (statAt(dir.parent->fd, dir.name.c_str(), FIELDS, st, false))
+                dir.items.push_back(makeItem(dir.path, st));
+        }
+        std::lock_guard<std::mutex> lock(m_);
+        for (Item &item : dir.items) items_.push_back(std::move(item));
+    }
+
+    std::vector<Item> items_;
+    std::atomic<std::uint64_t> dirsRead_{0};
+    std::atomic<std::uint64_t> dirsPruned_{0};
+    std::atomic<std::uint64_t> errors_{0};
+
+private:
+    // Takes the direct children of the unchanged directory at `at` from the
+    // previous manifest, jumping over the subtrees of its subdirectories.
+    void prune(TreeWalk &walk, ScanDir &dir, std::size_t at) {
+        dirsPruned_.fetch_add(1, std::memory_order_relaxed);
+        const Manifest &prev = *previous_;
+        std::string prefix = dir.path.empty() ? std::string() : dir.path + "/";
+        std::vector<std::string> subdirs;
+
+        std::size_t i = at + 1;
+        while (i < prev.size() && startsWith(prev.pathData(i), prev.record(i).pathLen, prefix)) {
+            const ManifestRecord &r = prev.record(i);
+            std::string path = prev.path(i);
+            if (!S_ISDIR(r.mode)) {
+                dir.items.push_back({std::move(path), r.mode, r.size, r.mtimeNs, r.ino});
+                ++i;
+                continue;
+            }
+            subdirs.push_back(path.substr(prefix.size()));
+            // the subtree is the run of entries starting with "path/"
+            std::string inside = path + "/";
+            std::size_t lo = i + 1, hi = prev.size();
+            while (lo < hi) {
+                std::size_t mid = lo + (hi - lo) / 2;
+                if (startsWith(prev.pathData(mid), prev.record(mid).pathLen, inside)) lo = mid + 1;
+                else hi = mid;
+            }
+            i = lo;
+        }
+
+        auto shared = dir.shared_from_this();
+        for (const std::string &name : subdirs) walk.descend(shared, name);
+    }
+
+    const Manifest *previous_;
+    std::mutex m_;
+};
+
+} // namespace
+
+Manifest::~Manifest() {
+    if (map_) ::munmap(const_cast<char *>(map_), mapSize_);
+}
+
+std::unique_ptr<Manifest> Manifest::scan(const std::string &rootIn, const Manifest *previous,
+                                         ManifestScanStats &stats) {
+    TraceSpan span("walk");
+    char resolved[PATH_MAX];
+    std::string root = ::realpath(rootIn.c_str(), resolved) ? resolved : rootIn;
+
+    ScanVisitor visitor(previous);
+    TreeWalk walk(visitor);
+    if (!walk.run(root)) return nullptr;
+    stats.dirsRead = visitor.dirsRead_.load();
+    stats.dirsPruned = visitor.dirsPruned_.load();
+    stats.errors = visitor.errors_.load() + walk.errors();
+    stats.cancelled = JobContext::stopRequested();
+
+    std::vector<Item> &items = visitor.items_;
+    {
+        TraceSpan sort("sort");
+        std::sort(items.begin(), items.end(), [](const Item &a, const Item &b) {
+            return comparePaths(a.path.data(), a.path.size(), b.path.data(), b.path.size()) < 0;
+        });
+    }
+
+    std::unique_ptr<Manifest> m(new Manifest());
+    m->root_ = root;
+    m->createdAtNs_ = nowNs();
+    m->ownNames_ = root;
+    m->ownRecords_.reserve(items.size());
+    for (const Item &item : items) {
+        m->ownRecords_.push_back({m->ownNames_.size(), static_cast<std::uint32_t>(item.path.size()), item.mode,
+                                  item.size, item.mtimeNs, item.ino});
+        m->ownNames_ += item.path;
+    }
+    m->records_ = m->ownRecords_.data();
+    m->names_ = m->ownNames_.data();
+    m->count_ = m->ownRecords_.size();
+    span.setArgs("\"entries\":" + std::to_string(m->count_) + ",\"pruned\":" + std::to_string(stats.dirsPruned));
+    return m;
+}
+
+std::unique_ptr<Manifest> Manifest::load(const std::string &file) {
+    int fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+
+    struct stat st{};
+    if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(Header)) {
+        ::close(fd);
+        return nullptr;
+    }
+    void *map = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return nullptr;
+
+    std::unique_ptr<Manifest> m(new Manifest());
+    m->map_ = static_cast<const char *>(map);
+    m->mapSize_ = static_cast<std::size_t>(st.st_size);
+
+    // Checked by subtraction and division: offsets and counts come from the
+    // file, and a sum or product of them could wrap past the size.
+    const Header *h = reinterpret_cast<const Header *>(m->map_);
+    if (std::memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        h->recordsOff % alignof(ManifestRecord) != 0 || h->recordsOff > m->mapSize_ ||
+        h->count > (m->mapSize_ - h->recordsOff) / sizeof(ManifestRecord) ||
+        h->namesOff > m->mapSize_ || h->namesSize > m->mapSize_ - h->namesOff || h->rootLen > h->namesSize)
+        return nullptr;
+
+    m->records_ = reinterpret_cast<const ManifestRecord *>(m->map_ + h->recordsOff);
+    m->names_ = m->map_ + h->namesOff;
+    m->count_ = h->count;
+    m->createdAtNs_ = h->createdAtNs;
+    m->root_.assign(m->names_, h->rootLen);
+    for (std::size_t i = 0; i < m->count_; ++i)
+        if (m->records_[i].pathOff > h->namesSize || m->records_[i].pathLen > h->namesSize - m->records_[i].pathOff)
+            return nullptr;
+    return m;
+}
+
+bool Manifest::save(const std::string &file) const {
+    std::string tmp = file + ".tmp" + std::to_string(::getpid());
+    FILE *f = std::fopen(tmp.c_str(), "wb");
+    if (!f) return false;
+    std::vector<char> buf(1 << 20);
+    std::setvbuf(f, buf.data(), _IOFBF, buf.size());
+
+    Header h{};
+    std::memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.count = count_;
+    h.rootLen = root_.size();
+    h.createdAtNs = createdAtNs_;
+    h.recordsOff = sizeof(Header); // 56 bytes, already 8-aligned
+    h.namesOff = h.recordsOff + count_ * sizeof(ManifestRecord);
+    h.namesSize = count_ ? records_[count_ - 1].pathOff + records_[count_ - 1].pathLen : root_.size();
+
+    bool ok = std::fwrite(&h, sizeof(h), 1, f) == 1 &&
+              std::fwrite(records_, sizeof(ManifestRecord), count_, f) == count_ &&
+              std::fwrite(names_, 1, h.namesSize, f) == h.namesSize;
+    ok = (std::fclose(f) == 0) && ok;
+    if (!ok || std::rename(tmp.c_str(), file.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::size_t Manifest::find(const std::string &path) const {
+    const ManifestRecord *end = records_ + count_;
+    const ManifestRecord *it = std::lower_bound(records_, end, path, [this](const ManifestRecord &r, const std::string &p) {
+        return comparePaths(names_ + r.pathOff, r.pathLen, p.data(), p.size()) < 0;
+    });
+    if (it == end || comparePaths(names_ + it->pathOff, it->pathLen, path.data(), path.size()) != 0) return count_;
+    return static_cast<std::size_t>(it - records_);
+}
+
+void Manifest::diff(const Manifest &before, const Manifest &after, const ChangeCallback &onChange) {
+    std::size_t i = 0, j = 0;
+    while (i < before.size() || j < after.size()) {
+        int c;
+        if (i == before.size()) c = 1;
+        else if (j == after.size()) c = -1;
+        else {
+            const ManifestRecord &a = before.record(i), &b = after.record(j);
+            c = comparePaths(before.names_ + a.pathOff, a.pathLen, after.names_ + b.pathOff, b.pathLen);
+        }
+
+        if (c < 0) {
+            onChange(ManifestChange::Removed, before.path(i++), std::string());
+        } else if (c > 0) {
+            onChange(ManifestChange::Added, after.path(j++), std::string());
+        } else {
+            const ManifestRecord &a = before.record(i), &b = after.record(j);
+            std::string what;
+            auto note = [&what](const char *field) {
+                if (!what.empty()) what += ',';
+                what += field;
+            };
+            if ((a.mode & S_IFMT) != (b.mode & S_IFMT)) note("type");
+            else if (a.mode != b.mode) note("mode");
+            // a directory's size and mtime only track its entries, which are compared themselves
+            if (!S_ISDIR(b.mode)) {
+                if (a.size != b.size) note("size");
+                if (a.mtimeNs != b.mtimeNs) note("mtime");
+            }
+            if (a.ino != b.ino) note("inode");
+            if (!what.empty()) onChange(ManifestChange::Modified, after.path(j), what);
+            ++i;
+            ++j;
+        }
+    }
+}
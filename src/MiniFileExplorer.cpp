@@ -1,6 +1,8 @@
 #include "MiniFileExplorer.h"
 #include "commands/Commands.h"
 #include "Utils.h"
+#include "JobContext.h"
+#include "Jobs.h"
 
 #include <iostream>
 #include <unistd.h>
@@ -18,11 +20,14 @@ MiniFileExplorer::MiniFileExplorer(const std::string& startDir) {
 
 
 void MiniFileExplorer::run() {
-    std::cout << "Current Directory: " << currentDir << std::endl;
+    std::cout << "Current Directory: " << currentDir << "\n";
 
     ::chdir(currentDir.c_str());
+    JobTable::installInterruptHandler();
 
     while (true) {
+        JobTable::instance().reportFinished(std::cout);
+
         char buf[1024];
         getcwd(buf, sizeof(buf));
 
@@ -35,7 +40,11 @@ void MiniFileExplorer::run() {
                   << WHITE << " > ";
 
         std::string input;
-        std::getline(std::cin, input);
+        if (!std::getline(std::cin, input)) {
+            // end of input (Ctrl-D or a closed pipe); running jobs are cancelled on exit
+            std::cout << "\n";
+            break;
+        }
 
         auto args = split(input);
         if (args.empty()) continue;
@@ -44,6 +53,49 @@ void MiniFileExplorer::run() {
     }
 }
 
+void MiniFileExplorer::runBatch(std::istream& in) {
+    batch = true;
+    ::chdir(currentDir.c_str());
+
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line[start] == '#') continue;
+
+        size_t begin = 0;
+        while (begin <= line.size()) {
+            size_t end = line.find(';', begin);
+            if (end == std::string::npos) end = line.size();
+            std::string command = line.substr(begin, end - begin);
+            if (!split(command).empty())
+                execute(command);
+            begin = end + 1;
+        }
+    }
+    JobTable::instance().waitAll(std::cout);
+}
+
+bool MiniFileExplorer::confirm(Confirm kind, const std::string& question) {
+    if (kind == Confirm::Overwrite && noClobber) {
+        JobContext::output() << question << " n (--no-clobber)\n";
+        return false;
+    }
+    if (assumeYes) {
+        JobContext::output() << question << " y (--yes)\n";
+        return true;
+    }
+    if (batch) {
+        JobContext::output() << question << " n (batch mode, use --yes)\n";
+        return false;
+    }
+
+    JobContext::output() << question << " ";
+    JobContext::output().flush();
+    std::string ans;
+    std::getline(std::cin, ans);
+    return ans == "y";
+}
+
 void MiniFileExplorer::execute(const std::string& input) {
     auto args = split(input);
     handleCommand(*this, args);
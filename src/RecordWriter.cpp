@@ -0,0 +1,310 @@
+#include "RecordWriter.h"
+#include "JobContext.h"
+
+#include <dirent.h>
+
+#include <atomic>
+#include <charconv>
+#include <cstring>
+
+namespace {
+
+std::atomic<OutputFormat> format{OutputFormat::Text};
+
+void appendInt(std::string &buf, std::int64_t v) {
+    char digits[24];
+    char *end = std::to_chars(digits, digits + sizeof(digits), v).ptr;
+    buf.append(digits, end);
+}
+
+void appendUint(std::string &buf, std::uint64_t v) {
+    char digits[24];
+    char *end = std::to_chars(digits, digits + sizeof(digits), v).ptr;
+    buf.append(digits, end);
+}
+
+// Length of the well-formed UTF-8 sequence starting at p[0] (a byte >= 0x80),
+// or 0 if it is not one: no overlong forms, surrogates or values past
+// U+10FFFF, as JSON requires.
+std::size_t utf8Sequence(const unsigned char *p, std::size_t n) {
+    unsigned char c = p[0];
+    std::size_t len;
+    unsigned char lo = 0x80, hi = 0xbf; // allowed range of the second byte
+    if (c >= 0xc2 && c <= 0xdf) len = 2;
+    else if (c >= 0xe0 && c <= 0xef) {
+        len = 3;
+        if (c == 0xe0) lo = 0xa0;
+        if (c == 0xed) hi = 0x9f;
+    } else if (c >= 0xf0 && c <= 0xf4) {
+        len = 4;
+        if (c == 0xf0) lo = 0x90;
+        if (c == 0xf4) hi = 0x8f;
+    } else {
+        return 0;
+    }
+    if (n < len || p[1] < lo || p[1] > hi) return 0;
+    for (std::size_t i = 2; i < len; ++i)
+        if ((p[i] & 0xc0) != 0x80) return 0;
+    return len;
+}
+
+bool validUtf8(std::string_view s) {
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(s.data());
+    for (std::size_t i = 0; i < s.size();) {
+        if (p[i] < 0x80) {
+            ++i;
+            continue;
+        }
+        std::size_t len = utf8Sequence(p + i, s.size() - i);
+        if (!len) return false;
+        i += len;
+    }
+    return true;
+}
+
+// Appends `s` as a JSON string. Runs without anything to escape, which is
+// nearly every file name, are copied in one append. Bytes that are not part
+// of valid UTF-8 become U+FFFD, so the line always parses.
+void appendString(std::string &buf, std::string_view s) {
+    static const char HEX[] = "0123456789abcdef";
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(s.data());
+    buf += '"';
+    std::size_t run = 0;
+    for (std::size_t i = 0; i < s.size(); ++i) {
+        unsigned char c = p[i];
+        if (c >= 0x80) {
+            std::size_t len = utf8Sequence(p + i, s.size() - i);
+            if (len) {
+                i += len - 1;
+                continue;
+            }
+        } else if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        buf.append(s.data() + run, i - run);
+        run = i + 1;
+        switch (c) {
+        case '"': buf += "\\\""; break;
+        case '\\': buf += "\\\\"; break;
+        case '\n': buf += "\\n"; break;
+        case '\t': buf += "\\t"; break;
+        default:
+            if (c >= 0x80) {
+                buf += "\\ufffd";
+                break;
+            }
+            buf += "\\u00";
+            buf += HEX[c >> 4];
+            buf += HEX[c & 15];
+        }
+    }
+    buf.append(s.data() + run, s.size() - run);
+    buf += '"';
+}
+
+void appendBase64(std::string &buf, std::string_view s) {
+    static const char ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(s.data());
+    buf += '"';
+    std::size_t i = 0;
+    for (; i + 3 <= s.size(); i += 3) {
+        std::uint32_t v = (p[i] << 16) | (p[i + 1] << 8) | p[i + 2];
+        buf += ALPHABET[v >> 18];
+        buf += ALPHABET[(v >> 12) & 63];
+        buf += ALPHABET[(v >> 6) & 63];
+        buf += ALPHABET[v & 63];
+    }
+    if (i < s.size()) {
+        std::uint32_t v = p[i] << 16;
+        if (i + 1 < s.size()) v |= p[i + 1] << 8;
+        buf += ALPHABET[v >> 18];
+        buf += ALPHABET[(v >> 12) & 63];
+        buf += i + 1 < s.size() ? ALPHABET[(v >> 6) & 63] : '=';
+        buf += '=';
+    }
+    buf += '"';
+}
+
+// "path":"..." and, for a name that is not valid UTF-8 (Linux names are any
+// bytes), "path_b64" with the exact bytes next to the lossy "path".
+void appendPath(std::string &buf, std::string_view path) {
+    buf += "\"path\":";
+    appendString(buf, path);
+    if (!validUtf8(path)) {
+        buf += ",\"path_b64\":";
+        appendBase64(buf, path);
+    }
+}
+
+char typeLetter(unsigned char type) {
+    switch (type) {
+    case DT_REG: return 'f';
+    case DT_DIR: return 'd';
+    case DT_LNK: return 'l';
+    default: return '?';
+    }
+}
+
+const char *endStatusName(std::uint16_t status) {
+    switch (status) {
+    case END_CANCELLED: return "cancelled";
+    case END_FAILED: return "failed";
+    default: return "complete";
+    }
+}
+
+} // namespace
+
+const char *outputFormatName(OutputFormat f) {
+    switch (f) {
+    case OutputFormat::Ndjson: return "ndjson";
+    case OutputFormat::Binary: return "bin";
+    default: return "text";
+    }
+}
+
+bool parseOutputFormat(const std::string &name, OutputFormat &out) {
+    if (name == "text") out = OutputFormat::Text;
+    else if (name == "ndjson" || name == "json") out = OutputFormat::Ndjson;
+    else if (name == "bin" || name == "binary") out = OutputFormat::Binary;
+    else return false;
+    return true;
+}
+
+void setOutputFormat(OutputFormat f) {
+    format.store(f, std::memory_order_relaxed);
+}
+
+OutputFormat outputFormat() {
+    return format.load(std::memory_order_relaxed);
+}
+
+RecordWriter::RecordWriter(std::ostream &out, OutputFormat format, const char *command)
+    : out_(out), format_(format), command_(command) {
+    buf_.reserve(FLUSH_AT + 4096);
+}
+
+RecordWriter::~RecordWriter() {
+    finish();
+}
+
+void RecordWriter::binary(RecordKind kind, unsigned char type, std::uint16_t flags, std::uint32_t mode,
+                          std::string_view path, std::uint64_t v0, std::uint64_t v1, std::uint64_t v2,
+                          std::uint64_t v3) {
+    RecordHeader h;
+    std::size_t padded = (sizeof(h) + path.size() + 1 + 7) & ~std::size_t(7);
+    h.length = static_cast<std::uint32_t>(padded);
+    h.kind = kind;
+    h.type = type;
+    h.flags = flags;
+    h.pathLen = static_cast<std::uint32_t>(path.size());
+    h.mode = mode;
+    h.v[0] = v0;
+    h.v[1] = v1;
+    h.v[2] = v2;
+    h.v[3] = v3;
+    buf_.append(reinterpret_cast<const char *>(&h), sizeof(h));
+    buf_.append(path.data(), path.size());
+    buf_.append(padded - sizeof(h) - path.size(), '\0'); // the NUL and the padding
+}
+
+void RecordWriter::entry(std::string_view path, const EntryRecord &e) {
+    ++entries_;
+    if (format_ == OutputFormat::Binary) {
+        std::uint16_t f = e.fields;
+        binary(RECORD_ENTRY, e.type, f, (f & ENTRY_HAS_MODE) ? e.mode : 0, path,
+               (f & ENTRY_HAS_SIZE) ? static_cast<std::uint64_t>(e.size) : 0,
+               (f & ENTRY_HAS_MTIME) ? static_cast<std::uint64_t>(e.mtimeNs) : 0, (f & ENTRY_HAS_INO) ? e.ino : 0, 0);
+    } else {
+        buf_ += "{\"kind\":\"entry\",";
+        appendPath(buf_, path);
+        buf_ += ",\"type\":\"";
+        buf_ += typeLetter(e.type);
+        buf_ += '"';
+        if (e.fields & ENTRY_HAS_SIZE) {
+            buf_ += ",\"size\":";
+            appendInt(buf_, e.size);
+        }
+        if (e.fields & ENTRY_HAS_MTIME) {
+            buf_ += ",\"mtime_ns\":";
+            appendInt(buf_, e.mtimeNs);
+        }
+        if (e.fields & ENTRY_HAS_MODE) {
+            buf_ += ",\"mode\":";
+            appendUint(buf_, e.mode);
+        }
+        if (e.fields & ENTRY_HAS_INO) {
+            buf_ += ",\"ino\":";
+            appendUint(buf_, e.ino);
+        }
+        buf_ += "}\n";
+    }
+    spill();
+}
+
+void RecordWriter::entry(std::string_view prefix, std::string_view path, const EntryRecord &e) {
+    joined_.assign(prefix.data(), prefix.size());
+    joined_ += '/';
+    joined_.append(path.data(), path.size());
+    entry(joined_, e);
+}
+
+void RecordWriter::total(std::string_view path, std::uint64_t apparent, std::uint64_t allocated,
+                         std::uint64_t files, std::uint64_t dirs) {
+    if (format_ == OutputFormat::Binary) {
+        binary(RECORD_TOTAL, DT_DIR, 0, 0, path, apparent, allocated, files, dirs);
+    } else {
+        buf_ += "{\"kind\":\"total\",";
+        appendPath(buf_, path);
+        buf_ += ",\"apparent\":";
+        appendUint(buf_, apparent);
+        buf_ += ",\"allocated\":";
+        appendUint(buf_, allocated);
+        buf_ += ",\"files\":";
+        appendUint(buf_, files);
+        buf_ += ",\"dirs\":";
+        appendUint(buf_, dirs);
+        buf_ += "}\n";
+    }
+    spill();
+}
+
+void RecordWriter::error(std::string_view message) {
+    failed_ = true;
+    if (format_ == OutputFormat::Binary) {
+        binary(RECORD_ERROR, 0, 0, 0, message, 0, 0, 0, 0);
+    } else {
+        buf_ += "{\"kind\":\"error\",\"message\":";
+        appendString(buf_, message);
+        buf_ += "}\n";
+    }
+    spill();
+}
+
+void RecordWriter::drain() {
+    out_.write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+    buf_.clear();
+}
+
+void RecordWriter::flush() {
+    drain();
+    out_.flush();
+}
+
+void RecordWriter::finish() {
+    if (finished_) return;
+    finished_ = true;
+    std::uint16_t status = failed_ ? END_FAILED : JobContext::stopRequested() ? END_CANCELLED : END_COMPLETE;
+    if (format_ == OutputFormat::Binary) {
+        binary(RECORD_END, 0, status, 0, command_, entries_, 0, 0, 0);
+    } else {
+        buf_ += "{\"kind\":\"end\",\"command\":";
+        appendString(buf_, command_);
+        buf_ += ",\"entries\":";
+        appendUint(buf_, entries_);
+        buf_ += ",\"status\":\"";
+        buf_ += endStatusName(status);
+        buf_ += "\"}\n";
+    }
+    flush();
+}
@@ -0,0 +1,419 @@
+#include "Server.h"
+#include "CopyEngine.h"
+#include "DirReader.h"
+#include "DirSizeCache.h"
+#include "DirSnapshot.h"
+#include "DiskUsage.h"
+#include "FileSystem.h"
+#include "JobContext.h"
+#include "Protocol.h"
+#include "Trace.h"
+#include "WorkPool.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+using namespace Protocol;
+
+namespace {
+
+const std::size_t READ_CHUNK = 64 * 1024;
+const int MAX_EVENTS = 64;
+
+// Runs one request on a worker and returns its response frame.
+std::string handle(Op op, std::uint32_t id, Reader &in) {
+    auto error = [id](const std::string &message) {
+        Writer w(static_cast<std::uint8_t>(Status::Error), id);
+        w.str(message);
+        return w.finish();
+    };
+    Writer w(static_cast<std::uint8_t>(Status::Ok), id);
+
+    switch (op) {
+    case Op::ListDir: {
+        std::string path = in.str();
+        if (!in.ok()) break;
+        DirSnapshot snap;
+        if (!FileSystem::listDir(path, snap)) return error("Cannot open directory: " + path);
+        w.u32(static_cast<std::uint32_t>(snap.size()));
+        for (std::size_t i = 0; i < snap.size(); ++i) {
+            w.u8(snap.isDir(i));
+            w.i64(snap.fileSize(i));
+            w.i64(snap.mtimeNs(i));
+            std::string_view name = snap.name(i);
+            w.str(name.data(), name.size());
+        }
+        return w.finish();
+    }
+    case Op::Search: {
+        std::string path = in.str(), keyword = in.str();
+        if (!in.ok()) break;
+        if (!FileSystem::isDir(path)) return error("Not a directory: " + path);
+        std::vector<std::pair<std::string, bool>> hits;
+        FileSystem::search(path, keyword, hits);
+        w.u32(static_cast<std::uint32_t>(hits.size()));
+        for (const auto &hit : hits) {
+            w.u8(hit.second);
+            w.str(hit.first);
+        }
+        return w.finish();
+    }
+    case Op::DirSize: {
+        std::string path = in.str();
+        if (!in.ok()) break;
+        DuResult du = DiskUsage::scan(path);
+        if (!du.ok) return error("Cannot open directory: " + path);
+        if (JobContext::stopRequested()) return error("Cancelled");
+        w.u64(du.apparent);
+        w.u64(du.allocated);
+        w.u64(du.files);
+        w.u64(du.dirs);
+        return w.finish();
+    }
+    case Op::Stat: {
+        std::string path = in.str();
+        if (!in.ok()) break;
+        StatInfo st;
+        if (!statAt(AT_FDCWD, path.c_str(), STAT_TYPE | STAT_SIZE | STAT_MTIME | STAT_INO, st))
+            return error("Target not found: " + path);
+        w.u8(st.type);
+        w.u32(st.mode);
+        w.i64(st.size);
+        w.i64(st.mtimeNs);
+        w.u64(st.ino);
+        w.u64(st.nlink);
+        return w.finish();
+    }
+    case Op::Copy: {
+        std::string src = in.str(), dst = in.str();
+        bool overwrite = in.u8() != 0;
+        if (!in.ok()) break;
+        CopyReport report;
+        if (!FileSystem::copyFile(src, dst, overwrite, &report)) return error("Copy failed: " + src + " -> " + dst);
+        w.u64(report.bytes);
+        return w.finish();
+    }
+    case Op::Move: {
+        std::string src = in.str(), dst = in.str();
+        bool overwrite = in.u8() != 0;
+        if (!in.ok()) break;
+        dst = FileSystem::moveTarget(src, dst); // into an existing directory, as `mv` does
+        if (!FileSystem::move(src, dst, overwrite)) return error("Move failed: " + src + " -> " + dst);
+        return w.finish();
+    }
+    default:
+        return error("Unknown request " + std::to_string(static_cast<unsigned>(op)));
+    }
+    return error("Malformed request");
+}
+
+struct Connection
+{
+    int fd = -1;
+    std::uint64_t id = 0;
+    std::string in;  // bytes received, not yet parsed
+    std::string out; // responses not yet written
+    unsigned inFlight = 0;
+    bool peerClosed = false; // the client shut down its side; finish and close
+    bool wantWrite = false;  // responses are waiting for the socket to drain
+    std::uint32_t armed = EPOLLIN | EPOLLRDHUP; // events registered with epoll
+    JobContext job;          // cancelled when the connection goes away
+};
+
+class Daemon
+{
+public:
+    Daemon(int listenFd, int signalFd)
+        : listen_(listenFd), signals_(signalFd), epoll_(::epoll_create1(EPOLL_CLOEXEC)),
+          wake_(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+        unsigned threads = Server::DEFAULT_WORKERS;
+        if (const char *env = std::getenv("MFE_SERVER_THREADS")) {
+            int v = std::atoi(env);
+            if (v > 0) threads = static_cast<unsigned>(v);
+        }
+        workers_.reset(new WorkPool(threads));
+    }
+
+    ~Daemon() {
+        for (auto &kv : conns_) kv.second->job.cancel();
+        workers_.reset(); // joins the workers before the state they report to goes away
+        for (auto &kv : conns_)
+            if (kv.second->fd >= 0) ::close(kv.second->fd);
+        if (wake_ >= 0) ::close(wake_);
+        if (epoll_ >= 0) ::close(epoll_);
+    }
+
+    bool ok() const { return epoll_ >= 0 && wake_ >= 0; }
+
+    void loop() {
+        watch(listen_, EPOLLIN, LISTEN_KEY);
+        watch(signals_, EPOLLIN, SIGNAL_KEY);
+        watch(wake_, EPOLLIN, WAKE_KEY);
+
+        struct epoll_event events[MAX_EVENTS];
+        for (;;) {
+            int n = ::epoll_wait(epoll_, events, MAX_EVENTS, -1);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                std::perror("epoll_wait");
+                return;
+            }
+            for (int i = 0; i < n; ++i) {
+                std::uint64_t key = events[i].data.u64;
+                if (key == SIGNAL_KEY) return;
+                if (key == LISTEN_KEY) accept();
+                else if (key == WAKE_KEY) deliver();
+                else onClient(key, events[i].events);
+            }
+        }
+    }
+
+private:
+    static const std::uint64_t LISTEN_KEY = 0, SIGNAL_KEY = 1, WAKE_KEY = 2;
+
+    void watch(int fd, std::uint32_t events, std::uint64_t key) {
+        struct epoll_event ev = {};
+        ev.events = events;
+        ev.data.u64 = key;
+        ::epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    static bool accepting(const Connection &c) {
+        return c.inFlight < Server::MAX_IN_FLIGHT && c.out.size() < Server::MAX_PENDING_OUTPUT;
+    }
+
+    void rearm(Connection &c) {
+        // stop reading while the connection has its fill of requests in flight
+        // or of unsent responses, and for good once read() has seen the end of the
+        // stream; RDHUP goes with IN, since a shutdown arriving while reading is
+        // paused may still have requests queued ahead of it in the socket
+        bool reading = accepting(c) && c.in.size() < Server::MAX_PENDING_INPUT && !c.peerClosed;
+        std::uint32_t events = (reading ? EPOLLIN | EPOLLRDHUP : 0u) | (c.wantWrite ? EPOLLOUT : 0u);
+        if (events == c.armed) return;
+        c.armed = events;
+        struct epoll_event ev = {};
+        ev.events = events;
+        ev.data.u64 = c.id;
+        ::epoll_ctl(epoll_, EPOLL_CTL_MOD, c.fd, &ev);
+    }
+
+    void accept() {
+        for (;;) {
+            int fd = ::accept4(listen_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) return; // EAGAIN, or a client that gave up already
+            auto c = std::make_shared<Connection>();
+            c->fd = fd;
+            c->id = nextId_++;
+            conns_[c->id] = c;
+            watch(fd, EPOLLIN | EPOLLRDHUP, c->id);
+        }
+    }
+
+    void close(std::uint64_t id) {
+        auto it = conns_.find(id);
+        if (it == conns_.end()) return;
+        Connection &c = *it->second;
+        c.job.cancel(); // requests still running stop at their next directory or chunk
+        ::epoll_ctl(epoll_, EPOLL_CTL_DEL, c.fd, nullptr);
+        ::close(c.fd);
+        c.fd = -1;
+        conns_.erase(it); // workers still hold the connection until their request returns
+    }
+
+    void onClient(std::uint64_t id, std::uint32_t events) {
+        auto it = conns_.find(id);
+        if (it == conns_.end()) return;
+        std::shared_ptr<Connection> c = it->second;
+        if (events & (EPOLLERR | EPOLLHUP)) {
+            close(id);
+            return;
+        }
+        if (events & (EPOLLIN | EPOLLRDHUP)) {
+            char buf[READ_CHUNK];
+            for (;;) {
+                ssize_t n = ::read(c->fd, buf, sizeof(buf));
+                if (n > 0) {
+                    c->in.append(buf, static_cast<std::size_t>(n));
+                    if (c->in.size() >= Server::MAX_PENDING_INPUT) break; // the rest waits in the socket
+                    continue;
+                }
+                if (n == 0) c->peerClosed = true; // only once everything before the shutdown is read
+                break;
+            }
+        }
+        if (events & EPOLLOUT) flush(*c); // first: draining may let held-back frames through
+        if (!parse(c)) {
+            close(id);
+            return;
+        }
+        finishIfDone(*c);
+    }
+
+    // Dispatches the complete frames of `c`; false on a malformed stream.
+    bool parse(const std::shared_ptr<Connection> &c) {
+        std::size_t pos = 0;
+        while (accepting(*c) && c->in.size() - pos >= 4) {
+            std::uint32_t len;
+            std::memcpy(&len, c->in.data() + pos, sizeof(len));
+            if (len < HEADER - 4 || len > MAX_REQUEST) return false;
+            if (c->in.size() - pos - 4 < len) break;
+
+            Reader header(c->in.data() + pos + 4, HEADER - 4);
+            Op op = static_cast<Op>(header.u8());
+            std::uint32_t reqId = header.u32();
+            std::string body = c->in.substr(pos + HEADER, len - (HEADER - 4));
+            pos += 4 + len;
+
+            ++c->inFlight;
+            JobScope scope(&c->job); // the request and everything it spawns run under it
+            workers_->submit([this, c, op, reqId, body] {
+                TraceSpan span("request", "server");
+                Reader in(body.data(), body.size());
+                std::string response = handle(op, reqId, in);
+                std::lock_guard<std::mutex> lock(doneM_);
+                done_.emplace_back(c->id, std::move(response));
+                std::uint64_t one = 1;
+                ssize_t ignored = ::write(wake_, &one, sizeof(one));
+                (void)ignored;
+            });
+        }
+        c->in.erase(0, pos);
+        rearm(*c);
+        return true;
+    }
+
+    // Moves finished responses to their connections.
+    void deliver() {
+        std::uint64_t count;
+        ssize_t ignored = ::read(wake_, &count, sizeof(count));
+        (void)ignored;
+        std::vector<std::pair<std::uint64_t, std::string>> done;
+        {
+            std::lock_guard<std::mutex> lock(doneM_);
+            done.swap(done_);
+        }
+        for (auto &d : done) {
+            auto it = conns_.find(d.first);
+            if (it == conns_.end()) continue; // the client left
+            std::shared_ptr<Connection> c = it->second;
+            --c->inFlight;
+            c->out += d.second;
+            flush(*c);
+            if (c->fd >= 0 && !parse(c)) close(c->id); // frames held back by MAX_IN_FLIGHT or MAX_PENDING_OUTPUT
+            else finishIfDone(*c);
+        }
+    }
+
+    void flush(Connection &c) {
+        while (!c.out.empty()) {
+            // MSG_NOSIGNAL: a client that left mid-response is an EPIPE, not a SIGPIPE
+            ssize_t n = ::send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+            if (n <= 0) break;
+            c.out.erase(0, static_cast<std::size_t>(n));
+        }
+        c.wantWrite = !c.out.empty();
+        rearm(c); // also resumes reading once the backlog is under MAX_PENDING_OUTPUT
+    }
+
+    void finishIfDone(Connection &c) {
+        if (c.fd >= 0 && c.peerClosed && c.inFlight == 0 && c.out.empty()) close(c.id);
+    }
+
+    int listen_;
+    int signals_;
+    int epoll_;
+    int wake_; // eventfd the workers poke when a response is ready
+    std::unordered_map<std::uint64_t, std::shared_ptr<Connection>> conns_;
+    std::uint64_t nextId_ = 3; // after the fixed keys
+    std::mutex doneM_;
+    std::vector<std::pair<std::uint64_t, std::string>> done_;
+    std::unique_ptr<WorkPool> workers_; // last: destroyed first
+};
+
+// Binds `path`, replacing a stale socket left by a server that died.
+int listenOn(const std::string &path) {
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cout << "Socket path too long: " << path << "\n";
+        return -1;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    struct stat st;
+    if (::lstat(path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            std::cout << "Not a socket: " << path << "\n";
+            return -1;
+        }
+        int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool live = ::connect(probe, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == 0;
+        ::close(probe);
+        if (live) {
+            std::cout << "A server is already listening on " << path << "\n";
+            return -1;
+        }
+        ::unlink(path.c_str());
+    }
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    mode_t old = ::umask(0177); // owner only: requests run with this process's rights
+    bool bound = fd >= 0 && ::bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == 0;
+    ::umask(old);
+    if (!bound || ::listen(fd, SOMAXCONN) != 0) {
+        std::perror(path.c_str());
+        if (fd >= 0) ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+} // namespace
+
+int Server::run(const std::string &socketPath) {
+    // Blocked before any thread starts, so every thread inherits the mask and
+    // the signals are only ever seen through the signalfd.
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    ::pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+
+    int listenFd = listenOn(socketPath);
+    if (listenFd < 0) return 1;
+    int signalFd = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+    std::cout << "Serving on " << socketPath << " (Ctrl-C or SIGTERM stops)" << std::endl;
+    int status = 0;
+    {
+        Daemon daemon(listenFd, signalFd);
+        if (!daemon.ok() || signalFd < 0) {
+            std::perror("epoll");
+            status = 1;
+        } else {
+            daemon.loop();
+        }
+    }
+    ::close(listenFd);
+    if (signalFd >= 0) ::close(signalFd);
+    ::unlink(socketPath.c_str());
+    DirSizeCache::instance().save();
+    std::cout << "Server stopped" << std::endl;
+    return status;
+}
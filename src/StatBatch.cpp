@@ -0,0 +1,247 @@
+#include "StatBatch.h"
+#include "IoStats.h"
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+
+namespace {
+
+const unsigned RING_ENTRIES = 256;
+
+std::atomic<StatBackend> backend{StatBackend::Sync};
+// Cleared the first time a ring cannot be created or rejects IORING_OP_STATX.
+std::atomic<bool> uringUsable{true};
+
+// Minimal io_uring instance driven through the raw syscalls (no liburing).
+class Ring
+{
+public:
+    ~Ring() {
+        if (sqes_ != MAP_FAILED) ::munmap(sqes_, sqesSize_);
+        if (cq_ != MAP_FAILED && cq_ != sq_) ::munmap(cq_, cqSize_);
+        if (sq_ != MAP_FAILED) ::munmap(sq_, sqSize_);
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    bool init() {
+        struct io_uring_params p;
+        std::memset(&p, 0, sizeof(p));
+        fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, RING_ENTRIES, &p));
+        if (fd_ < 0) return false;
+
+        sqSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cqSize_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single) sqSize_ = cqSize_ = std::max(sqSize_, cqSize_);
+
+        sq_ = ::mmap(nullptr, sqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+        if (sq_ == MAP_FAILED) return false;
+        cq_ = single ? sq_
+                     : ::mmap(nullptr, cqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+        if (cq_ == MAP_FAILED) return false;
+        sqesSize_ = p.sq_entries * sizeof(struct io_uring_sqe);
+        sqes_ = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+        if (sqes_ == MAP_FAILED) return false;
+
+        char *sq = static_cast<char *>(sq_);
+        char *cq = static_cast<char *>(cq_);
+        sqHead_ = reinterpret_cast<unsigned *>(sq + p.sq_off.head);
+        sqTail_ = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+        sqMask_ = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+        sqArray_ = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+        cqHead_ = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+        cqTail_ = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+        cqMask_ = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+        entries_ = p.sq_entries;
+        return true;
+    }
+
+    unsigned entries() const { return entries_; }
+
+    // Queues one statx; the caller submits with submitAndWait().
+    void prepStatx(int dirfd, const char *path, int flags, unsigned mask, struct statx *buf, std::uint64_t tag) {
+        unsigned tail = *sqTail_;
+        unsigned idx = tail & sqMask_;
+        struct io_uring_sqe *sqe = static_cast<struct io_uring_sqe *>(sqes_) + idx;
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = dirfd;
+        sqe->addr = reinterpret_cast<std::uint64_t>(path);
+        sqe->len = mask;
+        sqe->off = reinterpret_cast<std::uint64_t>(buf);
+        sqe->statx_flags = static_cast<std::uint32_t>(flags);
+        sqe->user_data = tag;
+        sqArray_[idx] = idx;
+        __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+        ++queued_;
+    }
+
+    // Submits everything queued and blocks until all of it has completed.
+    // After an error, entries the kernel has not taken are withdrawn and those
+    // it has are still waited for, then false is returned; if that wait fails
+    // too, requests may still be writing into the caller's buffers, so the
+    // caller drops the ring (closing it cancels them) before freeing those.
+    template <typename OnComplete>
+    bool submitAndWait(OnComplete onComplete) {
+        unsigned toSubmit = queued_, outstanding = queued_;
+        queued_ = 0;
+        bool failed = false;
+        while (outstanding > 0) {
+            int n = static_cast<int>(::syscall(__NR_io_uring_enter, fd_, toSubmit, outstanding, IORING_ENTER_GETEVENTS, nullptr, 0));
+            ioCount(&IoCounters::ringEnters);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (failed) return false;
+                failed = true;
+                // without SQPOLL the kernel reads the queue only inside io_uring_enter
+                unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+                unsigned unsubmitted = *sqTail_ - head;
+                __atomic_store_n(sqTail_, head, __ATOMIC_RELEASE);
+                outstanding -= unsubmitted;
+                toSubmit = 0;
+                n = 0;
+            }
+            toSubmit -= std::min(toSubmit, static_cast<unsigned>(n));
+
+            unsigned head = *cqHead_;
+            unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                const struct io_uring_cqe &cqe = cqes_[head & cqMask_];
+                onComplete(cqe.user_data, cqe.res);
+                --outstanding;
+            }
+            __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+        }
+        return !failed;
+    }
+
+private:
+    int fd_ = -1;
+    void *sq_ = MAP_FAILED;
+    void *cq_ = MAP_FAILED;
+    void *sqes_ = MAP_FAILED;
+    std::size_t sqSize_ = 0, cqSize_ = 0, sqesSize_ = 0;
+    unsigned *sqHead_ = nullptr, *sqTail_ = nullptr, *sqArray_ = nullptr, sqMask_ = 0;
+    unsigned *cqHead_ = nullptr, *cqTail_ = nullptr, cqMask_ = 0;
+    struct io_uring_cqe *cqes_ = nullptr;
+    unsigned entries_ = 0;
+    unsigned queued_ = 0;
+};
+
+// One ring per thread: workers never share submission queues.
+std::unique_ptr<Ring> &threadRingSlot() {
+    thread_local std::unique_ptr<Ring> ring;
+    return ring;
+}
+
+Ring *threadRing() {
+    thread_local bool failed = false;
+    std::unique_ptr<Ring> &ring = threadRingSlot();
+    if (!ring && !failed) {
+        std::unique_ptr<Ring> r(new Ring);
+        if (r->init()) ring = std::move(r);
+        else {
+            failed = true;
+            uringUsable.store(false, std::memory_order_relaxed);
+        }
+    }
+    return ring.get();
+}
+
+} // namespace
+
+const char *statBackendName(StatBackend b) {
+    return b == StatBackend::Uring ? "uring" : "sync";
+}
+
+bool parseStatBackend(const std::string &name, StatBackend &out) {
+    if (name == "sync") out = StatBackend::Sync;
+    else if (name == "uring" || name == "io_uring") out = StatBackend::Uring;
+    else return false;
+    return true;
+}
+
+void setStatBackend(StatBackend b) {
+    backend.store(b, std::memory_order_relaxed);
+    if (b == StatBackend::Uring && !threadRing()) backend.store(StatBackend::Sync, std::memory_order_relaxed);
+}
+
+StatBackend statBackend() {
+    if (!uringUsable.load(std::memory_order_relaxed)) return StatBackend::Sync;
+    return backend.load(std::memory_order_relaxed);
+}
+
+StatBatch::StatBatch(int dirfd, unsigned fields, bool follow) : dirfd_(dirfd), fields_(fields), follow_(follow) {}
+
+std::size_t StatBatch::add(const char *name, std::size_t len) {
+    offsets_.push_back(static_cast<std::uint32_t>(names_.size()));
+    names_.append(name, len);
+    names_.push_back('\0');
+    return offsets_.size() - 1;
+}
+
+void StatBatch::clear() {
+    names_.clear();
+    offsets_.clear();
+    infos_.clear();
+    ok_.clear();
+}
+
+void StatBatch::run() {
+    infos_.assign(offsets_.size(), StatInfo());
+    ok_.assign(offsets_.size(), 0);
+    if (offsets_.empty()) return;
+
+    if (statBackend() == StatBackend::Uring && runUring()) return;
+    for (std::size_t i = 0; i < offsets_.size(); ++i)
+        ok_[i] = statAt(dirfd_, name(i), fields_, infos_[i], follow_);
+}
+
+bool StatBatch::runUring() {
+    Ring *ring = threadRing();
+    if (!ring) return false;
+
+    const int flags = AT_NO_AUTOMOUNT | (follow_ ? 0 : AT_SYMLINK_NOFOLLOW);
+    const unsigned mask = statxMask(fields_);
+    std::unique_ptr<struct statx[]> bufs(new struct statx[ring->entries()]);
+
+    for (std::size_t base = 0; base < offsets_.size(); base += ring->entries()) {
+        std::size_t n = std::min<std::size_t>(ring->entries(), offsets_.size() - base);
+        for (std::size_t j = 0; j < n; ++j)
+            ring->prepStatx(dirfd_, name(base + j), flags, mask, &bufs[j], j);
+
+        bool rejected = false;
+        bool ok = ring->submitAndWait([&](std::uint64_t j, int res) {
+            std::size_t i = base + static_cast<std::size_t>(j);
+            if (res == 0) {
+                fromStatx(bufs[j], infos_[i]);
+                ok_[i] = 1;
+            } else if (res == -EINVAL || res == -EOPNOTSUPP) {
+                rejected = true; // kernel without IORING_OP_STATX
+            }
+        });
+        ioCount(&IoCounters::ringStats, n);
+
+        if (!ok || rejected) {
+            uringUsable.store(false, std::memory_order_relaxed);
+            // closing the ring cancels whatever it still holds before `bufs` goes away
+            if (!ok) threadRingSlot().reset();
+            // finish this batch synchronously; earlier results stay valid
+            for (std::size_t i = base; i < offsets_.size(); ++i)
+                if (!ok_[i]) ok_[i] = statAt(dirfd_, name(i), fields_, infos_[i], follow_);
+            return true;
+        }
+    }
+    return true;
+}
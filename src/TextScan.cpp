@@ -0,0 +1,90 @@
+#include "TextScan.h"
+
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+bool isAlpha(unsigned char c) {
+    return c >= 'a' && c <= 'z';
+}
+
+template <bool Fold>
+inline unsigned char fold(unsigned char c) {
+    return Fold ? asciiLower(c) : c;
+}
+
+template <bool Fold>
+bool equalsAt(const char *hay, const char *needle, std::size_t m) {
+    for (std::size_t j = 0; j < m; ++j)
+        if (fold<Fold>(static_cast<unsigned char>(hay[j])) != static_cast<unsigned char>(needle[j]))
+            return false;
+    return true;
+}
+
+#ifdef __SSE2__
+// Bytes of `block` equal to `c`, ignoring ASCII case when folding. For a
+// lowercase letter, (x | 0x20) == c holds exactly for x == c and its uppercase form.
+template <bool Fold>
+inline __m128i matchByte(__m128i block, unsigned char c) {
+    if (Fold && isAlpha(c)) block = _mm_or_si128(block, _mm_set1_epi8(0x20));
+    return _mm_cmpeq_epi8(block, _mm_set1_epi8(static_cast<char>(c)));
+}
+#endif
+
+template <bool Fold>
+std::size_t find(const char *hay, std::size_t n, const char *needle, std::size_t m) {
+    if (m == 0) return 0;
+    if (m > n) return n;
+
+    const std::size_t last = n - m; // last valid start position
+    std::size_t i = 0;
+
+#ifdef __SSE2__
+    const unsigned char first = static_cast<unsigned char>(needle[0]);
+    const unsigned char tail = static_cast<unsigned char>(needle[m - 1]);
+    // Compare 16 start positions at once on the first and last needle byte,
+    // then verify only the positions where both match.
+    for (; i + 16 <= last + 1; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hay + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hay + i + m - 1));
+        unsigned mask = static_cast<unsigned>(
+            _mm_movemask_epi8(_mm_and_si128(matchByte<Fold>(a, first), matchByte<Fold>(b, tail))));
+        while (mask) {
+            unsigned bit = static_cast<unsigned>(__builtin_ctz(mask));
+            if (equalsAt<Fold>(hay + i + bit, needle, m)) return i + bit;
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; i <= last; ++i)
+        if (equalsAt<Fold>(hay + i, needle, m)) return i;
+    return n;
+}
+
+} // namespace
+
+std::string asciiLowerCopy(const std::string &s) {
+    std::string r = s;
+    for (auto &c : r) c = static_cast<char>(asciiLower(static_cast<unsigned char>(c)));
+    return r;
+}
+
+bool containsIgnoreCase(const char *hay, std::size_t n, const char *needleLower, std::size_t m) {
+    if (m == 0) return true;
+    return find<true>(hay, n, needleLower, m) != n;
+}
+
+std::size_t findSubstring(const char *hay, std::size_t n, const char *needle, std::size_t m, bool ignoreCase) {
+    if (ignoreCase) return find<true>(hay, n, needle, m);
+    // a single byte is what memchr is tuned for
+    if (m == 1) {
+        const void *hit = std::memchr(hay, needle[0], n);
+        return hit ? static_cast<std::size_t>(static_cast<const char *>(hit) - hay) : n;
+    }
+    return find<false>(hay, n, needle, m);
+}
@@ -0,0 +1,106 @@
+#include "TopN.h"
+#include "DiskUsage.h"
+#include "JobContext.h"
+#include "Trace.h"
+#include "TreeWalk.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <tuple>
+
+namespace {
+
+struct Slot
+{
+    std::uint64_t size;
+    std::uint64_t dev;
+    std::uint64_t ino; // 0 for directories and singly-linked files
+    std::string path;
+};
+
+bool smaller(const Slot &a, const Slot &b) { return a.size > b.size; } // heap order: smallest on top
+
+// The n largest entries offered so far. Once full, `floor_` is the size of
+// the smallest kept entry; offers not above it are turned away without the
+// lock and before the caller pays for a path.
+class BoundedHeap
+{
+public:
+    explicit BoundedHeap(std::size_t n) : n_(n) {} // grows with what is offered, never to n up front
+
+    bool wants(std::uint64_t size) const { return size > floor_.load(std::memory_order_relaxed); }
+
+    void offer(Slot slot) {
+        std::lock_guard<std::mutex> lock(m_);
+        if (!wants(slot.size)) return;
+        if (slot.ino) {
+            // another name of a hard-linked file already kept
+            for (const Slot &s : heap_)
+                if (s.ino == slot.ino && s.dev == slot.dev) return;
+        }
+        heap_.push_back(std::move(slot));
+        std::push_heap(heap_.begin(), heap_.end(), smaller);
+        if (heap_.size() > n_) {
+            std::pop_heap(heap_.begin(), heap_.end(), smaller);
+            heap_.pop_back();
+        }
+        if (heap_.size() == n_) floor_.store(heap_.front().size, std::memory_order_relaxed);
+    }
+
+    // Largest first, ties by path.
+    std::vector<TopEntry> take() {
+        std::sort(heap_.begin(), heap_.end(), [](const Slot &a, const Slot &b) {
+            return std::tie(b.size, a.path) < std::tie(a.size, b.path);
+        });
+        std::vector<TopEntry> entries;
+        entries.reserve(heap_.size());
+        for (Slot &s : heap_) entries.push_back({s.size, std::move(s.path)});
+        heap_.clear();
+        return entries;
+    }
+
+private:
+    std::size_t n_;
+    std::atomic<std::uint64_t> floor_{0};
+    std::mutex m_;
+    std::vector<Slot> heap_;
+};
+
+} // namespace
+
+TopStats TopN::scan(const std::string &root, std::size_t n, bool allocated, std::vector<TopEntry> &files,
+                    std::vector<TopEntry> &dirs) {
+    TraceSpan span("top");
+    auto t0 = std::chrono::steady_clock::now();
+    TopStats stats;
+    if (n == 0) n = 1;
+
+    BoundedHeap topFiles(n), topDirs(n);
+    int which = allocated ? 1 : 0;
+    DuResult du = DiskUsage::scan(
+        root,
+        [&](const WalkDir &dir, const char *name, const StatInfo &st) {
+            std::uint64_t size = allocated ? st.blocks * 512ULL : static_cast<std::uint64_t>(st.size);
+            if (!topFiles.wants(size)) return;
+            topFiles.offer({size, st.dev, st.nlink > 1 ? st.ino : 0, dir.childPath(name)});
+        },
+        [&](const WalkDir &dir) {
+            if (dir.depth == 0) return; // the root is the total
+            std::uint64_t size = dir.sum[which].load(std::memory_order_relaxed);
+            if (topDirs.wants(size)) topDirs.offer({size, 0, 0, dir.path});
+        });
+    if (!du.ok) return stats;
+
+    stats.ok = true;
+    stats.total = allocated ? du.allocated : du.apparent;
+    stats.files = du.files;
+    stats.dirs = du.dirs;
+    stats.errors = du.errors;
+    stats.cancelled = JobContext::stopRequested();
+    files = topFiles.take();
+    dirs = topDirs.take();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return stats;
+}
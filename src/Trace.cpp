@@ -0,0 +1,125 @@
+#include "Trace.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+
+namespace {
+
+// The file is a JSON array written incrementally; the closing bracket is
+// added at exit, and the trace viewers also accept a file cut short.
+class TraceFile
+{
+public:
+    static TraceFile &instance() {
+        static TraceFile *file = new TraceFile; // never destroyed: the atexit hook still needs it
+        return *file;
+    }
+
+    bool enabled() const { return out_ != nullptr; }
+
+    void write(const std::string &event) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::fputs(first_ ? "[\n" : ",\n", out_);
+        std::fputs(event.c_str(), out_);
+        first_ = false;
+    }
+
+    void flush() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::fflush(out_);
+    }
+
+private:
+    TraceFile() {
+        const char *path = std::getenv("MFE_TRACE");
+        if (!path || !*path) return;
+        out_ = std::fopen(path, "w");
+        if (!out_) {
+            std::perror(path);
+            return;
+        }
+        std::atexit([] { instance().close(); });
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::fputs(first_ ? "[]\n" : "\n]\n", out_);
+        std::fclose(out_);
+        out_ = nullptr;
+    }
+
+    std::FILE *out_ = nullptr;
+    std::mutex mutex_;
+    bool first_ = true;
+};
+
+void appendEscaped(std::string &out, const std::string &s) {
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+}
+
+long threadId() {
+    thread_local long tid = ::syscall(SYS_gettid);
+    return tid;
+}
+
+} // namespace
+
+bool Trace::enabled() {
+    static const bool on = TraceFile::instance().enabled();
+    return on;
+}
+
+std::int64_t Trace::nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::complete(const std::string &name, const char *category, std::int64_t startUs,
+                     std::int64_t durationUs, const std::string &args) {
+    if (!enabled()) return;
+    std::string event = "{\"name\":\"";
+    appendEscaped(event, name);
+    event += "\",\"cat\":\"";
+    event += category;
+    event += "\",\"ph\":\"X\",\"ts\":" + std::to_string(startUs) + ",\"dur\":" + std::to_string(durationUs) +
+             ",\"pid\":" + std::to_string(::getpid()) + ",\"tid\":" + std::to_string(threadId());
+    if (!args.empty()) event += ",\"args\":{" + args + "}";
+    event += "}";
+    TraceFile::instance().write(event);
+}
+
+void Trace::flush() {
+    if (enabled()) TraceFile::instance().flush();
+}
+
+TraceSpan::TraceSpan(const char *name, const char *category)
+    : on_(Trace::enabled()), category_(category) {
+    if (!on_) return;
+    name_ = name;
+    start_ = Trace::nowUs();
+}
+
+TraceSpan::TraceSpan(std::string name, const char *category)
+    : on_(Trace::enabled()), name_(std::move(name)), category_(category) {
+    if (on_) start_ = Trace::nowUs();
+}
+
+TraceSpan::~TraceSpan() {
+    if (on_) Trace::complete(name_, category_, start_, Trace::nowUs() - start_, args_);
+}
@@ -0,0 +1,400 @@
+#include "TreeCopy.h"
+#include "CopyEngine.h"
+#include "DirReader.h"
+#include "DiskUsage.h"
+#include "JobContext.h"
+#include "Trace.h"
+#include "TreeRemove.h"
+#include "WorkPool.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+const std::size_t BATCH_FILES = 32;
+// A task stops taking files from its batch once it has this many bytes to copy.
+const std::uint64_t BATCH_BYTES = 1 << 20;
+
+// A source directory and its copy, open for as long as batches still need them.
+struct DirPair
+{
+    int src = -1;
+    int dst = -1;
+    ~DirPair() {
+        if (src >= 0) ::close(src);
+        if (dst >= 0) ::close(dst);
+    }
+};
+
+struct DirMeta
+{
+    std::string rel; // relative to the target root, "." for the root
+    mode_t mode;
+    struct timespec times[2]; // atime, mtime
+};
+
+struct Counters
+{
+    std::atomic<std::uint64_t> files{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> errors{0};
+    std::atomic<std::uint64_t> skipped{0};
+};
+
+// How the pipeline treats what already exists in the target.
+struct Mode
+{
+    bool overwrite = false;   // replace existing files
+    bool sync = false;        // skip files whose size and mtime already match
+    bool deleteExtra = false; // sync: remove target entries the source lacks
+    bool dryRun = false;      // sync: count instead of writing
+};
+
+struct timespec toTimespec(std::int64_t ns) {
+    struct timespec ts;
+    ts.tv_sec = static_cast<time_t>(ns / 1000000000LL);
+    ts.tv_nsec = static_cast<long>(ns % 1000000000LL);
+    return ts;
+}
+
+// `starting` gets the file's size once it is open, before any data moves.
+void copyOne(const DirPair &dir, const std::string &name, const Mode &mode, Counters &counters,
+             const std::function<void(std::uint64_t)> &starting) {
+    if (JobContext::stopRequested()) return;
+    if (mode.sync) {
+        // the comparison runs here on the worker, in parallel like the copies
+        StatInfo from, to;
+        if (!statAt(dir.src, name.c_str(), STAT_SIZE | STAT_MTIME, from, false)) {
+            counters.errors.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        bool present = dir.dst >= 0 && statAt(dir.dst, name.c_str(), STAT_TYPE | STAT_SIZE | STAT_MTIME, to, false);
+        if (present && to.type == DT_REG && to.size == from.size && to.mtimeNs == from.mtimeNs) {
+            counters.skipped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (mode.dryRun) {
+            counters.files.fetch_add(1, std::memory_order_relaxed);
+            counters.bytes.fetch_add(static_cast<std::uint64_t>(from.size), std::memory_order_relaxed);
+            return;
+        }
+    }
+
+    int in = ::openat(dir.src, name.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (in < 0) {
+        counters.errors.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    struct stat st{};
+    if (::fstat(in, &st) != 0) {
+        ::close(in);
+        counters.errors.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    starting(static_cast<std::uint64_t>(st.st_size));
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC | (mode.overwrite ? 0 : O_EXCL);
+    int out = ::openat(dir.dst, name.c_str(), flags, st.st_mode & 07777);
+    if (out < 0 && errno == EACCES && mode.sync) {
+        // a read-only copy from an earlier run: replace it rather than write into it
+        ::unlinkat(dir.dst, name.c_str(), 0);
+        out = ::openat(dir.dst, name.c_str(), flags | O_EXCL, st.st_mode & 07777);
+    }
+    if (out < 0) {
+        ::close(in);
+        counters.errors.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    CopyReport report;
+    bool ok = CopyEngine::copyData(in, out, static_cast<std::uint64_t>(st.st_size), report);
+    if (ok) {
+        ::fchmod(out, st.st_mode & 07777);
+        struct timespec times[2] = {st.st_atim, st.st_mtim};
+        ::futimens(out, times);
+    }
+    ok = (::close(out) == 0) && ok;
+    ::close(in);
+
+    if (ok) {
+        counters.files.fetch_add(1, std::memory_order_relaxed);
+        counters.bytes.fetch_add(report.bytes, std::memory_order_relaxed);
+    } else {
+        ::unlinkat(dir.dst, name.c_str(), 0);
+        counters.errors.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+class Copier
+{
+public:
+    Copier(const Mode &mode, const std::string &dstRoot) : mode_(mode), dstRoot_(dstRoot) {}
+
+    void walk(const std::shared_ptr<DirPair> &dir, const std::string &rel) {
+        std::vector<std::string> batch;
+        std::vector<std::string> subdirs;
+
+        // sync: target entries not matched by a source entry yet, with their types
+        std::unordered_map<std::string, unsigned char> extra;
+        if (mode_.sync && dir->dst >= 0) readTarget(dir->dst, extra);
+
+        {
+            // scoped so its buffer is freed before the recursion below, not held once per level
+            DirReader reader(dir->src);
+            DirEntry entry;
+            while (reader.next(entry)) {
+                if (JobContext::stopRequested()) return;
+                unsigned char type = resolveType(dir->src, entry, false);
+                if (!extra.empty()) {
+                    auto it = extra.find(std::string(entry.name, entry.nameLen));
+                    if (it != extra.end()) {
+                        // a file where the source has a directory (or the reverse) is replaced
+                        if (it->second != type) removeTarget(*dir, rel, it->first, it->second);
+                        extra.erase(it);
+                    }
+                }
+                if (type == DT_REG) {
+                    batch.emplace_back(entry.name, entry.nameLen);
+                    if (batch.size() == BATCH_FILES) submit(dir, batch);
+                } else if (type == DT_DIR) {
+                    subdirs.emplace_back(entry.name, entry.nameLen);
+                } else if (type == DT_LNK) {
+                    copyLink(*dir, entry.name);
+                } else {
+                    counters_.errors.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+        if (!batch.empty()) submit(dir, batch);
+
+        if (mode_.deleteExtra)
+            for (const auto &kv : extra) removeTarget(*dir, rel, kv.first, kv.second);
+        extra.clear();
+
+        for (const std::string &name : subdirs) {
+            auto child = std::make_shared<DirPair>();
+            if (!makeDir(*dir, name, rel == "." ? name : rel + "/" + name, *child)) {
+                counters_.errors.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            walk(child, rel == "." ? name : rel + "/" + name);
+        }
+    }
+
+    // Opens src/name, creates dst/name and records its metadata for the final pass.
+    bool makeDir(const DirPair &parent, const std::string &name, const std::string &rel, DirPair &child) {
+        child.src = ::openat(parent.src, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (child.src < 0) return false;
+        return createTarget(parent.dst, name, rel, child);
+    }
+
+    // `top.src` is the source root itself; the target root is `name` under `top.dst`.
+    bool makeRoot(const DirPair &top, const std::string &name, DirPair &root) {
+        root.src = ::dup(top.src);
+        if (root.src < 0) return false;
+        return createTarget(top.dst, name, ".", root);
+    }
+
+    void finish(int dstRoot) {
+        group_.wait();
+        if (mode_.dryRun) return;
+        // children before parents, so setting a directory's times is the last change to it
+        for (auto it = dirs_.rbegin(); it != dirs_.rend(); ++it) {
+            ::fchmodat(dstRoot, it->rel.c_str(), it->mode, 0);
+            ::utimensat(dstRoot, it->rel.c_str(), it->times, AT_SYMLINK_NOFOLLOW);
+        }
+    }
+
+    Counters counters_;
+    std::uint64_t symlinks_ = 0;
+    std::uint64_t deleted_ = 0;
+    std::vector<DirMeta> dirs_;
+
+private:
+    bool createTarget(int dstParent, const std::string &name, const std::string &rel, DirPair &child) {
+        StatInfo st;
+        if (!statAt(child.src, "", STAT_TYPE | STAT_MTIME | STAT_ATIME, st)) return false;
+
+        if (mode_.dryRun) {
+            // compare against the directory if it exists; otherwise everything below is new
+            if (dstParent >= 0)
+                child.dst = ::openat(dstParent, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            dirs_.push_back({rel, 0, {}});
+            return true;
+        }
+
+        // owner-writable until the final pass restores the real mode
+        if (::mkdirat(dstParent, name.c_str(), 0700) != 0 && !(mode_.overwrite && errno == EEXIST)) return false;
+        child.dst = ::openat(dstParent, name.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        if (child.dst < 0) return false;
+
+        dirs_.push_back({rel, static_cast<mode_t>(st.mode & 07777), {toTimespec(st.atimeNs), toTimespec(st.mtimeNs)}});
+        return true;
+    }
+
+    void submit(const std::shared_ptr<DirPair> &dir, std::vector<std::string> &batch) {
+        // keep the walker from racing arbitrarily far ahead of the copiers
+        WorkPool &pool = group_.pool();
+        while (pool.queued() > pool.threads() * 8) {
+            if (!pool.tryRunOne()) std::this_thread::yield();
+        }
+
+        auto names = std::make_shared<const std::vector<std::string>>(std::move(batch));
+        group_.run([this, dir, names] { copyBatch(dir, names, 0); });
+        batch.clear();
+    }
+
+    // Copies names[first..]. The batch is cut by count when it is built and
+    // by bytes here, where the sizes are known: before a file that is large
+    // by itself or brings the task past BATCH_BYTES, the rest of the batch
+    // becomes a new task, so small files never wait behind a big copy.
+    void copyBatch(const std::shared_ptr<DirPair> &dir, const std::shared_ptr<const std::vector<std::string>> &names,
+                   std::size_t first) {
+        std::uint64_t bytes = 0;
+        std::size_t i = first;
+        bool handedOff = false;
+        auto starting = [&](std::uint64_t size) {
+            bytes += size;
+            if (bytes <= BATCH_BYTES || handedOff || i + 1 >= names->size()) return;
+            handedOff = true;
+            std::size_t rest = i + 1;
+            group_.run([this, dir, names, rest] { copyBatch(dir, names, rest); });
+        };
+        for (; i < names->size() && !handedOff; ++i) copyOne(*dir, (*names)[i], mode_, counters_, starting);
+    }
+
+    void copyLink(const DirPair &dir, const char *name) {
+        char target[4096];
+        ssize_t n = ::readlinkat(dir.src, name, target, sizeof(target) - 1);
+        if (n < 0) {
+            counters_.errors.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        target[n] = '\0';
+        if (mode_.sync && dir.dst >= 0) {
+            char current[4096];
+            ssize_t m = ::readlinkat(dir.dst, name, current, sizeof(current));
+            if (m == n && std::memcmp(current, target, static_cast<std::size_t>(n)) == 0) {
+                counters_.skipped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+        if (mode_.dryRun) {
+            ++symlinks_;
+            return;
+        }
+        if (mode_.overwrite) ::unlinkat(dir.dst, name, 0);
+        if (::symlinkat(target, dir.dst, name) != 0) {
+            counters_.errors.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        StatInfo st;
+        if (statAt(dir.src, name, STAT_MTIME | STAT_ATIME, st, false)) {
+            struct timespec times[2] = {toTimespec(st.atimeNs), toTimespec(st.mtimeNs)};
+            ::utimensat(dir.dst, name, times, AT_SYMLINK_NOFOLLOW);
+        }
+        ++symlinks_;
+    }
+
+    static void readTarget(int fd, std::unordered_map<std::string, unsigned char> &out) {
+        DirReader reader(fd);
+        DirEntry entry;
+        while (reader.next(entry)) out.emplace(std::string(entry.name, entry.nameLen), resolveType(fd, entry, false));
+    }
+
+    // Deletes (or, in a dry run, counts) `name` in the target directory of `dir`.
+    void removeTarget(const DirPair &dir, const std::string &rel, const std::string &name, unsigned char type) {
+        if (type != DT_DIR) {
+            if (mode_.dryRun || ::unlinkat(dir.dst, name.c_str(), 0) == 0) ++deleted_;
+            else counters_.errors.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::string path = dstRoot_ + "/" + (rel == "." ? name : rel + "/" + name);
+        if (mode_.dryRun) {
+            DuResult du = DiskUsage::scan(path, false);
+            deleted_ += du.files + du.dirs + 1;
+            return;
+        }
+        TreeRemoveStats removed = TreeRemove::remove(path);
+        deleted_ += removed.files + removed.dirs;
+        counters_.errors.fetch_add(removed.errors, std::memory_order_relaxed);
+    }
+
+    Mode mode_;
+    std::string dstRoot_;
+    TaskGroup group_;
+};
+
+TreeCopyStats run(const std::string &src, const std::string &dst, const Mode &mode) {
+    TraceSpan span(mode.sync ? "sync" : "copy");
+    auto t0 = std::chrono::steady_clock::now();
+    TreeCopyStats stats;
+
+    // the target root is created through the same path as any subdirectory
+    std::string target = dst;
+    while (target.size() > 1 && target.back() == '/') target.pop_back();
+    std::string parent = ".", name = target;
+    std::size_t slash = target.find_last_of('/');
+    if (slash != std::string::npos) {
+        parent = slash == 0 ? "/" : target.substr(0, slash);
+        name = target.substr(slash + 1);
+    }
+
+    // the source root is opened as ".", under its parent and the target's parent
+    DirPair top;
+    top.src = ::open(src.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    top.dst = ::open(parent.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (top.src < 0 || top.dst < 0 || name.empty()) return stats;
+
+    Copier copier(mode, target);
+    auto root = std::make_shared<DirPair>();
+    if (!copier.makeRoot(top, name, *root)) return stats;
+
+    int dstRoot = root->dst >= 0 ? ::dup(root->dst) : -1;
+    copier.walk(root, ".");
+    root.reset();
+    copier.finish(dstRoot);
+    if (dstRoot >= 0) ::close(dstRoot);
+
+    stats.ok = true;
+    stats.cancelled = JobContext::stopRequested();
+    stats.files = copier.counters_.files.load();
+    stats.bytes = copier.counters_.bytes.load();
+    stats.errors = copier.counters_.errors.load();
+    stats.skipped = copier.counters_.skipped.load();
+    stats.deleted = copier.deleted_;
+    stats.dirs = copier.dirs_.size();
+    stats.symlinks = copier.symlinks_;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return stats;
+}
+
+} // namespace
+
+TreeCopyStats TreeCopy::copy(const std::string &src, const std::string &dst, bool overwrite) {
+    Mode mode;
+    mode.overwrite = overwrite;
+    return run(src, dst, mode);
+}
+
+TreeCopyStats TreeCopy::sync(const std::string &src, const std::string &dst, const SyncOptions &options) {
+    Mode mode;
+    mode.overwrite = true;
+    mode.sync = true;
+    mode.deleteExtra = options.deleteExtra;
+    mode.dryRun = options.dryRun;
+    return run(src, dst, mode);
+}
@@ -0,0 +1,133 @@
+#include "TreeRemove.h"
+#include "JobContext.h"
+#include "Trace.h"
+#include "TreeWalk.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+const std::size_t BATCH_FILES = 256;
+const std::int64_t PROGRESS_INTERVAL_NS = 200 * 1000 * 1000;
+
+std::int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct RemoveDir : WalkDir
+{
+    std::vector<std::string> batch; // entries read but not yet unlinked
+};
+
+class Remover : public TreeVisitor
+{
+public:
+    explicit Remover(const TreeRemove::Progress &progress) : progress_(progress), lastReport_(nowNs()) {}
+
+    std::shared_ptr<WalkDir> makeDir() override { return std::make_shared<RemoveDir>(); }
+
+    bool visit(TreeWalk &walk, WalkDir &dir, const DirEntry &entry, unsigned char type) override {
+        if (type == DT_DIR) return true;
+        auto &d = static_cast<RemoveDir &>(dir);
+        d.batch.emplace_back(entry.name, entry.nameLen);
+        if (d.batch.size() == BATCH_FILES) flush(walk, d);
+        return false;
+    }
+
+    void entriesDone(TreeWalk &walk, WalkDir &dir) override {
+        auto &d = static_cast<RemoveDir &>(dir);
+        if (!d.batch.empty()) flush(walk, d);
+    }
+
+    void leaveDir(TreeWalk &, WalkDir &dir) override {
+        // a directory that could not be opened was already counted by the walk
+        if (dir.fd < 0 || JobContext::stopRequested()) return;
+        int parentFd = dir.parent ? dir.parent->fd : AT_FDCWD;
+        if (::unlinkat(parentFd, dir.name.c_str(), AT_REMOVEDIR) == 0)
+            dirs_.fetch_add(1, std::memory_order_relaxed);
+        else
+            errors_.fetch_add(1, std::memory_order_relaxed);
+        report();
+    }
+
+    std::atomic<std::uint64_t> files_{0};
+    std::atomic<std::uint64_t> dirs_{0};
+    std::atomic<std::uint64_t> errors_{0};
+
+private:
+    void flush(TreeWalk &walk, RemoveDir &dir) {
+        auto self = std::static_pointer_cast<RemoveDir>(dir.shared_from_this());
+        walk.spawn(self, [this, self, names = std::move(dir.batch)] { unlinkAll(*self, names); });
+        dir.batch.clear();
+    }
+
+    void unlinkAll(const WalkDir &dir, const std::vector<std::string> &names) {
+        std::uint64_t removed = 0, failed = 0;
+        for (const std::string &name : names) {
+            if (JobContext::stopRequested()) break;
+            if (::unlinkat(dir.fd, name.c_str(), 0) == 0) ++removed;
+            else ++failed;
+        }
+        files_.fetch_add(removed, std::memory_order_relaxed);
+        errors_.fetch_add(failed, std::memory_order_relaxed);
+        report();
+    }
+
+    void report() {
+        if (!progress_) return;
+        std::int64_t now = nowNs();
+        if (now - lastReport_.load(std::memory_order_relaxed) < PROGRESS_INTERVAL_NS) return;
+        std::unique_lock<std::mutex> lock(progressM_, std::try_to_lock);
+        if (!lock) return;
+        lastReport_.store(now, std::memory_order_relaxed);
+        progress_(files_.load(std::memory_order_relaxed), dirs_.load(std::memory_order_relaxed));
+    }
+
+    const TreeRemove::Progress &progress_;
+    std::atomic<std::int64_t> lastReport_;
+    std::mutex progressM_;
+};
+
+} // namespace
+
+TreeRemoveStats TreeRemove::remove(const std::string &path, const Progress &progress) {
+    TraceSpan span("remove");
+    auto t0 = std::chrono::steady_clock::now();
+    TreeRemoveStats stats;
+
+    std::string root = path;
+    while (root.size() > 1 && root.back() == '/') root.pop_back();
+
+    struct stat st{};
+    if (::lstat(root.c_str(), &st) != 0) return stats;
+
+    if (!S_ISDIR(st.st_mode)) {
+        // a file or a symlink (even one pointing at a directory) is just unlinked
+        stats.ok = true;
+        if (::unlink(root.c_str()) == 0) stats.files = 1;
+        else stats.errors = 1;
+    } else {
+        Remover remover(progress);
+        TreeWalk walk(remover);
+        if (!walk.run(root)) return stats;
+
+        stats.ok = true;
+        stats.files = remover.files_.load();
+        stats.dirs = remover.dirs_.load();
+        stats.errors = remover.errors_.load() + walk.errors();
+    }
+
+    stats.cancelled = JobContext::stopRequested();
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    span.setArgs("\"files\":" + std::to_string(stats.files) + ",\"dirs\":" + std::to_string(stats.dirs));
+    return stats;
+}
@@ -0,0 +1,149 @@
+#include "TreeWalk.h"
+#include "IoStats.h"
+#include "JobContext.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+namespace {
+
+// Each in-flight directory keeps its fd open; lift the soft limit once.
+void raiseFdLimit() {
+    static bool done = [] {
+        struct rlimit rl{};
+        if (::getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+            rl.rlim_cur = rl.rlim_max;
+            ::setrlimit(RLIMIT_NOFILE, &rl);
+        }
+        return true;
+    }();
+    (void)done;
+}
+
+void closeFd(int &fd) {
+    if (fd < 0) return;
+    ::close(fd);
+    ioCount(&IoCounters::closes);
+    fd = -1;
+}
+
+} // namespace
+
+WalkDir::~WalkDir() {
+    closeFd(fd);
+}
+
+std::string WalkDir::childPath(const char *child) const {
+    if (path.empty()) return child;
+    std::string p;
+    p.reserve(path.size() + 1 + std::char_traits<char>::length(child));
+    p += path;
+    p += '/';
+    p += child;
+    return p;
+}
+
+TreeWalk::TreeWalk(TreeVisitor &visitor, WorkPool &pool)
+    : visitor_(visitor), job_(JobContext::current()), group_(pool) {
+    raiseFdLimit();
+}
+
+bool TreeWalk::run(const std::string &root) {
+    int fd = ::openat(AT_FDCWD, root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    ioCount(&IoCounters::opens);
+    if (fd < 0) return false;
+
+    root_ = visitor_.makeDir();
+    root_->fd = fd;
+    root_->name = root;
+    walkDir(root_);
+    group_.wait();
+    return true;
+}
+
+void TreeWalk::descend(const std::shared_ptr<WalkDir> &parent, const std::string &name) {
+    std::shared_ptr<WalkDir> child = visitor_.makeDir();
+    child->name = name;
+    child->path = parent->childPath(name.c_str());
+    child->depth = parent->depth + 1;
+    child->parent = parent;
+    parent->pending.fetch_add(1, std::memory_order_relaxed);
+
+    // Spread work while other workers may be idle; past that, recurse inline
+    // (depth-first) so open fds stay proportional to depth x threads.
+    WorkPool &pool = group_.pool();
+    if (pool.queued() < pool.threads() * 2)
+        group_.run([this, child] { walkDir(child); });
+    else
+        walkDir(child);
+}
+
+void TreeWalk::spawn(const std::shared_ptr<WalkDir> &dir, WorkPool::Task task) {
+    WorkPool &pool = group_.pool();
+    if (pool.queued() >= pool.threads() * 8) {
+        task();
+        return;
+    }
+    dir->pending.fetch_add(1, std::memory_order_relaxed);
+    group_.run([this, dir, task = std::move(task)] {
+        task();
+        finish(dir);
+    });
+}
+
+void TreeWalk::walkDir(const std::shared_ptr<WalkDir> &dir) {
+    if (job_ && job_->cancelled()) {
+        finish(dir);
+        return;
+    }
+    if (dir->fd < 0) {
+        dir->fd = ::openat(dir->parent->fd, dir->name.c_str(),
+                           O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        ioCount(&IoCounters::opens);
+    }
+
+    if (dir->fd < 0) {
+        errors_.fetch_add(1, std::memory_order_relaxed);
+    } else if (visitor_.enterDir(*this, *dir)) {
+        std::vector<std::string> subdirs;
+        {
+            DirReader reader(dir->fd);
+            DirEntry entry;
+            while (reader.next(entry)) {
+                unsigned char type = resolveType(dir->fd, entry, false);
+                if (type == DT_UNKNOWN) {
+                    errors_.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                if (visitor_.visit(*this, *dir, entry, type) && type == DT_DIR)
+                    subdirs.emplace_back(entry.name, entry.nameLen);
+            }
+            if (reader.failed()) {
+                dir->incomplete = true;
+                errors_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        visitor_.entriesDone(*this, *dir);
+        for (auto &name : subdirs) descend(dir, name);
+    }
+
+    finish(dir);
+}
+
+void TreeWalk::finish(std::shared_ptr<WalkDir> dir) {
+    while (dir) {
+        if (dir->pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+
+        visitor_.leaveDir(*this, *dir);
+        std::shared_ptr<WalkDir> parent = std::move(dir->parent);
+        if (parent) {
+            for (int i = 0; i < 2; ++i)
+                parent->sum[i].fetch_add(dir->sum[i].load(std::memory_order_relaxed),
+                                         std::memory_order_relaxed);
+        }
+        closeFd(dir->fd);
+        dir = std::move(parent);
+    }
+}
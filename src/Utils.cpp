@@ -1,5 +1,9 @@
 #include "Utils.h"
 #include <sstream>
+#include <iomanip>
+#include <ctime>
+#include <cstdlib>
+#include <sys/stat.h>
 
 std::vector<std::string> split(const std::string& input) {
     std::stringstream ss(input);
@@ -11,3 +15,42 @@ std::vector<std::string> split(const std::string& input) {
 
     return res;
 }
+
+std::string cacheDir() {
+    std::string dir;
+    if (const char* env = std::getenv("MFE_CACHE_DIR")) {
+        dir = env;
+    } else {
+        if (const char* xdg = std::getenv("XDG_CACHE_HOME")) dir = xdg;
+        else if (const char* home = std::getenv("HOME")) dir = std::string(home) + "/.cache";
+        else dir = "/tmp";
+        ::mkdir(dir.c_str(), 0755);
+        dir += "/minifileexplorer";
+    }
+    ::mkdir(dir.c_str(), 0755);
+    return dir;
+}
+
+std::string formatTime(std::int64_t epochNs) {
+    // localtime_r: unlike localtime it does not re-stat /etc/localtime on every call
+    std::tm tm{};
+    std::time_t t = static_cast<std::time_t>(epochNs / 1000000000LL);
+    ::localtime_r(&t, &tm);
+
+    char buf[32];
+    std::size_t n = std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    return std::string(buf, n);
+}
+
+std::string formatBytes(std::uint64_t b) {
+    const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+    double v = static_cast<double>(b);
+    int u = 0;
+    while (v >= 1024 && u < 4) {
+        v /= 1024;
+        ++u;
+    }
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(u == 0 ? 0 : 1) << v << units[u];
+    return out.str();
+}
@@ -0,0 +1,140 @@
+#include "WorkPool.h"
+#include "JobContext.h"
+
+#include <chrono>
+#include <cstdlib>
+
+namespace {
+thread_local WorkPool *tlsPool = nullptr;
+thread_local int tlsWorker = -1;
+
+void runTask(WorkPool::Task &task) {
+    try {
+        task();
+    } catch (...) {
+        // a failing task must not take the worker down
+    }
+}
+} // namespace
+
+WorkPool::WorkPool(unsigned threads) {
+    if (threads == 0) threads = 1;
+    for (unsigned i = 0; i < threads; ++i) queues_.emplace_back(new Queue);
+    for (unsigned i = 0; i < threads; ++i) threads_.emplace_back([this, i] { loop(i); });
+}
+
+WorkPool::~WorkPool() {
+    {
+        std::lock_guard<std::mutex> lk(sleepM_);
+        stop_ = true;
+    }
+    sleepCv_.notify_all();
+    for (auto &t : threads_) t.join();
+}
+
+WorkPool &WorkPool::shared() {
+    // intentionally leaked: workers may still be parked when exit() runs
+    static WorkPool *pool = [] {
+        unsigned n = std::thread::hardware_concurrency();
+        if (n < 4) n = 4;
+        if (const char *env = std::getenv("MFE_THREADS")) {
+            int v = std::atoi(env);
+            if (v > 0) n = static_cast<unsigned>(v);
+        }
+        return new WorkPool(n);
+    }();
+    return *pool;
+}
+
+void WorkPool::submit(Task task) {
+    unsigned idx = (tlsPool == this && tlsWorker >= 0)
+                       ? static_cast<unsigned>(tlsWorker)
+                       : next_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    {
+        std::lock_guard<std::mutex> lk(queues_[idx]->m);
+        queues_[idx]->tasks.push_back({std::move(task), JobContext::current()});
+    }
+    queued_.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lk(sleepM_);
+    }
+    sleepCv_.notify_one();
+}
+
+bool WorkPool::take(int self, Item &item) {
+    if (self >= 0) {
+        Queue &own = *queues_[self];
+        std::lock_guard<std::mutex> lk(own.m);
+        if (!own.tasks.empty()) {
+            item = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    const std::size_t n = queues_.size();
+    const std::size_t start = self >= 0 ? static_cast<std::size_t>(self) + 1 : 0;
+    for (std::size_t i = 0; i < n; ++i) {
+        Queue &victim = *queues_[(start + i) % n];
+        std::lock_guard<std::mutex> lk(victim.m);
+        if (!victim.tasks.empty()) {
+            item = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool WorkPool::tryRunOne() {
+    Item item;
+    if (!take(tlsPool == this ? tlsWorker : -1, item)) return false;
+    JobScope scope(item.job);
+    runTask(item.task);
+    return true;
+}
+
+void WorkPool::loop(unsigned index) {
+    tlsPool = this;
+    tlsWorker = static_cast<int>(index);
+
+    for (;;) {
+        Item item;
+        if (take(static_cast<int>(index), item)) {
+            JobScope scope(item.job);
+            runTask(item.task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lk(sleepM_);
+        sleepCv_.wait(lk, [this] { return stop_ || queued_.load(std::memory_order_relaxed) > 0; });
+        if (stop_ && queued_.load(std::memory_order_relaxed) == 0) return;
+    }
+}
+
+TaskGroup::TaskGroup(WorkPool &pool) : pool_(pool) {}
+
+TaskGroup::~TaskGroup() {
+    wait();
+}
+
+void TaskGroup::run(WorkPool::Task task) {
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    pool_.submit([this, task = std::move(task)]() mutable {
+        runTask(task);
+        // decrement under the lock so wait() cannot return (and destroy us) mid-notify
+        std::lock_guard<std::mutex> lk(m_);
+        if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1) cv_.notify_all();
+    });
+}
+
+void TaskGroup::wait() {
+    while (pending_.load(std::memory_order_acquire) > 0) {
+        if (pool_.tryRunOne()) continue;
+        std::unique_lock<std::mutex> lk(m_);
+        cv_.wait_for(lk, std::chrono::milliseconds(1),
+                     [this] { return pending_.load(std::memory_order_acquire) == 0; });
+    }
+    std::lock_guard<std::mutex> lk(m_);
+}
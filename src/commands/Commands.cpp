@@ -1,10 +1,33 @@
 #include "commands/Commands.h"
 #include "MiniFileExplorer.h"
 #include "FileSystem.h"
+#include "DirSnapshot.h"
+#include "ListSort.h"
+#include "Manifest.h"
+#include "IoStats.h"
+#include "DiskUsage.h"
+#include "DirSizeCache.h"
+#include "DirWatch.h"
+#include "ListingCache.h"
+#include "Dupes.h"
+#include "FileIndex.h"
+#include "Find.h"
+#include "RecordWriter.h"
+#include "Grep.h"
+#include "CopyEngine.h"
+#include "TreeCopy.h"
+#include "TreeRemove.h"
+#include "TopN.h"
+#include "CommandStats.h"
+#include "Trace.h"
+#include "JobContext.h"
+#include "Jobs.h"
+#include "Utils.h"
 
 #include <iostream>
 #include <iomanip>
 #include <unistd.h>
+#include <dirent.h>
 #include <sys/stat.h>
 #include <ctime>
 #include <sstream>
@@ -14,38 +37,108 @@
 #include <system_error>
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <memory>
+
+// Commands print through out(): std::cout, or the capture buffer of the
+// background job they run in.
+static std::ostream &out()
+{
+    return JobContext::output();
+}
+
+// Under --format=ndjson|bin the listing commands write records instead of
+// text, errors included.
+static bool structuredOutput()
+{
+    return outputFormat() != OutputFormat::Text;
+}
+
+// Reports why a listing command could not run: one line of text, or an
+// error record followed by the command's end record.
+static void fail(const char *command, const std::string &message)
+{
+    if (!structuredOutput())
+    {
+        out() << message << "\n";
+        return;
+    }
+    RecordWriter records(out(), outputFormat(), command);
+    records.error(message);
+}
+
+// A path argument as an absolute path. Relative ones name entries under the
+// session's directory: a background job keeps the directory it started in,
+// while the process cwd follows every later cd.
+static std::filesystem::path inCurrentDir(const MiniFileExplorer &app, const std::string &arg)
+{
+    std::filesystem::path p(arg);
+    return p.is_absolute() ? p : std::filesystem::path(app.getCurrentDir()) / p;
+}
 
 // ----------------- Command Implementations -----------------
 
 static void cmd_help()
 {
-    std::cout << "\n=== MiniFileExplorer Commands ===\n"
-              << std::endl;
-    std::cout << "Core Commands:" << std::endl;
-    std::cout << "  ls [options]       - List contents of current directory" << std::endl;
-    std::cout << "                     - Options: -s (sort by size), -t (sort by time)" << std::endl;
-    std::cout << "  cd [path]          - Change current directory (e.g., cd ../docs)" << std::endl;
-    std::cout << "  touch [filename]   - Create an empty file" << std::endl;
-    std::cout << "  mkdir [dirname]    - Create a new directory" << std::endl;
-    std::cout << "  rm [filename]      - Delete a file (with confirmation)" << std::endl;
-    std::cout << "  rmdir [dirname]    - Delete an empty directory" << std::endl;
-    std::cout << "  stat [name]        - Show detailed information of a file or directory" << std::endl;
-    std::cout << std::endl;
-    std::cout << "Advanced Commands:" << std::endl;
-    std::cout << "  search [keyword]   - Search files and directories recursively" << std::endl;
-    std::cout << "  cp [src] [dst]     - Copy file from src to dst" << std::endl;
-    std::cout << "  mv [src] [dst]     - Move or rename file or directory" << std::endl;
-    std::cout << "  du [dirname]       - Show total size of directory" << std::endl;
-    std::cout << std::endl;
-    std::cout << "System:" << std::endl;
-    std::cout << "  help               - Show this help message" << std::endl;
-    std::cout << "  exit               - Exit MiniFileExplorer" << std::endl;
-    std::cout << std::endl;
+    out() << "\n=== MiniFileExplorer Commands ===\n"
+          << "\n";
+    out() << "Core Commands:\n";
+    out() << "  ls [options]       - List contents of current directory\n";
+    out() << "                     - Options: -s (sort by size), -t (sort by time)\n";
+    out() << "                     - -v (natural name order), -X (sort by extension)\n";
+    out() << "                     - --syscalls (report syscalls used vs. readdir + stat)\n";
+    out() << "  cd [path]          - Change current directory (e.g., cd ../docs)\n";
+    out() << "  touch [filename]   - Create an empty file\n";
+    out() << "  mkdir [dirname]    - Create a new directory\n";
+    out() << "  rm [-r] [name]     - Delete a file, or a directory tree with -r (one confirmation)\n";
+    out() << "  rmdir [dirname]    - Delete an empty directory\n";
+    out() << "  stat [name]        - Show detailed information of a file or directory\n";
+    out() << "\n";
+    out() << "Advanced Commands:\n";
+    out() << "  search [keyword]   - Search files and directories recursively\n";
+    out() << "                     - Uses a file index when one covers the directory (--no-index to walk)\n";
+    out() << "  find [dir] [predicates] - Find entries matching every predicate:\n";
+    out() << "                     - -name/-iname GLOB, -regex/-iregex RE (on the name), -type f|d|l\n";
+    out() << "                     - -size [+-]N[c|k|M|G], -mtime [+-]N[s|m|h|d], -mindepth N, -maxdepth N\n";
+    out() << "                     - -exclude GLOB (directories not entered)\n";
+    out() << "  grep [-i] [-l] [text] [path] - Search file contents for a fixed string (binary files skipped)\n";
+    out() << "  index [action] [dir] - Filename index: build, update (rescan changed dirs), status, drop\n";
+    out() << "  cp [-r] [src] [dst] - Copy a file, or a directory tree with -r\n";
+    out() << "  sync [-n] [--delete] [src] [dst] - Mirror a tree, copying only files whose size or mtime differ\n";
+    out() << "                     - -n (dry run: report what would be copied), --delete (remove extra files)\n";
+    out() << "  mv [src] [dst]     - Move or rename file or directory\n";
+    out() << "  du [-A] [dirname]  - Show total size of directory (-A: allocated blocks)\n";
+    out() << "                     - --no-cache (ignore the directory size cache)\n";
+    out() << "  dupes [dir]        - Find files with identical contents and the space they waste\n";
+    out() << "  top [-n N] [-A] [dir] - The N largest files and directories (default 10, at most 100000) in one walk\n";
+    out() << "  snapshot save [dir] [file] - Write a manifest of a tree (path, size, mtime, inode, mode)\n";
+    out() << "  snapshot diff [--full] [file] [dir|file] - Added, removed and modified entries since a manifest\n";
+    out() << "                     - unchanged directories are not re-read unless --full\n";
+    out() << "  watch [-r] [-t secs] [dir] - Stream creates, deletes, changes and moves as they happen\n";
+    out() << "                     - -r (subdirectories too), -t (stop after secs); Ctrl-C stops\n";
+    out() << "  cache [clear|on|off] - Show directory size and listing cache hit rates, or clear them\n";
+    out() << "                     - on/off: reuse directory sizes in du and ls -s (off by default: edits\n";
+    out() << "                       inside a file do not invalidate them)\n";
+    out() << "  stats [cmd|clear|on|off] - Per-command time, CPU, entries, bytes and syscalls this session\n";
+    out() << "                     - with a latency histogram; on/off prints a summary after each command\n";
+    out() << "\n";
+    out() << "Jobs:\n";
+    out() << "  [command] &        - Run a command in the background (e.g., du /data &)\n";
+    out() << "  jobs               - List jobs with elapsed time and progress\n";
+    out() << "  fg [id]            - Wait for a job and show its output (Ctrl-C cancels it)\n";
+    out() << "  kill [id]          - Cancel a job at its next directory or copy chunk\n";
+    out() << "\n";
+    out() << "System:\n";
+    out() << "  help               - Show this help message\n";
+    out() << "  exit               - Exit MiniFileExplorer\n";
+    out() << "\n";
 }
 
 static void cmd_exit()
 {
-    std::cout << "MiniFileExplorer closed successfully\n";
+    out() << "MiniFileExplorer closed successfully\n";
     std::exit(0);
 }
 
@@ -53,7 +146,7 @@ static void cmd_cd(MiniFileExplorer &app, const std::vector<std::string> &args)
 {
     if (args.size() < 2)
     {
-        std::cout << "Usage: cd [path]\n";
+        out() << "Usage: cd [path]\n";
         return;
     }
 
@@ -61,13 +154,13 @@ static void cmd_cd(MiniFileExplorer &app, const std::vector<std::string> &args)
 
     if (!FileSystem::exists(path))
     {
-        std::cout << "Invalid directory: " << path << "\n";
+        out() << "Invalid directory: " << path << "\n";
         return;
     }
 
     if (!FileSystem::isDir(path))
     {
-        std::cout << "Not a directory: " << path << "\n";
+        out() << "Not a directory: " << path << "\n";
         return;
     }
 
@@ -84,183 +177,271 @@ static void cmd_cd(MiniFileExplorer &app, const std::vector<std::string> &args)
 
 // directory size calculation moved to FileSystem::calcDirSize
 
-static void cmd_ls(MiniFileExplorer &app, const std::vector<std::string> &args)
+// Streaming ls sizes the name column from the first batch, capped here;
+// longer names later in the listing push their row out instead.
+static const size_t LS_MAX_STREAM_WIDTH = 40;
+
+static void printLsHeader(size_t nameWidth)
 {
-    auto files = FileSystem::listDir(app.getCurrentDir());
+    out() << std::left << std::setw(nameWidth + 2) << "Name"
+          << std::setw(8) << "Type"
+          << std::setw(10) << "Size(B)"
+          << "Modify Time" << "\n";
+    out() << std::string(nameWidth + 2 + 8 + 10 + 20, '-') << "\n";
+}
 
-    // determine mode: normal / -s (size) / -t (time)
-    bool sortSize = false, sortTime = false;
-    if (args.size() > 1)
+static void printLsRow(const DirSnapshot &snap, size_t i, const std::string &size, size_t nameWidth)
+{
+    std::string name(snap.name(i));
+    if (snap.isDir(i))
+        name += "/";
+    out() << std::left << std::setw(nameWidth + 2) << name
+          << std::setw(8) << (snap.isDir(i) ? "Dir" : "File")
+          << std::setw(10) << size
+          << snap.mtimeString(i) << "\n";
+}
+
+// A listing row as a record; directories carry a size only when -s measured it.
+// The type is the entry's own (l for a symlink), the size and mtime its target's.
+static EntryRecord lsRecord(const DirSnapshot &snap, size_t i, const std::uint64_t *dirSize)
+{
+    EntryRecord e;
+    e.type = snap.type(i);
+    e.fields = ENTRY_HAS_MTIME;
+    e.mtimeNs = snap.mtimeNs(i);
+    if (!snap.isDir(i) || dirSize)
+    {
+        e.fields |= ENTRY_HAS_SIZE;
+        e.size = snap.isDir(i) ? static_cast<std::int64_t>(*dirSize) : snap.fileSize(i);
+    }
+    return e;
+}
+
+static void cmd_ls(MiniFileExplorer &app, const std::vector<std::string> &args)
+{
+    // determine mode: normal / -s (size) / -t (time) / -v (natural name) / -X (extension),
+    // --syscalls reports the listing cost
+    bool sorted = false, showSyscalls = false;
+    ListOrder order = ListOrder::Name;
+    for (size_t i = 1; i < args.size(); ++i)
     {
-        if (args[1] == "-s")
-            sortSize = true;
-        else if (args[1] == "-t")
-            sortTime = true;
+        if (args[i] == "-s")
+            sorted = true, order = ListOrder::Size;
+        else if (args[i] == "-t")
+            sorted = true, order = ListOrder::Time;
+        else if (args[i] == "-v")
+            sorted = true, order = ListOrder::Name;
+        else if (args[i] == "-X")
+            sorted = true, order = ListOrder::Extension;
+        else if (args[i] == "--syscalls")
+            showSyscalls = true;
     }
+    bool sortSize = sorted && order == ListOrder::Size;
+    std::unique_ptr<RecordWriter> records;
+    if (structuredOutput())
+        records.reset(new RecordWriter(out(), outputFormat(), "ls"));
 
-    size_t nameWidth = 0;
-    for (auto &f : files)
-        nameWidth = std::max(nameWidth, f.name.size());
+    IoSnapshot before = ioSnapshot();
+    IoSnapshot cost;
 
-    // Prepare auxiliary data for sorting
-    struct Row
+    if (!sorted)
     {
-        FileInfo info;
-        unsigned long long compSize;
-        std::time_t mtime_epoch;
-    };
-    std::vector<Row> rows;
-    rows.reserve(files.size());
-    for (auto &f : files)
-    {
-        Row r;
-        r.info = f;
-        r.compSize = 0;
-        r.mtime_epoch = 0;
-        std::string entryPath = app.getCurrentDir() + "/" + f.name;
-        if (sortSize)
-        {
-            if (f.isDir)
+        // unsorted: print each batch as soon as it has been stat'ed
+        bool started = false;
+        size_t nameWidth = 0;
+        FileSystem::listDir(app.getCurrentDir(), [&](const DirSnapshot &batch)
+                            {
+            TraceSpan span("print");
+            if (records)
             {
-                r.compSize = FileSystem::calcDirSize(entryPath);
+                for (size_t i = 0; i < batch.size(); ++i)
+                    records->entry(batch.name(i), lsRecord(batch, i, nullptr));
+                records->flush();
+                return;
             }
-            else
+            if (!started)
             {
-                r.compSize = (f.size < 0) ? 0 : static_cast<unsigned long long>(f.size);
+                for (size_t i = 0; i < batch.size(); ++i)
+                    nameWidth = std::max(nameWidth, batch.name(i).size());
+                nameWidth = std::min(nameWidth, LS_MAX_STREAM_WIDTH);
+                printLsHeader(nameWidth);
+                started = true;
             }
-        }
-        if (sortTime)
-        {
-            struct stat st{};
-            if (::stat(entryPath.c_str(), &st) == 0)
-                r.mtime_epoch = st.st_mtime;
-        }
-        rows.push_back(std::move(r));
-    }
-
-    if (sortSize)
-    {
-        std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b)
-                  {
-            // empty directories go last
-            bool aEmptyDir = a.info.isDir && a.compSize == 0;
-            bool bEmptyDir = b.info.isDir && b.compSize == 0;
-            if (aEmptyDir != bEmptyDir) return !aEmptyDir; // non-empty (or file) first
-            if (a.compSize != b.compSize) return a.compSize > b.compSize; // desc
-            return a.info.name < b.info.name; });
+            for (size_t i = 0; i < batch.size(); ++i)
+                printLsRow(batch, i, batch.isDir(i) ? "-" : std::to_string(batch.fileSize(i)), nameWidth);
+            out().flush(); });
+        cost = ioSnapshot() - before;
+        if (!started && !records)
+            printLsHeader(0);
     }
-    else if (sortTime)
+    else
     {
-        std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b)
-                  {
-            if (a.mtime_epoch != b.mtime_epoch) return a.mtime_epoch > b.mtime_epoch; // desc
-            return a.info.name < b.info.name; });
-    }
+        DirSnapshot files;
+        FileSystem::listDir(app.getCurrentDir(), files);
+        cost = ioSnapshot() - before;
 
-    // Print header
-    std::cout << std::left << std::setw(nameWidth + 2) << "Name"
-              << std::setw(8) << "Type"
-              << std::setw(10) << "Size(B)"
-              << "Modify Time" << "\n";
+        size_t nameWidth = 0;
+        for (size_t i = 0; i < files.size(); ++i)
+            nameWidth = std::max(nameWidth, files.name(i).size());
 
-    // Separator
-    std::cout << std::string(nameWidth + 2 + 8 + 10 + 20, '-') << "\n";
-
-    if (sortSize || sortTime)
-    {
-        for (auto &r : rows)
+        // directories are measured for -s; every other key is already in the snapshot
+        std::vector<std::uint64_t> sizes;
+        if (sortSize)
         {
-            auto &f = r.info;
-            std::string name = f.name + (f.isDir ? "/" : "");
-            std::string type = f.isDir ? "Dir" : "File";
-            std::string size = "-";
-            if (sortSize)
+            TraceSpan span("calcDirSize");
+            sizes.resize(files.size());
+            for (size_t i = 0; i < files.size() && !JobContext::stopRequested(); ++i)
             {
-                if (f.isDir)
-                {
-                    if (r.compSize == 0)
-                        size = "-";
-                    else
-                        size = std::to_string(r.compSize);
-                }
+                if (files.isDir(i))
+                    sizes[i] = FileSystem::calcDirSize(app.getCurrentDir() + "/" + std::string(files.name(i)));
                 else
-                {
-                    size = std::to_string(f.size);
-                }
+                    sizes[i] = (files.fileSize(i) < 0) ? 0 : static_cast<std::uint64_t>(files.fileSize(i));
             }
-            else
+            DirSizeCache::instance().save();
+            if (JobContext::stopRequested())
             {
-                size = f.isDir ? "-" : std::to_string(f.size);
+                if (!records)
+                    out() << "Cancelled\n";
+                return;
             }
+        }
 
-            std::cout << std::left << std::setw(nameWidth + 2) << name
-                      << std::setw(8) << type
-                      << std::setw(10) << size
-                      << f.mtime << "\n";
+        std::vector<std::uint32_t> rows;
+        {
+            TraceSpan span("sort");
+            rows = sortListing(files, order, sortSize ? &sizes : nullptr);
         }
-    }
-    else
-    {
-        for (auto &f : files)
+
+        TraceSpan span("print");
+        if (records)
         {
-            std::string name = f.name + (f.isDir ? "/" : "");
-            std::string type = f.isDir ? "Dir" : "File";
-            std::string size = f.isDir ? "-" : std::to_string(f.size);
-
-            std::cout << std::left << std::setw(nameWidth + 2) << name
-                      << std::setw(8) << type
-                      << std::setw(10) << size
-                      << f.mtime << "\n";
+            for (std::uint32_t i : rows)
+                records->entry(files.name(i), lsRecord(files, i, sortSize ? &sizes[i] : nullptr));
+            return;
+        }
+        printLsHeader(nameWidth);
+        for (std::uint32_t i : rows)
+        {
+            std::string size = "-";
+            if (!files.isDir(i))
+                size = std::to_string(files.fileSize(i));
+            else if (sortSize && sizes[i] != 0)
+                size = std::to_string(sizes[i]);
+            printLsRow(files, i, size, nameWidth);
         }
     }
+
+    if (showSyscalls && !records)
+    {
+        unsigned long long legacy = cost.legacySyscalls();
+        unsigned long long used = cost.syscalls();
+        out() << "\nSyscalls: " << used
+              << " (open " << cost.opens << ", getdents " << cost.getdents
+              << ", stat " << cost.stats << ", d_type only " << cost.statsSkipped << ")\n";
+        if (cost.ringStats > 0)
+            out() << "io_uring: " << cost.ringStats << " statx in " << cost.ringEnters << " submissions\n";
+        out() << "readdir + stat(path) estimate: " << legacy
+              << ", saved: " << (legacy > used ? legacy - used : 0) << "\n";
+    }
 }
 
-static void cmd_touch(const std::vector<std::string> &args)
+static void cmd_touch(MiniFileExplorer &app, const std::vector<std::string> &args)
 {
     if (args.size() < 2)
     {
-        std::cout << "Usage: touch <filename>\n";
+        out() << "Usage: touch <filename>\n";
         return;
     }
 
-    if (FileSystem::exists(args[1]))
+    std::string path = inCurrentDir(app, args[1]).string();
+    if (FileSystem::exists(path))
     {
-        std::cout << "File already exists: " << args[1] << "\n";
+        out() << "File already exists: " << args[1] << "\n";
         return;
     }
 
-    if (!FileSystem::createFile(args[1]))
-        std::cout << "Failed to create file: " << args[1] << "\n";
+    if (!FileSystem::createFile(path))
+        out() << "Failed to create file: " << args[1] << "\n";
 }
 
-static void cmd_mkdir(const std::vector<std::string> &args)
+static void cmd_mkdir(MiniFileExplorer &app, const std::vector<std::string> &args)
 {
     if (args.size() < 2)
     {
-        std::cout << "Usage: mkdir <dirname>\n";
+        out() << "Usage: mkdir <dirname>\n";
+        return;
+    }
+
+    std::string path = inCurrentDir(app, args[1]).string();
+    if (FileSystem::exists(path))
+    {
+        out() << "Directory already exists: " << args[1] << "\n";
+        return;
+    }
+
+    if (!FileSystem::createDir(path))
+        out() << "Failed to create directory: " << args[1] << "\n";
+}
+
+static void cmd_rm_tree(MiniFileExplorer &app, const std::string &path, const std::string &shown)
+{
+    // refuse "/" and anything the shell is standing in
+    char realTarget[PATH_MAX];
+    if (::realpath(path.c_str(), realTarget))
+    {
+        std::string t(realTarget), cur = app.getCurrentDir();
+        if (t == "/" || cur == t || cur.compare(0, t.size() + 1, t + "/") == 0)
+        {
+            out() << "Refusing to remove " << shown << ": it contains the current directory\n";
+            return;
+        }
+    }
+
+    if (!app.confirm(MiniFileExplorer::Confirm::Delete, "Remove " + shown + " and everything under it? (y/n):"))
         return;
+
+    // a live counter only on an interactive terminal; jobs and batch runs get the summary
+    bool live = !app.isBatch() && &out() == &std::cout && ::isatty(STDOUT_FILENO);
+    bool shownProgress = false;
+    TreeRemove::Progress progress;
+    if (live)
+    {
+        progress = [&shownProgress](std::uint64_t files, std::uint64_t dirs) {
+            std::cout << "\rRemoving... " << files << " files, " << dirs << " dirs" << std::flush;
+            shownProgress = true;
+        };
     }
 
-    if (FileSystem::exists(args[1]))
+    TreeRemoveStats stats = TreeRemove::remove(path, progress);
+    if (shownProgress)
+        out() << "\r\033[K";
+    if (!stats.ok)
     {
-        std::cout << "Directory already exists: " << args[1] << "\n";
+        out() << "Failed to remove " << shown << "\n";
         return;
     }
 
-    if (!FileSystem::createDir(args[1]))
-        std::cout << "Failed to create directory: " << args[1] << "\n";
+    out() << "Removed " << stats.files << " files, " << stats.dirs << " dirs in " << std::fixed
+          << std::setprecision(3) << stats.seconds << "s\n";
+    if (stats.cancelled)
+        out() << "Cancelled; " << shown << " was partly removed\n";
+    else if (stats.errors)
+        out() << stats.errors << " entries could not be removed\n";
 }
 
 static void cmd_rm(MiniFileExplorer &app, const std::vector<std::string> &args)
 {
-    if (args.size() < 2)
+    bool recursive = args.size() > 1 && args[1] == "-r";
+    std::size_t first = recursive ? 2 : 1;
+    if (args.size() < first + 1)
     {
-        std::cout << "Usage: rm <filename>\n";
+        out() << "Usage: rm [-r] <name>\n";
         return;
     }
+    const std::string &name = args[first];
     namespace fs = std::filesystem;
 
-    fs::path inPath(args[1]);
+    fs::path inPath(name);
     fs::path absPath;
     if (inPath.is_absolute())
     {
@@ -272,82 +453,87 @@ static void cmd_rm(MiniFileExplorer &app, const std::vector<std::string> &args)
     }
     std::string absStr = absPath.string();
 
-    if (!FileSystem::exists(absStr))
+    struct stat st;
+    if (::lstat(absStr.c_str(), &st) != 0)
     {
-        std::cout << "File not found: " << args[1] << "\n";
+        out() << "File not found: " << name << "\n";
         return;
     }
 
-    // If the target is a directory, rm should not prompt: instruct to use rmdir
-    if (FileSystem::isDir(absStr))
+    if (S_ISDIR(st.st_mode))
     {
-        std::cout << "Is a directory: " << args[1] << " (use rmdir to remove directories)" << std::endl;
+        if (!recursive)
+        {
+            out() << "Is a directory: " << name << " (use rm -r, or rmdir for an empty directory)\n";
+            return;
+        }
+        cmd_rm_tree(app, absStr, name);
         return;
     }
 
-    std::cout << "Are you sure to delete " << args[1] << "? (y/n): ";
-    std::string ans;
-    std::getline(std::cin, ans);
-
-    if (ans != "y")
+    if (!app.confirm(MiniFileExplorer::Confirm::Delete, "Are you sure to delete " + name + "? (y/n):"))
         return;
 
     if (!FileSystem::removeFile(absStr))
-        std::cout << "Failed to delete file: " << args[1] << "\n";
+        out() << "Failed to delete file: " << name << "\n";
 }
 
-static void cmd_rmdir(const std::vector<std::string> &args)
+static void cmd_rmdir(const MiniFileExplorer &app, const std::vector<std::string> &args)
 {
     if (args.size() < 2)
     {
-        std::cout << "Usage: rmdir <dirname>\n";
+        out() << "Usage: rmdir <dirname>\n";
         return;
     }
 
     std::string dir = args[1];
+    std::string path = inCurrentDir(app, dir).string();
 
-    if (!FileSystem::exists(dir))
+    if (!FileSystem::exists(path))
     {
-        std::cout << "Directory not found: " << dir << "\n";
+        out() << "Directory not found: " << dir << "\n";
         return;
     }
 
-    if (!FileSystem::isDir(dir))
+    if (!FileSystem::isDir(path))
     {
-        std::cout << "Not a directory: " << dir << "\n";
+        out() << "Not a directory: " << dir << "\n";
         return;
     }
 
-    if (!FileSystem::isEmptyDir(dir))
+    if (!FileSystem::isEmptyDir(path))
     {
-        std::cout << "Directory not empty: " << dir << "\n";
+        out() << "Directory not empty: " << dir << "\n";
         return;
     }
 
-    if (!FileSystem::removeDir(dir))
-        std::cout << "Failed to remove directory: " << dir << "\n";
+    if (!FileSystem::removeDir(path))
+        out() << "Failed to remove directory: " << dir << "\n";
 }
 
-static void cmd_stat(const std::vector<std::string> &args)
+static void cmd_stat(const MiniFileExplorer &app, const std::vector<std::string> &args)
 {
     if (args.size() < 2)
     {
-        std::cout << "Missing target: Please enter 'stat [name]'" << std::endl;
+        fail("stat", "Missing target: Please enter 'stat [name]'");
         return;
     }
 
-    const std::string path = args[1];
+    const std::string path = inCurrentDir(app, args[1]).string();
 
     if (!FileSystem::exists(path))
     {
-        std::cout << "Target not found: " << path << std::endl;
+        fail("stat", "Target not found: " + args[1]);
         return;
     }
 
     struct stat st{};
     if (::stat(path.c_str(), &st) != 0)
     {
-        perror("stat");
+        if (structuredOutput())
+            fail("stat", "stat: " + std::string(std::strerror(errno)));
+        else
+            perror("stat");
         return;
     }
 
@@ -362,6 +548,19 @@ static void cmd_stat(const std::vector<std::string> &args)
     else
         fullpath = path;
 
+    if (structuredOutput())
+    {
+        EntryRecord e;
+        e.type = IFTODT(st.st_mode);
+        e.fields = ENTRY_HAS_SIZE | ENTRY_HAS_MTIME | ENTRY_HAS_MODE | ENTRY_HAS_INO;
+        e.mode = st.st_mode;
+        e.size = st.st_size;
+        e.mtimeNs = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+        e.ino = st.st_ino;
+        RecordWriter(out(), outputFormat(), "stat").entry(fullpath, e);
+        return;
+    }
+
     std::string size = is_dir ? "-" : std::to_string(static_cast<long long>(st.st_size));
 
     auto fmt = [](time_t t) -> std::string
@@ -374,61 +573,319 @@ static void cmd_stat(const std::vector<std::string> &args)
         return oss.str();
     };
 
-    std::cout << "=== File/Directory Information ===" << std::endl;
-    std::cout << "Type: " << type << std::endl;
-    std::cout << "Path: " << fullpath << std::endl;
-    std::cout << "Size(B): " << size << std::endl;
-    std::cout << "Creation Time: " << fmt(st.st_ctime) << std::endl;
-    std::cout << "Modification Time: " << fmt(st.st_mtime) << std::endl;
-    std::cout << "Access Time: " << fmt(st.st_atime) << std::endl;
+    out() << "=== File/Directory Information ===\n";
+    out() << "Type: " << type << "\n";
+    out() << "Path: " << fullpath << "\n";
+    out() << "Size(B): " << size << "\n";
+    out() << "Creation Time: " << fmt(st.st_ctime) << "\n";
+    out() << "Modification Time: " << fmt(st.st_mtime) << "\n";
+    out() << "Access Time: " << fmt(st.st_atime) << "\n";
 }
 
 static void cmd_search(MiniFileExplorer &app, const std::vector<std::string> &args)
+{
+    // --no-index forces a filesystem walk even when an index covers the directory
+    bool useIndex = true;
+    std::string keyword;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "--no-index")
+            useIndex = false;
+        else
+            keyword = args[i];
+    }
+
+    if (keyword.empty())
+    {
+        fail("search", "Usage: search [--no-index] [keyword]");
+        return;
+    }
+
+    if (structuredOutput())
+    {
+        RecordWriter records(out(), outputFormat(), "search");
+        FileSystem::search(app.getCurrentDir(), keyword, [&](const std::string &path, bool isDir)
+                           {
+            EntryRecord e;
+            e.type = isDir ? DT_DIR : DT_REG;
+            records.entry(path, e); }, useIndex);
+        return;
+    }
+
+    // results are printed as the walk finds them; the count follows at the end
+    size_t count = 0;
+    FileSystem::search(app.getCurrentDir(), keyword, [&](const std::string &path, bool isDir)
+                       {
+        if (count++ == 0)
+            out() << "Search results for '" << keyword << "':\n";
+        out() << path << " (" << (isDir ? "Dir" : "File") << ")\n"; }, useIndex);
+
+    bool cancelled = JobContext::stopRequested();
+    if (count == 0 && !cancelled)
+    {
+        out() << "No results found for '" << keyword << "'\n";
+        return;
+    }
+    out() << "(" << count << " items" << (cancelled ? ", cancelled before the walk finished" : "") << ")\n";
+}
+
+static void cmd_find(MiniFileExplorer &app, const std::vector<std::string> &args)
+{
+    // an optional directory, then the predicates
+    size_t first = 1;
+    std::string target = ".";
+    if (args.size() > 1 && (args[1].empty() || args[1][0] != '-'))
+        target = args[first++];
+
+    FindQuery query;
+    std::string error;
+    if (!query.parse(std::vector<std::string>(args.begin() + first, args.end()), error))
+    {
+        fail("find", error);
+        return;
+    }
+
+    namespace fs = std::filesystem;
+    fs::path dirPath(target);
+    if (dirPath.is_relative())
+        dirPath = fs::path(app.getCurrentDir()) / dirPath;
+    if (!fs::is_directory(dirPath))
+    {
+        fail("find", "Invalid target path");
+        return;
+    }
+
+    // matches are shown under the directory as it was given, like find(1)
+    std::string prefix = target;
+    while (!prefix.empty() && prefix.back() == '/')
+        prefix.pop_back();
+
+    if (structuredOutput())
+    {
+        RecordWriter records(out(), outputFormat(), "find");
+        FindStats stats = Find::run(dirPath.string(), query, [&](const std::string &path, char type)
+                                    {
+            EntryRecord e;
+            e.type = type == 'f' ? DT_REG : type == 'd' ? DT_DIR : type == 'l' ? DT_LNK : DT_UNKNOWN;
+            records.entry(prefix, path, e); });
+        if (!stats.ok)
+            records.error("Failed to read directory");
+        return;
+    }
+
+    FindStats stats = Find::run(dirPath.string(), query, [&](const std::string &path, char)
+                                { out() << prefix << "/" << path << "\n"; });
+    if (!stats.ok)
+    {
+        out() << "Failed to read directory\n";
+        return;
+    }
+
+    // stat calls vs entries shows how much the name predicates saved
+    out() << "(" << stats.matches << " matches; " << stats.entries << " entries, " << stats.stats << " stat'ed";
+    if (stats.pruned)
+        out() << ", " << stats.pruned << " dirs pruned";
+    if (stats.errors)
+        out() << ", " << stats.errors << " errors";
+    out() << (stats.cancelled ? ", cancelled" : "") << "; " << std::fixed << std::setprecision(3) << stats.seconds
+          << "s)\n";
+}
+
+static void cmd_grep(MiniFileExplorer &app, const std::vector<std::string> &args)
+{
+    // -i ignores ASCII case, -l prints only the names of matching files
+    GrepOptions options;
+    std::vector<std::string> operands;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "-i")
+            options.ignoreCase = true;
+        else if (args[i] == "-l")
+            options.filesOnly = true;
+        else
+            operands.push_back(args[i]);
+    }
+
+    if (operands.empty() || operands.size() > 2)
+    {
+        out() << "Usage: grep [-i] [-l] [text] [path]\n";
+        return;
+    }
+    std::string path = operands.size() > 1 ? inCurrentDir(app, operands[1]).string() : app.getCurrentDir();
+
+    // each file's lines arrive together; files come in the order they finish
+    GrepStats stats = Grep::run(path, operands[0], options, [](const std::string &text)
+                                { out() << text; });
+    if (!stats.ok)
+    {
+        out() << "Invalid target path\n";
+        return;
+    }
+
+    out() << "(" << stats.lines << " lines in " << stats.matchedFiles << " files; scanned " << stats.files
+          << " files, " << formatBytes(stats.bytes);
+    if (stats.binary)
+        out() << ", " << stats.binary << " binary skipped";
+    if (stats.errors)
+        out() << ", " << stats.errors << " unreadable";
+    out() << (JobContext::stopRequested() ? ", cancelled before the walk finished" : "") << ")\n";
+}
+
+static void cmd_index(MiniFileExplorer &app, const std::vector<std::string> &args)
 {
     if (args.size() < 2)
     {
-        std::cout << "Usage: search [keyword]" << std::endl;
+        out() << "Usage: index [build|update|status|drop] [dir]\n";
         return;
     }
 
-    const std::string keyword = args[1];
-    std::vector<std::pair<std::string, bool>> results;
-    FileSystem::search(app.getCurrentDir(), keyword, results);
+    const std::string &action = args[1];
+    std::string root = args.size() > 2 ? inCurrentDir(app, args[2]).string() : app.getCurrentDir();
 
-    if (results.empty())
+    if (!FileSystem::exists(root) || !FileSystem::isDir(root))
     {
-        std::cout << "No results found for '" << keyword << "'" << std::endl;
+        out() << "Invalid target path\n";
         return;
     }
 
-    std::cout << "Search results for '" << keyword << "' (" << results.size() << " items):" << std::endl;
-    for (auto &r : results)
+    if (action == "build" || action == "update")
     {
-        std::cout << r.first << " (" << (r.second ? "Dir" : "File") << ")" << std::endl;
+        IndexBuildStats st = FileIndex::build(root, action == "update");
+        if (JobContext::stopRequested())
+        {
+            out() << "Cancelled; the previous index is unchanged\n";
+            return;
+        }
+        if (!st.ok)
+        {
+            out() << "Failed to build index for " << root << "\n";
+            return;
+        }
+        out() << "Indexed " << st.entries << " entries in " << st.dirs << " directories ("
+              << st.trigrams << " trigrams, " << st.bytes << " bytes) in "
+              << std::fixed << std::setprecision(2) << st.seconds << "s\n";
+        out() << "Directories rescanned: " << st.rescanned << ", reused: " << st.reused << "\n";
+    }
+    else if (action == "status")
+    {
+        auto index = FileIndex::openCovering(root);
+        if (!index)
+        {
+            out() << "No index covers " << root << "\n";
+            return;
+        }
+        std::time_t built = static_cast<std::time_t>(index->builtAtNs() / 1000000000LL);
+        std::tm tm{};
+        if (std::tm *p = std::localtime(&built))
+            tm = *p;
+        out() << "=== File Index ===\n";
+        out() << "Root: " << index->root() << "\n";
+        out() << "File: " << FileIndex::indexPath(index->root()) << "\n";
+        out() << "Entries: " << index->entryCount() << "\n";
+        out() << "Directories: " << index->dirCount() << "\n";
+        out() << "Trigrams: " << index->trigramCount() << "\n";
+        out() << "Size(B): " << index->fileSize() << "\n";
+        out() << "Built: " << std::put_time(&tm, "%Y-%m-%d %H:%M:%S") << "\n";
+    }
+    else if (action == "drop")
+    {
+        if (!FileIndex::drop(root))
+            out() << "No index for " << root << "\n";
+    }
+    else
+    {
+        out() << "Usage: index [build|update|status|drop] [dir]\n";
     }
 }
 
-static void cmd_cp(const std::vector<std::string> &args)
+static void cmd_cp_dir(MiniFileExplorer &app, const std::filesystem::path &src, std::filesystem::path dst)
 {
-    if (args.size() < 3)
+    namespace fs = std::filesystem;
+    if (fs::exists(dst) && fs::is_directory(dst))
     {
-        std::cout << "Usage: cp [src] [dst]" << std::endl;
+        dst /= src.filename();
+    }
+    else if (dst.has_parent_path() && !fs::exists(dst.parent_path()))
+    {
+        out() << "Invalid target path\n";
+        return;
+    }
+
+    // copying a tree into itself would never terminate
+    char realSrc[PATH_MAX], realParent[PATH_MAX];
+    fs::path parent = dst.has_parent_path() ? dst.parent_path() : fs::path(".");
+    if (::realpath(src.c_str(), realSrc) && ::realpath(parent.c_str(), realParent))
+    {
+        std::string s(realSrc), p = std::string(realParent) + "/" + dst.filename().string();
+        if (p == s || p.compare(0, s.size() + 1, s + "/") == 0)
+        {
+            out() << "Cannot copy a directory into itself\n";
+            return;
+        }
+    }
+
+    bool overwrite = false;
+    if (fs::exists(dst))
+    {
+        if (!app.confirm(MiniFileExplorer::Confirm::Overwrite, "Directory exists in target: Merge and overwrite? (y/n)"))
+            return;
+        overwrite = true;
+    }
+
+    TreeCopyStats stats;
+    bool ok = FileSystem::copyDir(src.string(), dst.string(), overwrite, &stats);
+    if (!stats.ok)
+    {
+        out() << "Failed to copy\n";
+        return;
+    }
+
+    double rate = stats.seconds > 0 ? static_cast<double>(stats.bytes) / stats.seconds : 0;
+    out() << "Copied " << stats.files << " files, " << stats.dirs << " dirs";
+    if (stats.symlinks)
+        out() << ", " << stats.symlinks << " symlinks";
+    out() << " (" << stats.bytes << " bytes) in " << std::fixed << std::setprecision(3) << stats.seconds
+          << "s (" << std::setprecision(1) << rate / (1024.0 * 1024.0) << " MB/s)\n";
+    if (stats.cancelled)
+        out() << "Cancelled; the copy is incomplete\n";
+    else if (!ok)
+        out() << stats.errors << " entries could not be copied\n";
+}
+
+static void cmd_cp(MiniFileExplorer &app, const std::vector<std::string> &args)
+{
+    bool recursive = args.size() > 1 && args[1] == "-r";
+    std::size_t first = recursive ? 2 : 1;
+    if (args.size() < first + 2)
+    {
+        out() << "Usage: cp [-r] [src] [dst]\n";
         return;
     }
 
     namespace fs = std::filesystem;
-    fs::path src(args[1]);
-    fs::path dst(args[2]);
+    fs::path src = inCurrentDir(app, args[first]);
+    fs::path dst = inCurrentDir(app, args[first + 1]);
 
     if (!fs::exists(src))
     {
-        std::cout << "Source not found" << std::endl;
+        out() << "Source not found\n";
+        return;
+    }
+
+    if (fs::is_directory(src))
+    {
+        if (!recursive)
+        {
+            out() << "Source is a directory (use cp -r)\n";
+            return;
+        }
+        cmd_cp_dir(app, src, dst);
         return;
     }
 
     if (!fs::is_regular_file(src))
     {
-        std::cout << "Source not found" << std::endl;
+        out() << "Source not found\n";
         return;
     }
 
@@ -442,52 +899,122 @@ static void cmd_cp(const std::vector<std::string> &args)
     }
     else if (!fs::exists(dst.parent_path()))
     {
-        std::cout << "Invalid target path" << std::endl;
+        out() << "Invalid target path\n";
         return;
     }
 
+    std::error_code ec;
     bool overwrite = false;
-    if (fs::exists(dst))
+    if (fs::exists(fs::symlink_status(dst, ec)))
     {
-        std::cout << "File exists in target: Overwrite? (y/n)" << std::endl;
-        std::string ans;
-        std::getline(std::cin, ans);
-        if (ans != "y")
+        if (!app.confirm(MiniFileExplorer::Confirm::Overwrite, "File exists in target: Overwrite? (y/n)"))
             return;
         overwrite = true;
     }
 
-    if (!FileSystem::copyFile(src.string(), dst.string(), overwrite))
+    CopyReport report;
+    if (!FileSystem::copyFile(src.string(), dst.string(), overwrite, &report))
     {
-        std::cout << "Failed to copy" << std::endl;
+        out() << (JobContext::stopRequested() ? "Cancelled\n" : "Failed to copy\n");
+        return;
     }
+
+    out() << "Copied " << report.bytes << " bytes in " << std::fixed << std::setprecision(3)
+          << report.seconds << "s (" << std::setprecision(1) << report.bytesPerSec() / (1024.0 * 1024.0)
+          << " MB/s) via " << copyMethodName(report.method) << "\n";
+}
+
+static void cmd_sync(MiniFileExplorer &app, const std::vector<std::string> &args)
+{
+    // -n/--dry-run only counts, --delete removes target entries the source lacks
+    SyncOptions options;
+    std::vector<std::string> operands;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "-n" || args[i] == "--dry-run")
+            options.dryRun = true;
+        else if (args[i] == "--delete")
+            options.deleteExtra = true;
+        else
+            operands.push_back(args[i]);
+    }
+    if (operands.size() != 2)
+    {
+        out() << "Usage: sync [-n] [--delete] [src] [dst]\n";
+        return;
+    }
+
+    namespace fs = std::filesystem;
+    fs::path src = inCurrentDir(app, operands[0]), dst = inCurrentDir(app, operands[1]);
+    if (!fs::is_directory(src))
+    {
+        out() << "Source is not a directory\n";
+        return;
+    }
+    if (fs::exists(dst) && !fs::is_directory(dst))
+    {
+        out() << "Target exists and is not a directory\n";
+        return;
+    }
+
+    // the mirror must not live inside its source (or the reverse, with --delete)
+    char realSrc[PATH_MAX], realParent[PATH_MAX];
+    fs::path parent = dst.has_parent_path() ? dst.parent_path() : fs::path(".");
+    if (::realpath(src.c_str(), realSrc) && ::realpath(parent.c_str(), realParent))
+    {
+        std::string s(realSrc), d = std::string(realParent) + "/" + dst.filename().string();
+        if (d == s || d.compare(0, s.size() + 1, s + "/") == 0 || s.compare(0, d.size() + 1, d + "/") == 0)
+        {
+            out() << "Source and target overlap\n";
+            return;
+        }
+    }
+
+    TreeCopyStats stats = TreeCopy::sync(src.string(), dst.string(), options);
+    if (!stats.ok)
+    {
+        out() << "Invalid target path\n";
+        return;
+    }
+
+    out() << (options.dryRun ? "Would copy " : "Copied ") << stats.files << " files";
+    if (stats.symlinks)
+        out() << ", " << stats.symlinks << " symlinks";
+    out() << " (" << formatBytes(stats.bytes) << "), " << stats.skipped << " up to date";
+    if (options.deleteExtra || stats.deleted)
+        out() << ", " << (options.dryRun ? "would delete " : "deleted ") << stats.deleted;
+    out() << "; " << stats.dirs << " dirs in " << std::fixed << std::setprecision(3) << stats.seconds << "s\n";
+    if (stats.cancelled)
+        out() << "Cancelled; the mirror is incomplete\n";
+    else if (stats.errors)
+        out() << stats.errors << " entries could not be synced\n";
 }
 
 static void cmd_mv(const std::vector<std::string> &args, MiniFileExplorer &app)
 {
     if (args.size() < 3)
     {
-        std::cout << "Usage: mv [src] [dst]" << std::endl;
+        out() << "Usage: mv [src] [dst]\n";
         return;
     }
 
     namespace fs = std::filesystem;
-    fs::path src(args[1]);
-    fs::path dst(args[2]);
+    fs::path src = inCurrentDir(app, args[1]);
+    fs::path dst = inCurrentDir(app, args[2]);
 
     if (!fs::exists(src))
     {
-        std::cout << "Source not found" << std::endl;
+        out() << "Source not found\n";
         return;
     }
 
     if (fs::exists(dst) && fs::is_directory(dst))
     {
-        dst /= src.filename();
+        dst = FileSystem::moveTarget(src.string(), dst.string());
     }
     else if (dst.has_parent_path() && !fs::exists(dst.parent_path()))
     {
-        std::cout << "Invalid target path" << std::endl;
+        out() << "Invalid target path\n";
         return;
     }
 
@@ -497,56 +1024,305 @@ static void cmd_mv(const std::vector<std::string> &args, MiniFileExplorer &app)
     {
         if (std::string(realSrc) == std::string(realDst))
         {
-            std::cout << "Source and destination are the same file" << std::endl;
+            out() << "Source and destination are the same file\n";
             return;
         }
     }
 
+    // refuse before asking to confirm a replacement FileSystem::move would not make
+    std::error_code ec;
+    if (fs::exists(fs::symlink_status(dst, ec)) && !FileSystem::canReplace(src.string(), dst.string()))
+    {
+        out() << "Cannot replace " << dst.string() << " with " << src.string() << "\n";
+        return;
+    }
+
     bool overwrite = false;
-    if (fs::exists(dst))
+    if (fs::exists(fs::symlink_status(dst, ec)))
     {
-        std::cout << "File exists in target: Overwrite? (y/n)" << std::endl;
-        std::string ans;
-        std::getline(std::cin, ans);
-        if (ans != "y")
+        const char *prompt = fs::is_directory(fs::symlink_status(dst, ec))
+                                 ? "Directory exists in target: Replace it and everything in it? (y/n)"
+                                 : "File exists in target: Overwrite? (y/n)";
+        if (!app.confirm(MiniFileExplorer::Confirm::Overwrite, prompt))
             return;
         overwrite = true;
     }
 
+    std::string movedFrom = FileSystem::entryPath(src.string());
     if (!FileSystem::move(src.string(), dst.string(), overwrite))
     {
-        std::cout << "Failed to move" << std::endl;
+        out() << (JobContext::stopRequested() ? "Cancelled; the source was kept\n" : "Failed to move\n");
+        return;
+    }
+
+    // the session was standing in what moved (or below it): follow it
+    std::string cur = app.getCurrentDir();
+    if (cur == movedFrom || cur.compare(0, movedFrom.size() + 1, movedFrom + "/") == 0)
+        app.setCurrentDir(FileSystem::entryPath(dst.string()) + cur.substr(movedFrom.size()));
+}
+
+static void cmd_dupes(MiniFileExplorer &app, const std::vector<std::string> &args)
+{
+    namespace fs = std::filesystem;
+    fs::path dirPath = args.size() > 1 ? fs::path(args[1]) : fs::path(app.getCurrentDir());
+    if (dirPath.is_relative())
+        dirPath = fs::path(app.getCurrentDir()) / dirPath;
+
+    if (!fs::exists(dirPath) || !fs::is_directory(dirPath))
+    {
+        out() << "Invalid target path\n";
+        return;
+    }
+
+    std::vector<DupeSet> sets;
+    DupesStats stats = Dupes::find(dirPath.string(), sets);
+    if (!stats.ok)
+    {
+        out() << "Failed to read directory\n";
+        return;
+    }
+    if (stats.cancelled)
+    {
+        out() << "Cancelled\n";
         return;
     }
 
-    // If moved a directory that is current dir, update app currentDir
-    try
+    for (const DupeSet &set : sets)
     {
-        char cwd[PATH_MAX];
-        getcwd(cwd, sizeof(cwd));
-        std::string cur = cwd;
-        if (cur.find(src.string()) == 0)
+        out() << set.paths.size() << " x " << formatBytes(set.size) << " (" << formatBytes(set.reclaimable())
+              << " reclaimable)\n";
+        for (const std::string &path : set.paths)
+            out() << "  " << path << "\n";
+    }
+
+    // each stage narrows the candidates the next one has to read
+    out() << "(" << sets.size() << " sets, " << stats.duplicates << " duplicate files, "
+          << formatBytes(stats.reclaimable) << " reclaimable; " << stats.files << " files, "
+          << stats.sizeMatches << " same size, " << stats.prefixMatches << " same prefix, "
+          << formatBytes(stats.bytesHashed) << " hashed";
+    if (stats.errors)
+        out() << ", " << stats.errors << " unreadable";
+    out() << ")\n";
+}
+
+static void printTop(const char *title, const std::vector<TopEntry> &entries)
+{
+    out() << title << ":\n";
+    for (const TopEntry &e : entries)
+        out() << "  " << std::setw(10) << formatBytes(e.size) << "  " << e.path << "\n";
+}
+
+static void cmd_top(MiniFileExplorer &app, const std::vector<std::string> &args)
+{
+    // -A ranks by allocated blocks, as in du
+    size_t count = 10;
+    bool allocated = false;
+    std::string target;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "-n" && i + 1 < args.size())
         {
-            char newcwd[PATH_MAX];
-            if (::realpath(dst.string().c_str(), newcwd))
-                app.setCurrentDir(newcwd);
+            char *end = nullptr;
+            long long n = std::strtoll(args[++i].c_str(), &end, 10);
+            if (*end || n <= 0 || static_cast<unsigned long long>(n) > TopN::MAX_COUNT)
+            {
+                fail("top", "Invalid count: " + args[i] + " (1 to " + std::to_string(TopN::MAX_COUNT) + ")");
+                return;
+            }
+            count = static_cast<size_t>(n);
+        }
+        else if (args[i] == "-A")
+            allocated = true;
+        else if (target.empty())
+            target = args[i];
+        else
+        {
+            fail("top", "Usage: top [-n N] [-A] [dir]");
+            return;
         }
     }
-    catch (...)
+
+    namespace fs = std::filesystem;
+    fs::path dirPath = target.empty() ? fs::path(app.getCurrentDir()) : fs::path(target);
+    if (dirPath.is_relative())
+        dirPath = fs::path(app.getCurrentDir()) / dirPath;
+
+    if (!fs::exists(dirPath) || !fs::is_directory(dirPath))
     {
+        fail("top", "Invalid target path");
+        return;
     }
+
+    std::vector<TopEntry> files, dirs;
+    TopStats stats = TopN::scan(dirPath.string(), count, allocated, files, dirs);
+    if (!stats.ok)
+    {
+        fail("top", "Failed to read directory");
+        return;
+    }
+    if (structuredOutput())
+    {
+        // files first, then directories, each largest first; paths are relative to the root
+        RecordWriter records(out(), outputFormat(), "top");
+        if (stats.cancelled)
+            return;
+        EntryRecord e;
+        e.fields = ENTRY_HAS_SIZE;
+        e.type = DT_REG;
+        for (const TopEntry &f : files)
+        {
+            e.size = static_cast<std::int64_t>(f.size);
+            records.entry(f.path, e);
+        }
+        e.type = DT_DIR;
+        for (const TopEntry &d : dirs)
+        {
+            e.size = static_cast<std::int64_t>(d.size);
+            records.entry(d.path, e);
+        }
+        return;
+    }
+    if (stats.cancelled)
+    {
+        out() << "Cancelled\n";
+        return;
+    }
+
+    printTop("Largest files", files);
+    printTop("Largest directories", dirs);
+    out() << "(" << formatBytes(stats.total) << (allocated ? " allocated" : "") << " in " << stats.files
+          << " files, " << stats.dirs << " dirs";
+    if (stats.errors)
+        out() << ", " << stats.errors << " unreadable";
+    out() << "; " << std::fixed << std::setprecision(3) << stats.seconds << "s)\n";
+}
+
+static void cmd_snapshot(const MiniFileExplorer &app, const std::vector<std::string> &args)
+{
+    // --full re-reads every directory instead of trusting unchanged directory mtimes
+    bool full = false;
+    std::vector<std::string> operands;
+    for (size_t i = 2; i < args.size(); ++i)
+    {
+        if (args[i] == "--full")
+            full = true;
+        else
+            operands.push_back(inCurrentDir(app, args[i]).string());
+    }
+    std::string action = args.size() > 1 ? args[1] : "";
+
+    if (action == "save" && operands.size() == 2)
+    {
+        if (!FileSystem::isDir(operands[0]))
+        {
+            out() << "Invalid target path\n";
+            return;
+        }
+        ManifestScanStats scan;
+        auto t0 = std::chrono::steady_clock::now();
+        std::unique_ptr<Manifest> manifest = Manifest::scan(operands[0], nullptr, scan);
+        if (scan.cancelled)
+        {
+            out() << "Cancelled; no manifest written\n";
+            return;
+        }
+        if (!manifest || !manifest->save(operands[1]))
+        {
+            out() << "Failed to write manifest: " << operands[1] << "\n";
+            return;
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        out() << "Saved " << manifest->size() << " entries of " << manifest->root() << " to " << operands[1]
+              << " in " << std::fixed << std::setprecision(3) << seconds << "s\n";
+        if (scan.errors)
+            out() << scan.errors << " entries could not be read\n";
+        return;
+    }
+
+    if (action != "diff" || operands.empty() || operands.size() > 2)
+    {
+        out() << "Usage: snapshot save [dir] [file] | snapshot diff [--full] [file] [dir|file]\n";
+        return;
+    }
+
+    std::unique_ptr<Manifest> before = Manifest::load(operands[0]);
+    if (!before)
+    {
+        out() << "Not a manifest: " << operands[0] << "\n";
+        return;
+    }
+
+    // the other side is a second manifest, or a live tree (by default the one recorded)
+    std::unique_ptr<Manifest> after;
+    ManifestScanStats scan;
+    bool live = true;
+    if (operands.size() > 1 && !FileSystem::isDir(operands[1]))
+    {
+        after = Manifest::load(operands[1]);
+        live = false;
+        if (!after)
+        {
+            out() << "Not a manifest or directory: " << operands[1] << "\n";
+            return;
+        }
+    }
+    else
+    {
+        std::string root = operands.size() > 1 ? operands[1] : before->root();
+        after = Manifest::scan(root, full ? nullptr : before.get(), scan);
+        if (!after)
+        {
+            out() << "Invalid target path\n";
+            return;
+        }
+        if (scan.cancelled)
+        {
+            out() << "Cancelled\n";
+            return;
+        }
+    }
+
+    std::uint64_t counts[3] = {};
+    Manifest::diff(*before, *after, [&](ManifestChange kind, const std::string &path, const std::string &what)
+                   {
+        static const char marks[] = {'+', '-', '~'};
+        ++counts[static_cast<int>(kind)];
+        out() << marks[static_cast<int>(kind)] << " " << (path.empty() ? "." : path);
+        if (!what.empty())
+            out() << " (" << what << ")";
+        out() << "\n"; });
+
+    out() << "(" << counts[0] << " added, " << counts[1] << " removed, " << counts[2] << " modified";
+    if (live)
+        out() << "; " << scan.dirsRead << " dirs read, " << scan.dirsPruned << " unchanged dirs skipped";
+    if (scan.errors)
+        out() << ", " << scan.errors << " unreadable";
+    out() << ")\n";
 }
 
 static void cmd_du(MiniFileExplorer &app, const std::vector<std::string> &args)
 {
-    if (args.size() < 2)
+    // -A reports allocated blocks instead of apparent size, --no-cache forces a full walk
+    bool allocated = false, useCache = true;
+    std::string target;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "-A")
+            allocated = true;
+        else if (args[i] == "--no-cache")
+            useCache = false;
+        else
+            target = args[i];
+    }
+
+    if (target.empty())
     {
-        std::cout << "Usage: du [dirname]" << std::endl;
+        fail("du", "Usage: du [-A] [--no-cache] [dirname]");
         return;
     }
 
     namespace fs = std::filesystem;
-    fs::path inPath(args[1]);
+    fs::path inPath(target);
     fs::path dirPath;
     if (inPath.is_absolute())
         dirPath = inPath;
@@ -555,57 +1331,247 @@ static void cmd_du(MiniFileExplorer &app, const std::vector<std::string> &args)
 
     if (!fs::exists(dirPath) || !fs::is_directory(dirPath))
     {
-        std::cout << "Invalid target path" << std::endl;
+        fail("du", "Invalid target path");
         return;
     }
 
-    unsigned long long total = 0;
-    try
+    DuResult du = DiskUsage::scan(dirPath.string(), useCache);
+    DirSizeCache::instance().save();
+    if (structuredOutput())
     {
-        for (auto it = fs::recursive_directory_iterator(dirPath, fs::directory_options::skip_permission_denied);
-             it != fs::recursive_directory_iterator(); ++it)
-        {
-            try
-            {
-                if (fs::is_regular_file(it->path()))
-                {
-                    total += fs::file_size(it->path());
-                }
-            }
-            catch (...)
-            {
-                // ignore files we can't stat
-            }
-        }
+        // both sizes are in the record, so -A changes nothing here
+        RecordWriter records(out(), outputFormat(), "du");
+        if (!du.ok)
+            records.error("Failed to calculate directory size");
+        else if (!JobContext::stopRequested())
+            records.total(target, du.apparent, du.allocated, du.files, du.dirs);
+        return;
     }
-    catch (...)
+    if (JobContext::stopRequested())
     {
-        std::cout << "Failed to calculate directory size" << std::endl;
+        out() << "Cancelled\n";
         return;
     }
+    if (!du.ok)
+    {
+        out() << "Failed to calculate directory size\n";
+        return;
+    }
+    unsigned long long total = allocated ? du.allocated : du.apparent;
 
-    std::string out;
+    std::string sizeText;
     const unsigned long long MB = 1024ULL * 1024ULL;
     const unsigned long long KB = 1024ULL;
     if (total >= MB)
     {
         unsigned long long val = (total + MB / 2) / MB; // rounded
-        out = std::to_string(val) + "MB";
+        sizeText = std::to_string(val) + "MB";
     }
     else
     {
         unsigned long long val = (total + KB / 2) / KB; // rounded
-        out = std::to_string(val) + "KB";
+        sizeText = std::to_string(val) + "KB";
     }
 
-    std::cout << "Total size of " << args[1] << ": " << out << std::endl;
+    out() << "Total size of " << target << ": " << sizeText << (allocated ? " (allocated)" : "") << "\n";
 }
 
-void handleCommand(MiniFileExplorer &app, const std::vector<std::string> &args)
+static void cmd_watch(MiniFileExplorer &app, const std::vector<std::string> &args)
 {
-    if (args.empty())
+    bool recursive = false;
+    double limit = 0; // seconds, 0 until Ctrl-C
+    std::string target;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "-r")
+            recursive = true;
+        else if (args[i] == "-t" && i + 1 < args.size())
+            limit = std::atof(args[++i].c_str());
+        else
+            target = args[i];
+    }
+
+    namespace fs = std::filesystem;
+    fs::path dirPath = target.empty() ? fs::path(app.getCurrentDir()) : fs::path(target);
+    if (dirPath.is_relative())
+        dirPath = fs::path(app.getCurrentDir()) / dirPath;
+    if (!fs::is_directory(dirPath))
+    {
+        out() << "Invalid target path\n";
+        return;
+    }
+    std::string root = dirPath.lexically_normal().string();
+    while (root.size() > 1 && root.back() == '/')
+        root.pop_back();
+
+    DirWatch watch;
+    if (!watch.ok())
+    {
+        out() << "inotify is not available\n";
         return;
+    }
+    if (!watch.add(root, recursive))
+    {
+        out() << "Cannot watch " << root << "\n";
+        return;
+    }
+    out() << "Watching " << root << " (" << watch.watches() << " directories";
+    if (watch.failed())
+        out() << ", " << watch.failed() << " could not be watched: see fs.inotify.max_user_watches";
+    out() << "); Ctrl-C stops\n";
+    out().flush();
+
+    // paths are shown relative to the watched directory
+    auto shown = [&](const std::string &dir, const std::string &name, bool isDir)
+    {
+        std::string path = dir.size() > root.size() ? dir.substr(root == "/" ? 1 : root.size() + 1) : "";
+        if (!name.empty())
+            path += (path.empty() ? "" : "/") + name;
+        if (path.empty())
+            path = ".";
+        return isDir ? path + "/" : path;
+    };
 
+    auto start = std::chrono::steady_clock::now();
+    std::vector<WatchEvent> batch;
+    std::uint64_t batches = 0, events = 0;
+    bool gone = false;
+    while (!gone && !JobContext::stopRequested())
+    {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (limit > 0 && elapsed >= limit)
+            break;
+        // short waits so Ctrl-C and -t are noticed promptly
+        if (!watch.read(batch, 200))
+            continue;
+        ++batches;
+        for (const WatchEvent &ev : batch)
+        {
+            ++events;
+            switch (ev.kind)
+            {
+            case WatchEvent::Created:
+                out() << "+ " << shown(ev.dir, ev.name, ev.isDir) << "\n";
+                break;
+            case WatchEvent::Deleted:
+                out() << "- " << shown(ev.dir, ev.name, ev.isDir) << "\n";
+                gone = gone || (ev.name.empty() && ev.dir == root);
+                break;
+            case WatchEvent::Modified:
+                out() << "~ " << shown(ev.dir, ev.name, ev.isDir) << "\n";
+                break;
+            case WatchEvent::Moved:
+                out() << "> " << shown(ev.fromDir, ev.fromName, ev.isDir) << " -> " << shown(ev.dir, ev.name, ev.isDir)
+                      << "\n";
+                break;
+            case WatchEvent::Overflow:
+                out() << "! event queue overflowed, some changes were missed\n";
+                break;
+            }
+        }
+        out().flush();
+    }
+    if (gone)
+        out() << "Watched directory was removed\n";
+    out() << "(" << events << " changes in " << batches << " batches from " << watch.rawEvents()
+          << " inotify events)\n";
+}
+
+static void cmd_cache(const std::vector<std::string> &args)
+{
+    DirSizeCache &cache = DirSizeCache::instance();
+
+    if (args.size() > 1 && args[1] == "clear")
+    {
+        cache.clear();
+        ListingCache::instance().clear();
+        out() << "Directory size and listing caches cleared\n";
+        return;
+    }
+    if (args.size() > 1 && (args[1] == "on" || args[1] == "off"))
+    {
+        DirSizeCache::setEnabled(args[1] == "on");
+        out() << "Directory size cache " << (args[1] == "on" ? "enabled" : "disabled") << "\n";
+        return;
+    }
+    if (args.size() > 1)
+    {
+        out() << "Usage: cache [clear|on|off]\n";
+        return;
+    }
+
+    DirSizeCache::Stats st = cache.stats();
+    unsigned long long lookups = st.hits + st.misses;
+    std::ostringstream rate;
+    rate << std::fixed << std::setprecision(1)
+         << (lookups ? 100.0 * static_cast<double>(st.hits) / static_cast<double>(lookups) : 0.0) << "%";
+
+    out() << "=== Directory Size Cache ===\n";
+    out() << "State: " << (DirSizeCache::enabled() ? "on" : "off (enable with 'cache on')") << "\n";
+    out() << "File: " << st.path << "\n";
+    out() << "Entries: " << st.entries << " (" << formatBytes(st.bytes) << " of " << formatBytes(DirSizeCache::MAX_BYTES)
+          << ", " << st.evictions << " evicted)\n";
+    out() << "Lookups: " << lookups << " (hits " << st.hits << ", misses " << st.misses << ")\n";
+    out() << "Hit rate: " << rate.str() << "\n";
+    out() << "Stored this session: " << st.stores << "\n";
+
+    ListingCache::Stats ls = ListingCache::instance().stats();
+    lookups = ls.hits + ls.misses;
+    out() << "\n=== Listing Cache ===\n";
+    out() << "Directories: " << ls.dirs << " (" << ls.entries << " entries)\n";
+    out() << "Lookups: " << lookups << " (hits " << ls.hits << ", misses " << ls.misses << ")\n";
+    out() << "Invalidated by changes: " << ls.invalidations << "\n";
+}
+
+static void cmd_stats(const std::vector<std::string> &args)
+{
+    CommandStats &stats = CommandStats::instance();
+    if (args.size() > 1 && args[1] == "clear")
+    {
+        stats.clear();
+        out() << "Command statistics cleared\n";
+        return;
+    }
+    if (args.size() > 1 && (args[1] == "on" || args[1] == "off"))
+    {
+        stats.verbose = args[1] == "on";
+        out() << "Per-command summary " << (stats.verbose ? "enabled" : "disabled") << "\n";
+        return;
+    }
+    stats.print(out(), args.size() > 1 ? args[1] : std::string());
+}
+
+static void cmd_jobs()
+{
+    JobTable::instance().list(out());
+}
+
+static void cmd_fg(const std::vector<std::string> &args)
+{
+    int id = args.size() > 1 ? std::atoi(args[1].c_str()) : 0;
+    if (!JobTable::instance().foreground(id, out()))
+        out() << (id ? "No such job: " + args[1] + "\n" : std::string("No jobs\n"));
+}
+
+static void cmd_kill(const std::vector<std::string> &args)
+{
+    if (args.size() < 2)
+    {
+        out() << "Usage: kill <job id>\n";
+        return;
+    }
+    int id = std::atoi(args[1].c_str());
+    if (!JobTable::instance().cancel(id))
+    {
+        out() << "No such job: " << args[1] << "\n";
+        return;
+    }
+    out() << "Cancelling job " << id << "\n";
+}
+
+// Runs the command; false if it is not one.
+static bool dispatch(MiniFileExplorer &app, const std::vector<std::string> &args)
+{
     const std::string &cmd = args[0];
 
     if (cmd == "help")
@@ -617,23 +1583,137 @@ void handleCommand(MiniFileExplorer &app, const std::vector<std::string> &args)
     else if (cmd == "exit")
         cmd_exit();
     else if (cmd == "touch")
-        cmd_touch(args);
+        cmd_touch(app, args);
     else if (cmd == "mkdir")
-        cmd_mkdir(args);
+        cmd_mkdir(app, args);
     else if (cmd == "rm")
         cmd_rm(app, args);
     else if (cmd == "rmdir")
-        cmd_rmdir(args);
+        cmd_rmdir(app, args);
     else if (cmd == "cp")
-        cmd_cp(args);
+        cmd_cp(app, args);
+    else if (cmd == "sync")
+        cmd_sync(app, args);
     else if (cmd == "mv")
         cmd_mv(args, app);
     else if (cmd == "du")
         cmd_du(app, args);
     else if (cmd == "stat")
-        cmd_stat(args);
+        cmd_stat(app, args);
+    else if (cmd == "snapshot")
+        cmd_snapshot(app, args);
+    else if (cmd == "dupes")
+        cmd_dupes(app, args);
+    else if (cmd == "top")
+        cmd_top(app, args);
     else if (cmd == "search")
         cmd_search(app, args);
+    else if (cmd == "find")
+        cmd_find(app, args);
+    else if (cmd == "grep")
+        cmd_grep(app, args);
+    else if (cmd == "watch")
+        cmd_watch(app, args);
+    else if (cmd == "cache")
+        cmd_cache(args);
+    else if (cmd == "index")
+        cmd_index(app, args);
+    else if (cmd == "stats")
+        cmd_stats(args);
+    else if (cmd == "jobs")
+        cmd_jobs();
+    else if (cmd == "fg")
+        cmd_fg(args);
+    else if (cmd == "kill")
+        cmd_kill(args);
     else
-        std::cout << "Unknown command: " << cmd << "\n";
-}
\ No newline at end of file
+        return false;
+    return true;
+}
+
+// Runs one command with instrumentation on the calling thread.
+static void runCommand(MiniFileExplorer &app, const std::vector<std::string> &args)
+{
+    const std::string &cmd = args[0];
+    std::string line = cmd;
+    for (size_t i = 1; i < args.size(); ++i)
+        line += " " + args[i];
+
+    CommandProbe probe;
+    bool known;
+    {
+        TraceSpan span(line, "command");
+        known = dispatch(app, args);
+        if (known && Trace::enabled())
+        {
+            CommandSample s = probe.finish();
+            span.setArgs("\"entries\":" + std::to_string(s.entries) + ",\"bytes_read\":" + std::to_string(s.bytesRead) +
+                         ",\"bytes_written\":" + std::to_string(s.bytesWritten) +
+                         ",\"syscalls\":" + std::to_string(s.syscalls) +
+                         ",\"cpu_us\":" + std::to_string(static_cast<long long>(s.cpuSeconds * 1e6)));
+        }
+    }
+    Trace::flush();
+
+    if (!known)
+    {
+        out() << "Unknown command: " << cmd << "\n";
+        return;
+    }
+    // `stats` itself stays out of the numbers it reports
+    if (cmd == "stats")
+        return;
+    CommandSample sample = probe.finish();
+    CommandStats &stats = CommandStats::instance();
+    stats.record(cmd, sample);
+    if (stats.verbose)
+        CommandStats::printSample(out(), cmd, sample);
+}
+
+// Removes a trailing "&" (separate or attached to the last word); true if there was one.
+static bool stripBackground(std::vector<std::string> &args)
+{
+    std::string &last = args.back();
+    if (last.empty() || last.back() != '&')
+        return false;
+    last.pop_back();
+    if (last.empty())
+        args.pop_back();
+    return true;
+}
+
+void handleCommand(MiniFileExplorer &app, const std::vector<std::string> &args)
+{
+    if (args.empty())
+        return;
+
+    std::vector<std::string> command = args;
+    if (stripBackground(command))
+    {
+        if (command.empty())
+            return;
+        const std::string &cmd = command[0];
+        // these act on the session itself
+        if (cmd == "cd" || cmd == "exit" || cmd == "jobs" || cmd == "fg" || cmd == "kill")
+        {
+            out() << cmd << " cannot run in the background\n";
+            return;
+        }
+        std::string line = cmd;
+        for (size_t i = 1; i < command.size(); ++i)
+            line += " " + command[i];
+
+        // the job gets its own copy of the session: it sees the current
+        // directory as of now and answers prompts like batch mode
+        MiniFileExplorer jobApp = app;
+        jobApp.setBatch(true);
+        int id = JobTable::instance().start(line, [jobApp, command]() mutable { runCommand(jobApp, command); });
+        out() << "[" << id << "] " << line << "\n";
+        return;
+    }
+
+    JobContext job;
+    JobScope scope(&job);
+    JobTable::Foreground foreground(&job);
+    runCommand(app, command);
+}
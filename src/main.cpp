@@ -1,19 +1,111 @@
 #include "MiniFileExplorer.h"
+#include "Client.h"
 #include "FileSystem.h"
+#include "RecordWriter.h"
+#include "Server.h"
+#include "StatBatch.h"
 
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <unistd.h>
 
+namespace {
+
+const std::size_t BATCH_OUTPUT_BUFFER = 1 << 20;
+
+// Batch output goes to the terminal or a pipe in 1 MiB writes instead of
+// one write per line. Must run before anything is written to std::cout.
+void useBatchOutput() {
+    static char buffer[BATCH_OUTPUT_BUFFER];
+    std::ios::sync_with_stdio(false);
+    std::cout.rdbuf()->pubsetbuf(buffer, sizeof(buffer));
+    std::cin.tie(nullptr); // reading the next script line must not flush
+}
+
+void usage() {
+    std::cout << "Usage: MiniFileExplorer [--io=sync|uring] [--format=text|ndjson|bin] [-c \"cmd; cmd\" | -f script|-] [--yes] [--no-clobber] [startDir]\n"
+              << "       MiniFileExplorer [--io=sync|uring] --serve <socket>\n"
+              << "       MiniFileExplorer --connect <socket> [command args...]\n";
+}
+
+} // namespace
+
 int main(int argc, char* argv[]) {
     std::string startDir;
+    std::string commands, script;
+    bool haveCommands = false, yes = false, noClobber = false;
+    std::string backendArg, formatArg, serveSocket;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--io=", 0) == 0) {
+            backendArg = arg.substr(5);
+        } else if (arg.rfind("--format=", 0) == 0) {
+            formatArg = arg.substr(9);
+        } else if (arg == "-c" || arg == "-f") {
+            if (i + 1 >= argc) {
+                std::cout << "Missing argument for " << arg << "\n";
+                usage();
+                return 1;
+            }
+            (arg == "-c" ? commands : script) = argv[++i];
+            haveCommands = haveCommands || arg == "-c";
+        } else if (arg == "--serve" || arg == "--connect") {
+            if (i + 1 >= argc) {
+                std::cout << "Missing argument for " << arg << "\n";
+                usage();
+                return 1;
+            }
+            if (arg == "--connect") {
+                // Everything after the socket is the command; without one,
+                // commands are read from stdin.
+                std::string socketPath = argv[++i];
+                return Client::run(socketPath, std::vector<std::string>(argv + i + 1, argv + argc), std::cin);
+            }
+            serveSocket = argv[++i];
+        } else if (arg == "--yes" || arg == "-y") {
+            yes = true;
+        } else if (arg == "--no-clobber" || arg == "-n") {
+            noClobber = true;
+        } else if (arg == "--help" || arg == "-h") {
+            usage();
+            return 0;
+        } else {
+            startDir = arg;
+        }
+    }
+
+    bool batch = haveCommands || !script.empty();
+    if (batch) useBatchOutput();
+
+    if (!backendArg.empty()) {
+        StatBackend backend;
+        if (!parseStatBackend(backendArg, backend)) {
+            std::cout << "Unknown I/O backend: " << backendArg << " (use sync or uring)\n";
+            return 1;
+        }
+        setStatBackend(backend);
+        if (statBackend() != backend)
+            std::cout << "io_uring is not available, using synchronous stat\n";
+    }
 
-    if (argc == 1) {
+    if (!formatArg.empty()) {
+        OutputFormat format;
+        if (!parseOutputFormat(formatArg, format)) {
+            std::cout << "Unknown output format: " << formatArg << " (use text, ndjson or bin)\n";
+            return 1;
+        }
+        setOutputFormat(format);
+    }
+
+    if (!serveSocket.empty()) return Server::run(serveSocket);
+
+    if (startDir.empty()) {
         char buf[1024];
         getcwd(buf, sizeof(buf));
         startDir = buf;
     } else {
-        startDir = argv[1];
-
         if (!FileSystem::exists(startDir)) {
             std::cout << "Directory not found: " << startDir << "\n";
             return 1;
@@ -26,6 +118,26 @@ int main(int argc, char* argv[]) {
     }
 
     MiniFileExplorer app(startDir);
-    app.run();
+    app.setAssumeYes(yes);
+    app.setNoClobber(noClobber);
+    if (!batch) {
+        app.run();
+        return 0;
+    }
+
+    if (haveCommands) {
+        std::istringstream in(commands);
+        app.runBatch(in);
+    }
+    if (script == "-") {
+        app.runBatch(std::cin);
+    } else if (!script.empty()) {
+        std::ifstream in(script);
+        if (!in) {
+            std::cout << "Cannot open script: " << script << "\n";
+            return 1;
+        }
+        app.runBatch(in);
+    }
     return 0;
-}
\ No newline at end of file
+}